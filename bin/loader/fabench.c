@@ -0,0 +1,241 @@
+/*****************************************
+ * Formula AllCode Robot Buggy bootloader
+ *
+ * Flashing throughput benchmark.  Runs
+ * the faload sequence against the
+ * bootloader emulator in each flashing
+ * mode and reports modelled throughput,
+ * reports, round trips, retries and
+ * pages erased.
+ *
+ * Build: cc -O2 -o fabench fabench.c
+ *        faflash.c faproto.c faemu.c
+ *
+ *****************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "faproto.h"
+#include "faflash.h"
+#include "faemu.h"
+
+const char *short_opts = "s:l:r:S:oh";
+
+struct option long_opts[] = {
+    {"size", required_argument, NULL, 's'},
+    {"latency", required_argument, NULL, 'l'},
+    {"error-rate", required_argument, NULL, 'r'},
+    {"seed", required_argument, NULL, 'S'},
+    {"old-bootloader", no_argument, NULL, 'o'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+};
+
+#define USAGE "Usage: fabench [ -s bytes ] [ -l report_us ] [ -r error_rate ] [ -S seed ] [ -o ] [ hexfile ]\n"
+
+const char *help_text = USAGE
+"\n"
+"   Flashes FILE (or a synthetic image of -s bytes, default 24576)\n"
+"   into the bootloader emulator once per flashing mode.\n"
+"\n"
+"   OPTIONS:\n"
+"       -s, --size        Synthetic image size in bytes\n"
+"       -l, --latency     Modelled time per HID report, microseconds\n"
+"       -r, --error-rate  Probability that a report is corrupted\n"
+"       -S, --seed        Error injection seed\n"
+"       -o, --old-bootloader  Emulate a 1.0 bootloader without page erase\n"
+;
+
+/* One way of flashing an image, as selected by faload options */
+
+typedef struct bench_mode {
+    const char *name;
+    int check;
+    int full_erase;
+} bench_mode;
+
+const bench_mode modes[] = {
+    {"full", 0, 1},         // faload -F FILE
+    {"full/check", 1, 1},   // faload -F -c FILE
+    {"pages", 0, 0},        // faload FILE
+    {"pages/check", 1, 0},  // faload -c FILE
+};
+
+/* Write a synthetic Intel hex image laid out like XC16 output */
+
+void synth_hex (FILE *hf, long size)
+{
+    long addr;
+    int i, n;
+    uint8_t rec[21];
+    uint8_t sum;
+
+    srand(1);
+    for (addr = 0; addr < size; addr += 16) {
+        if ((addr & 0xffff) == 0) {
+            fprintf(hf, ":02000004%04lX%02X\n", addr >> 16,
+                (uint8_t)(-(2 + 4 + ((addr >> 24) & 0xff) + ((addr >> 16) & 0xff))));
+        }
+        n = 0;
+        rec[n++] = 16;
+        rec[n++] = (addr >> 8) & 0xff;
+        rec[n++] = addr & 0xff;
+        rec[n++] = 0;
+        for (i = 0; i < 16; i++) {
+            /* Every fourth byte is the phantom byte of a 24-bit instruction */
+            rec[n++] = ((i & 3) == 3) ? 0 : rand() & 0xff;
+        }
+        sum = 0;
+        fputc(':', hf);
+        for (i = 0; i < n; i++) {
+            sum += rec[i];
+            fprintf(hf, "%02X", rec[i]);
+        }
+        fprintf(hf, "%02X\n", (uint8_t)-sum);
+    }
+    fprintf(hf, ":00000001FF\n");
+}
+
+/* Stand-in for the program left on the robot by an earlier load */
+
+void old_image (fa_emu *e)
+{
+    long i;
+
+    srand(2);
+    for (i = 0; i < FLASH_BYTES; i++)
+        e->flash[i] = ((i & 3) == 3) ? 0 : rand() & 0xff;
+}
+
+double cpu_secs (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main (int argc, char *argv[])
+{
+    static fa_emu emu, ref;
+    fa_emu_config cfg = fa_emu_defaults;
+    fa_transport tp;
+    fa_session s;
+    FILE *hf;
+    uint8_t pages[FLASH_PAGES];
+    long size = 24576;
+    long p;
+    int bad;
+    double t0, secs;
+    int opt, lindex, res;
+    unsigned m;
+
+    while ((opt = getopt_long(argc, argv, short_opts, long_opts, &lindex)) != -1) {
+        switch (opt) {
+            case 's':
+                size = strtol(optarg, NULL, 0);
+                break;
+            case 'l':
+                cfg.report_us = strtol(optarg, NULL, 0);
+                break;
+            case 'r':
+                cfg.error_rate = strtod(optarg, NULL);
+                break;
+            case 'S':
+                cfg.seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                cfg.page_erase = 0;
+                break;
+            case 'h':
+                fprintf(stdout, "%s", help_text);
+                exit(0);
+            default:
+                fprintf(stderr, "%s", USAGE);
+                exit(1);
+        }
+    }
+
+    if ((argc - optind) == 1) {
+        hf = fopen(argv[optind], "r");
+        if (hf == NULL) {
+            fprintf(stderr, "** Hex file not found: %s\n", argv[optind]);
+            exit(1);
+        }
+    }
+    else if ((argc - optind) == 0) {
+        hf = tmpfile();
+        if (hf == NULL) {
+            perror("** tmpfile");
+            exit(1);
+        }
+        synth_hex(hf, size);
+    }
+    else {
+        fprintf(stderr, "%s", USAGE);
+        exit(1);
+    }
+
+    /* Reference image, loaded without errors, to detect lost records */
+    {
+        fa_emu_config clean = cfg;
+        clean.error_rate = 0;
+        fa_emu_init(&ref, &clean);
+        fa_emu_transport(&ref, &tp);
+        memset(&s, 0, sizeof(s));
+        s.tp = &tp;
+        s.quiet = 1;
+        rewind(hf);
+        if (fa_erase(&s) < 0 || fa_program(&s, hf) < 0) {
+            fprintf(stderr, "** Reference load failed\n");
+            exit(1);
+        }
+    }
+    /* Only pages holding the image are compared */
+    if (fa_image_pages(hf, pages) < 0) {
+        fprintf(stderr, "** Bad hex file record\n");
+        exit(1);
+    }
+
+    fprintf(stdout, "%-12s %10s %10s %8s %8s %8s %8s %6s %6s %s\n",
+        "mode", "time_s", "bytes/s", "records", "reports", "trips", "retries", "pages", "image", "host_s");
+    for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        fa_emu_init(&emu, &cfg);
+        fa_emu_transport(&emu, &tp);
+        old_image(&emu);
+        memset(&s, 0, sizeof(s));
+        s.tp = &tp;
+        s.check = modes[m].check;
+        s.full_erase = modes[m].full_erase;
+        s.quiet = 1;
+
+        rewind(hf);
+        t0 = cpu_secs();
+        res = fa_erase_image(&s, hf);
+        if (res == 0)
+            res = fa_program(&s, hf);
+        if (res == 0)
+            res = fa_exec(&s);
+        secs = emu.clock_us / 1e6;
+
+        bad = emu.prog_errors > 0;
+        for (p = 0; p < FLASH_PAGES; p++) {
+            if (pages[p] && memcmp(&emu.flash[p * FLASH_PAGE_BYTES], &ref.flash[p * FLASH_PAGE_BYTES], FLASH_PAGE_BYTES))
+                bad = 1;
+        }
+
+        fprintf(stdout, "%-12s %10.3f %10.0f %8ld %8ld %8ld %8ld %6ld %6s %.4f\n",
+            modes[m].name, secs, secs > 0 ? s.stats.bytes / secs : 0.0,
+            s.stats.records, s.stats.reports, s.stats.round_trips, s.stats.retries,
+            emu.pages_erased, res != 0 ? "FAIL" : bad ? "BAD" : "ok",
+            cpu_secs() - t0);
+    }
+
+    fclose(hf);
+    return 0;
+}
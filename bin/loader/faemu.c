@@ -0,0 +1,259 @@
+/*****************************************
+ * Formula AllCode Robot Buggy bootloader
+ *
+ * Bootloader emulator.  Decodes frames
+ * written to it, applies them to a model
+ * of program flash and queues the reply
+ * a real robot would send.  Time is
+ * modelled, not slept, so benchmarks run
+ * at host speed.
+ *
+ *****************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "faemu.h"
+
+const fa_emu_config fa_emu_defaults = {
+    1000,   // report_us: one full-speed HID interrupt transfer
+    20000,  // erase_page_us
+    100,    // prog_rec_us: two double-word writes per 16-byte record
+    0.0,    // error_rate
+    1,      // page_erase
+    1       // seed
+};
+
+static uint64_t emu_rand (fa_emu *e)
+{
+    /* xorshift64* */
+    e->rng ^= e->rng >> 12;
+    e->rng ^= e->rng << 25;
+    e->rng ^= e->rng >> 27;
+    return e->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static double emu_uniform (fa_emu *e)
+{
+    return (emu_rand(e) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+void fa_emu_init (fa_emu *e, const fa_emu_config *cfg)
+{
+    memset(e, 0, sizeof(*e));
+    e->cfg = *cfg;
+    e->rng = cfg->seed ? cfg->seed : 1;
+    memset(e->flash, 0xff, sizeof(e->flash));
+}
+
+uint16_t fa_emu_crc (const fa_emu *e)
+{
+    return crc16(e->flash, FLASH_BYTES);
+}
+
+static void reply (fa_emu *e, const uint8_t *data, int datalen)
+{
+    uint8_t pkt[MAXSTR];
+    int pktlen;
+
+    /* Replies carry no report ID */
+    pktlen = mkpacket(pkt, data, datalen) - 1;
+    memset(e->resp, 0, REPORT_LEN);
+    memcpy(e->resp, pkt + 1, pktlen);
+    e->resp_len = REPORT_LEN;
+}
+
+static void reply_cmd (fa_emu *e, uint8_t cmd)
+{
+    reply(e, &cmd, 1);
+}
+
+static void erase_pages (fa_emu *e, long first, long count)
+{
+    memset(&e->flash[first * FLASH_PAGE_BYTES], 0xff, count * FLASH_PAGE_BYTES);
+    e->pages_erased += count;
+    e->busy_us += count * e->cfg.erase_page_us;     // Replies once erased
+}
+
+/* Apply one Intel hex record; returns 0 if the record is malformed */
+
+static int program (fa_emu *e, const uint8_t *rec, int reclen)
+{
+    int i, count, type;
+    uint8_t sum;
+    uint32_t addr;
+
+    if (reclen < 5)
+        return 0;
+    count = rec[0];
+    if (reclen != count + 5)
+        return 0;
+    sum = 0;
+    for (i = 0; i < reclen; i++)
+        sum += rec[i];
+    if (sum != 0)
+        return 0;
+
+    addr = e->base + ((rec[1] << 8) | rec[2]);
+    type = rec[3];
+    switch (type) {
+
+        case 0:     // Data
+            for (i = 0; i < count; i++, addr++) {
+                if (addr >= FLASH_BYTES) {
+                    e->out_of_range++;
+                    continue;
+                }
+                /* Flash programming can only clear bits */
+                if ((e->flash[addr] & rec[4+i]) != rec[4+i])
+                    e->prog_errors++;
+                e->flash[addr] &= rec[4+i];
+            }
+            e->clock_us += e->cfg.prog_rec_us;
+            break;
+
+        case 4:     // Extended linear address
+            if (count != 2)
+                return 0;
+            e->base = (uint32_t)((rec[4] << 8) | rec[5]) << 16;
+            break;
+
+        default:    // End of file and unused record types
+            break;
+    }
+    return 1;
+}
+
+static void command (fa_emu *e, const uint8_t *data, int datalen)
+{
+    uint8_t out[4];
+    uint16_t c;
+    long first, count;
+
+    switch (data[0]) {
+
+        case BOOT_VERS:
+            out[0] = BOOT_VERS;
+            out[1] = EMU_VERS_MAJOR;
+            out[2] = e->cfg.page_erase ? EMU_VERS_MINOR : 0;
+            reply(e, out, 3);
+            break;
+
+        case BOOT_ERASE:
+            erase_pages(e, 0, FLASH_PAGES);
+            reply_cmd(e, BOOT_ERASE);
+            break;
+
+        case BOOT_ERASE_PAGES:
+            if (!e->cfg.page_erase || datalen != 5) {
+                e->naks++;
+                reply_cmd(e, BOOT_NAK);
+                break;
+            }
+            first = data[1] | (data[2] << 8);
+            count = data[3] | (data[4] << 8);
+            if (first + count > FLASH_PAGES) {
+                e->naks++;
+                reply_cmd(e, BOOT_NAK);
+                break;
+            }
+            erase_pages(e, first, count);
+            reply_cmd(e, BOOT_ERASE_PAGES);
+            break;
+
+        case BOOT_PROG:
+            if (!program(e, data + 1, datalen - 1)) {
+                e->naks++;
+                reply_cmd(e, BOOT_NAK);
+                break;
+            }
+            reply_cmd(e, BOOT_PROG);
+            break;
+
+        case BOOT_CRC:
+            c = fa_emu_crc(e);
+            out[0] = BOOT_CRC;
+            out[1] = c & 0xff;
+            out[2] = (c >> 8) & 0xff;
+            reply(e, out, 3);
+            break;
+
+        case BOOT_EXEC:
+            e->executed = 1;    // No reply: the user program starts
+            break;
+
+        default:
+            e->naks++;
+            reply_cmd(e, BOOT_NAK);
+            break;
+    }
+}
+
+static int emu_write (void *ctx, const uint8_t *pkt, int len)
+{
+    fa_emu *e = ctx;
+    uint8_t report[REPORT_LEN];
+    uint8_t data[REPORT_LEN];
+    int datalen, n;
+
+    /* Skip the report ID, as the USB stack would */
+    if (len < 2 || len - 1 > REPORT_LEN)
+        return -1;
+    memset(report, 0, REPORT_LEN);
+    memcpy(report, pkt + 1, len - 1);
+    /* The robot finishes one command before it reads the next */
+    e->clock_us += e->busy_us + e->cfg.report_us;
+    e->busy_us = 0;
+
+    if (e->cfg.error_rate > 0 && emu_uniform(e) < e->cfg.error_rate) {
+        n = emu_rand(e) % (len - 1);
+        report[n] ^= 1 << (emu_rand(e) % 8);
+        e->corrupted++;
+    }
+
+    datalen = unpacket(report, REPORT_LEN, data);
+    if (datalen < 1) {
+        e->naks++;
+        reply_cmd(e, BOOT_NAK);
+        return len;
+    }
+    command(e, data, datalen);
+    return len;
+}
+
+static int emu_read (void *ctx, uint8_t *data, int len, int timeout_ms)
+{
+    fa_emu *e = ctx;
+
+    if (e->resp_len == 0 || (timeout_ms >= 0 && e->busy_us > (long)timeout_ms * 1000)) {
+        /* Nothing queued, or not sent in time: a real read would block or time out */
+        if (timeout_ms > 0) {
+            e->clock_us += (long)timeout_ms * 1000;
+            if (e->resp_len > 0)
+                e->busy_us -= (long)timeout_ms * 1000;
+        }
+        return 0;
+    }
+    if (len > e->resp_len)
+        len = e->resp_len;
+    memcpy(data, e->resp, len);
+    e->resp_len = 0;
+    e->clock_us += e->busy_us + e->cfg.report_us;
+    e->busy_us = 0;
+    return len;
+}
+
+static const char *emu_error (void *ctx)
+{
+    (void)ctx;
+    return "emulator rejected report";
+}
+
+void fa_emu_transport (fa_emu *e, fa_transport *tp)
+{
+    tp->ctx = e;
+    tp->write = emu_write;
+    tp->read = emu_read;
+    tp->error = emu_error;
+}
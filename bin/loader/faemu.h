@@ -0,0 +1,52 @@
+/*****************************************
+ * Formula AllCode Robot Buggy bootloader
+ *
+ * Bootloader emulator: a local stand-in
+ * for a robot in bootloader mode, used
+ * to exercise faload without hardware.
+ *
+ *****************************************/
+
+#ifndef FAEMU_H
+#define FAEMU_H
+
+#include <stdint.h>
+
+#include "faproto.h"
+
+#define EMU_VERS_MAJOR  1
+#define EMU_VERS_MINOR  1
+
+typedef struct fa_emu_config {
+    long report_us;         // Modelled transfer time of one HID report
+    long erase_page_us;     // Modelled erase time of one flash page
+    long prog_rec_us;       // Modelled programming time of one hex record
+    double error_rate;      // Probability a written report is corrupted
+    int page_erase;         // Honour BOOT_ERASE_PAGES (else act as 1.0)
+    unsigned long seed;     // Error injection seed
+} fa_emu_config;
+
+typedef struct fa_emu {
+    fa_emu_config cfg;
+    uint8_t flash[FLASH_BYTES];
+    uint32_t base;          // Extended linear address (type 04 record)
+    uint8_t resp[REPORT_LEN];
+    int resp_len;           // Pending response, 0 if none
+    long busy_us;           // Modelled time until the pending response is sent
+    int executed;           // BOOT_EXEC received
+    long clock_us;          // Modelled time spent so far
+    long corrupted;         // Reports corrupted by error injection
+    long naks;              // Frames rejected
+    long prog_errors;       // Writes to bits that were not erased
+    long out_of_range;      // Data bytes outside program flash
+    long pages_erased;
+    uint64_t rng;
+} fa_emu;
+
+extern const fa_emu_config fa_emu_defaults;
+
+void fa_emu_init (fa_emu *e, const fa_emu_config *cfg);
+void fa_emu_transport (fa_emu *e, fa_transport *tp);
+uint16_t fa_emu_crc (const fa_emu *e);
+
+#endif
@@ -0,0 +1,347 @@
+/*****************************************
+ * Formula AllCode Robot Buggy bootloader
+ *
+ * Flashing sequence (erase, program,
+ * execute) over any fa_transport.
+ *
+ *****************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "faflash.h"
+
+/* Trim trailing whitespace, inc. line terminators(s) */
+/* NB: Modifies string in-place */
+
+static char *trim (char *s)
+{
+    int i;
+
+    i = strlen(s);
+    if (i == 0)
+        return s;
+    i--;    // Point at last actual char
+    while (i >= 0 && isspace((unsigned char)s[i])) {
+        s[i] = '\0';    // Overwrite whitespace
+        i--;
+    }
+    return s;
+}
+
+static int decode_hex (char *buf, uint8_t *rec)
+{
+    int buflen, reclen;
+    uint8_t b;
+    char *p;
+
+    reclen = 0;
+
+    buflen = strlen(buf);
+    if (buflen < 6) {
+        fprintf(stderr, "** Hex file record too short: %s\n", buf);
+        return 0;
+    }
+    if (buf[0] != ':') {
+        fprintf(stderr, "** Hex file record doesn't start with colon: %s\n", buf);
+        return 0;
+    }
+
+    rec[reclen++] = BOOT_PROG;    // Set up "program flash" command
+
+    p = &buf[1];    // Skip initial colon
+    while (*p && ((p - buf) < buflen)) {
+        /* Upper nybble */
+        if (!isxdigit((unsigned char)*p)) {
+            fprintf(stderr, "** Bad hex digit in hex file record: %s\n", buf);
+            return 0;
+        }
+        if (*p < 'A') {
+            b = (*p & 0x0f) << 4;
+        }
+        else {
+            b = ((*p & 0x0f) + 9) << 4;
+        }
+        p++;
+
+        /* Lower nybble */
+        if (!isxdigit((unsigned char)*p)) {
+            fprintf(stderr, "** Bad hex digit in hex file record: %s\n", buf);
+            return 0;
+        }
+        if (*p < 'A') {
+            b = b | (*p & 0x0f);
+        }
+        else {
+            b = b | ((*p & 0x0f) + 9);
+        }
+        p++;
+
+        /* Save byte to binary record */
+        rec[reclen++] = b;
+    }
+    return reclen;
+}
+
+/* How long to wait for the response to a command record */
+/* An erase only answers once done, so waits for every page it names */
+
+static int resp_timeout (const uint8_t *rec)
+{
+    switch (rec[0]) {
+        case BOOT_ERASE:
+            return FA_RESP_TIMEOUT_MS + FLASH_PAGES * FA_ERASE_PAGE_MS;
+        case BOOT_ERASE_PAGES:
+            return FA_RESP_TIMEOUT_MS + (rec[3] | (rec[4] << 8)) * FA_ERASE_PAGE_MS;
+        default:
+            return FA_RESP_TIMEOUT_MS;
+    }
+}
+
+/* Read one response frame; returns its length, 0 if NAKed, -5 if missing */
+
+static int check_resp (fa_session *s, uint8_t *pkt, int timeout_ms)
+{
+    int pktlen, res;
+    uint8_t data[REPORT_LEN];
+
+    res = s->tp->read(s->tp->ctx, pkt, REPORT_LEN, timeout_ms);
+    if (res == -1) {
+        fprintf(stderr, "** Error reading response from robot: %s\n", s->tp->error(s->tp->ctx));
+        return -1;
+    }
+    if (res == 0) {
+        fprintf(stderr, "** No response from robot\n");
+        return -5;
+    }
+    s->stats.round_trips++;
+    pktlen = find_eot(pkt, REPORT_LEN);
+    if (pktlen >= REPORT_LEN) {
+        if (s->dump) {
+            fprintf(stdout, "PKT < %s\n", hexdump(pkt, REPORT_LEN));
+        }
+        fprintf(stderr, "** Bad response from robot - no EOT: %s...\n",   hexdump(pkt, 16));
+        return -2;
+    }
+    if (s->dump) {
+        fprintf(stdout, "PKT < %s\n", hexdump(pkt, pktlen+1));
+    }
+    if (pkt[0] != SOH) {
+        fprintf(stderr, "** Bad response from robot - no SOH: %s...\n",   hexdump(pkt, 16));
+        return -3;
+    }
+    if (unpacket(pkt, pktlen+1, data) >= 1 && data[0] == BOOT_NAK) {
+        return 0;
+    }
+    return pktlen+1;
+}
+
+/* Frame and send one command record, optionally waiting for the response */
+/* A NAKed or unanswered frame is sent again up to max_retries times, */
+/* bar an unanswered erase: the robot may still be erasing, and its */
+/* late reply would be read as the reply to the next frame */
+/* Returns -6 if every try was NAKed, -4 if it gave up otherwise */
+
+static int send_rec (fa_session *s, const uint8_t *rec, int reclen, int want_resp, uint8_t *resp, int max_retries)
+{
+    uint8_t pkt[MAXSTR];
+    int pktlen, res, tries, naks;
+
+    pktlen = mkpacket(pkt, rec, reclen);
+    naks = 0;
+    for (tries = 0; tries <= max_retries; tries++) {
+        if (tries > 0)
+            s->stats.retries++;
+        if (s->dump) {
+            fprintf(stdout, "PKT > %s\n", hexdump(pkt, pktlen));
+        }
+        if (s->tp->write(s->tp->ctx, pkt, pktlen) == -1) {
+            fprintf(stderr, "** Error writing to robot: %s\n", s->tp->error(s->tp->ctx));
+            return -1;
+        }
+        s->stats.reports++;
+        s->stats.bytes += pktlen;
+        if (!want_resp)
+            return 0;
+        res = check_resp(s, resp, resp_timeout(rec));
+        if (res == 0)
+            naks++;
+        if (res == 0 || (res == -5 && rec[0] != BOOT_ERASE && rec[0] != BOOT_ERASE_PAGES))
+            continue;
+        return res;
+    }
+    /* fa_version() expects a 1.0 bootloader to reject VERS */
+    if (naks == tries && rec[0] == BOOT_VERS)
+        return -6;
+    if (max_retries > 0)
+        fprintf(stderr, "** Giving up after %d retries\n", max_retries);
+    return naks == tries ? -6 : -4;
+}
+
+/* Ask the bootloader for its version, resending VERS like any other */
+/* record; only a bootloader that NAKs it every time, as a 1.0 one */
+/* that doesn't know the command does, is taken to be 1.0 */
+
+int fa_version (fa_session *s, int *major, int *minor)
+{
+    uint8_t rec[1];
+    uint8_t resp[REPORT_LEN];
+    uint8_t data[REPORT_LEN];
+    int len;
+
+    *major = 1;
+    *minor = 0;
+    rec[0] = BOOT_VERS;
+    len = send_rec(s, rec, 1, 1, resp, FA_MAX_RETRIES);
+    if (len == -6)
+        return 0;
+    if (len < 0)
+        return -1;
+    if (unpacket(resp, len, data) < 3 || data[0] != BOOT_VERS) {
+        fprintf(stderr, "** Bad response from robot to VERS: %s\n", hexdump(resp, len));
+        return -1;
+    }
+    *major = data[1];
+    *minor = data[2];
+    return 0;
+}
+
+/* Mark the flash pages that the data records of a hex file occupy */
+/* Returns the number of pages marked, or -1 on a bad record */
+
+int fa_image_pages (FILE *hf, uint8_t *pages)
+{
+    char buf[MAXSTR];
+    uint8_t rec[MAXSTR];
+    uint32_t base, addr, last;
+    int reclen, npages;
+
+    memset(pages, 0, FLASH_PAGES);
+    npages = 0;
+    base = 0;
+    rewind(hf);
+    while (fgets(buf, MAXSTR, hf) != NULL) {
+        trim(buf);
+        reclen = decode_hex(buf, rec);
+        /* rec[0] is BOOT_PROG, then count, address, type, data */
+        if (reclen < 6 || reclen != rec[1] + 6)
+            return -1;
+        if (rec[4] == 4 && rec[1] == 2) {
+            base = (uint32_t)((rec[5] << 8) | rec[6]) << 16;
+        }
+        else if (rec[4] == 0 && rec[1] > 0) {
+            addr = base + ((rec[2] << 8) | rec[3]);
+            last = addr + rec[1] - 1;
+            for (addr = addr / FLASH_PAGE_BYTES; addr <= last / FLASH_PAGE_BYTES && addr < FLASH_PAGES; addr++) {
+                if (!pages[addr]) {
+                    pages[addr] = 1;
+                    npages++;
+                }
+            }
+        }
+    }
+    rewind(hf);
+    return npages;
+}
+
+int fa_erase (fa_session *s)
+{
+    uint8_t rec[1];
+    uint8_t resp[REPORT_LEN];
+
+    /* Erase flash memory */
+    if (!s->quiet)
+        fprintf(stdout, "--- Sending ERASE command...\n");
+    rec[0] = BOOT_ERASE;
+    if (send_rec(s, rec, 1, 1, resp, FA_MAX_RETRIES) < 0)
+        return -1;
+    s->stats.pages_erased += FLASH_PAGES;
+    return 0;
+}
+
+/* Erase only the pages a hex file will program, one command per run */
+/* of consecutive pages; falls back to a full erase on 1.0 bootloaders */
+
+int fa_erase_image (fa_session *s, FILE *hf)
+{
+    uint8_t pages[FLASH_PAGES];
+    uint8_t rec[5];
+    uint8_t resp[REPORT_LEN];
+    int major, minor, first, count;
+
+    if (s->full_erase)
+        return fa_erase(s);
+    if (fa_version(s, &major, &minor) < 0)
+        return -1;
+    if (major < 1 || (major == 1 && minor < 1))
+        return fa_erase(s);
+    if (fa_image_pages(hf, pages) < 0) {
+        fprintf(stderr, "** Bad hex file record, cannot size image\n");
+        return -1;
+    }
+
+    if (!s->quiet)
+        fprintf(stdout, "--- Sending ERASE PAGES commands...\n");
+    first = 0;
+    while (first < FLASH_PAGES) {
+        if (!pages[first]) {
+            first++;
+            continue;
+        }
+        for (count = 1; first + count < FLASH_PAGES && pages[first + count]; count++)
+            ;
+        rec[0] = BOOT_ERASE_PAGES;
+        rec[1] = first & 0xff;
+        rec[2] = (first >> 8) & 0xff;
+        rec[3] = count & 0xff;
+        rec[4] = (count >> 8) & 0xff;
+        if (send_rec(s, rec, 5, 1, resp, FA_MAX_RETRIES) < 0)
+            return -1;
+        s->stats.pages_erased += count;
+        first += count;
+    }
+    if (!s->quiet)
+        fprintf(stdout, "    %ld pages erased.\n", s->stats.pages_erased);
+    return 0;
+}
+
+int fa_program (fa_session *s, FILE *hf)
+{
+    char buf[MAXSTR];
+    uint8_t rec[MAXSTR];
+    uint8_t resp[REPORT_LEN];
+    int reclen;
+
+    /* Read and process records */
+    if (!s->quiet)
+        fprintf(stdout, "--- Sending PROGRAM records...\n");
+    while (fgets(buf, MAXSTR, hf) != NULL) {
+        trim(buf);
+        reclen = decode_hex(buf, rec);
+        if (reclen == 0) {
+            return -1;
+        }
+        /* Send the record as a HID report */
+        if (send_rec(s, rec, reclen, s->check, resp, FA_MAX_RETRIES) < 0)
+            return -1;
+        s->stats.records++;
+    }
+    if (!s->quiet)
+        fprintf(stdout, "    %ld records sent.\n", s->stats.records);
+    return 0;
+}
+
+int fa_exec (fa_session *s)
+{
+    uint8_t rec[1];
+
+    /* No response expected: the robot leaves the bootloader */
+    if (!s->quiet)
+        fprintf(stdout, "--- Sending EXECUTE command...\n");
+    rec[0] = BOOT_EXEC;
+    if (send_rec(s, rec, 1, 0, NULL, 0) < 0)
+        return -1;
+    return 0;
+}
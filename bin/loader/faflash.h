@@ -0,0 +1,46 @@
+/*****************************************
+ * Formula AllCode Robot Buggy bootloader
+ *
+ * Flashing sequence (erase, program,
+ * execute) over any fa_transport.
+ *
+ *****************************************/
+
+#ifndef FAFLASH_H
+#define FAFLASH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "faproto.h"
+
+#define FA_RESP_TIMEOUT_MS  1000    // Wait for a response frame
+#define FA_ERASE_PAGE_MS    40      // Further wait per page erased (twice the 20 ms a page takes)
+#define FA_MAX_RETRIES      5       // Resends of a NAKed or unanswered frame (erases are not resent when unanswered)
+
+typedef struct fa_stats {
+    long records;       // Program records accepted
+    long bytes;         // Frame bytes written, incl. report ID
+    long reports;       // HID reports written
+    long round_trips;   // Responses read back
+    long retries;       // Frames sent again after NAK or timeout
+    long pages_erased;  // Flash pages named in erase commands
+} fa_stats;
+
+typedef struct fa_session {
+    fa_transport *tp;
+    int dump;           // Dump frames in hexadecimal
+    int check;          // Read a response for every program record
+    int quiet;          // No progress messages
+    int full_erase;     // Always erase the whole of program flash
+    fa_stats stats;
+} fa_session;
+
+int fa_version (fa_session *s, int *major, int *minor);
+int fa_image_pages (FILE *hf, uint8_t *pages);
+int fa_erase (fa_session *s);
+int fa_erase_image (fa_session *s, FILE *hf);
+int fa_program (fa_session *s, FILE *hf);
+int fa_exec (fa_session *s);
+
+#endif
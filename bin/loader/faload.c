@@ -8,6 +8,13 @@
  * Aberystywth University
  * 
  * 2018-03-14   LGT     Initial version 1.0
+ * 2026-10-19           1.1: pluggable transport,
+ *                      bootloader emulator
+ * 2026-10-19           1.2: erase only the pages
+ *                      the image occupies
+ * 
+ * Build: cc -o faload faload.c faflash.c
+ *        faproto.c faemu.c -lhidapi-libusb
  * 
  *****************************************/
 
@@ -15,31 +22,22 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
-#include <ctype.h>
 #include <unistd.h>
 #include <getopt.h>
 
 #include <hidapi/hidapi.h>
 
-#define VERSION "1.0"
-
-#define SOH 1
-#define EOT 4
-#define DLE 16
-
-#define BOOT_VERS   1 // Get bootloader version
-#define BOOT_ERASE  2 // Erase flash memory
-#define BOOT_PROG   3 // Program flash memory
-#define BOOT_CRC    4 // Get program CRC
-#define BOOT_EXEC   5 // Execute user program
+#include "faproto.h"
+#include "faflash.h"
+#include "faemu.h"
 
+#define VERSION "1.2"
 
 #define ROBOT_VID 0x12bf
 #define ROBOT_PID 0x00a1
 
-#define MAXSTR 256
 
-const char *short_opts = "enxcdh";
+const char *short_opts = "enxcdEFh";
 
 struct option long_opts[] = {
     {"erase", no_argument, NULL, 'e'},
@@ -47,6 +45,8 @@ struct option long_opts[] = {
     {"exec", no_argument, NULL, 'x'},
     {"check", no_argument, NULL, 'c'},
     {"dump", no_argument, NULL, 'd'},
+    {"emulate", no_argument, NULL, 'E'},
+    {"full-erase", no_argument, NULL, 'F'},
     {"help", no_argument, NULL, 'h'},
     {NULL, 0, NULL, 0}
 };
@@ -63,25 +63,28 @@ const char *help_text = "Usage: faload [ OPTION... ] [ FILE ]\n"
 "   OPTIONS:\n"
 "       -c, --check       Check response frames from robot\n"
 "       -d, --dump        Dump frames in hexadecimal, for debugging\n"
+"       -E, --emulate     Talk to the bootloader emulator, not a robot\n"
+"       -F, --full-erase  Erase all program memory, not just the pages\n"
+"                         the hex file occupies\n"
 "\n"
 "LGT 2018-03-14\n"
 ;
 
-#define USAGE "Usage: faload [ -c | -d ] [ -e | -x | -h | [ -n ] hexfile ]\n"
-
-const char *hexdigit = "0123456789ABCDEF";
-char st[1024];
+#define USAGE "Usage: faload [ -c | -d | -E | -F ] [ -e | -x | -h | [ -n ] hexfile ]\n"
 
 int opt_dump = 0;   // Dump packet contents
 int opt_erase = 1;  // Erase program memory
 int opt_load = 1;   // Load program
 int opt_exec = 1;   // Execute program
 int opt_check = 0;  // Read (check) response packets
+int opt_emulate = 0;    // Use the bootloader emulator
+int opt_full_erase = 0; // Erase everything, even when loading a file
 
 char *hf_name = NULL;
 
-char *st_hid_error (hid_device *dev)
+const char *st_hid_error (void *ctx)
 {
+    hid_device *dev = ctx;
     int len;
     
     len = wcstombs(st, hid_error(dev), 1023);
@@ -91,191 +94,14 @@ char *st_hid_error (hid_device *dev)
     return st;
 }
 
-uint16_t crc_table[] = {
-    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
-    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
-};
-
-
-uint16_t crc16 (uint8_t *data, int datalen)
-{
-    uint16_t crc, n;
-    int i;
-    
-    crc = 0;
-    for (i = 0; i < datalen; i++) {
-        n = (crc >> 12) ^ (data[i] >> 4);
-        crc = crc_table[n & 0x0f] ^ (crc << 4);
-        n = (crc >> 12) ^ data[i];
-        crc = crc_table[n & 0x0f] ^ (crc << 4);
-    }
-    
-    return crc;
-}
-
-void put(uint8_t **seq, uint8_t val)
-{
-    uint8_t *p = *seq;
-    if (val == SOH || val == EOT || val == DLE)
-        *p++ = DLE;
-    *p++ = val;
-    *seq = p;
-}
-
-int mkpacket (uint8_t *pkt, uint8_t *data, int datalen)
-{
-    int i;
-    uint8_t *p;
-    uint16_t c;
-    uint8_t b;
-    
-    p = pkt;
-    *p++ = 0;   // HID report ID
-    *p++ = SOH; // Start of data frame
-    
-    for (i = 0; i < datalen; i++) {
-        put(&p, data[i]);
-    }
-    
-    c = crc16(data, datalen);
-    b = c & 0xff;
-    put(&p, b);     // Checksum low
-    b = (c >> 8) & 0xff;
-    put(&p, b);     // Checksum high
-    
-    *p++ = EOT; // End of data frame
-    
-    return (p - pkt);
-}
-
-/* Trim trailing whitespace, inc. line terminators(s) */
-/* NB: Modifies string in-place */
-
-char *trim (char *s)
-{
-    int i;
-
-    i = strlen(s);
-    if (i == 0)
-        return s;
-    i--;    // Point at last actual char
-    while (i >= 0 && isspace(s[i])) {
-        s[i] = '\0';    // Overwrite whitespace
-        i--;
-    }
-    return s;
-}
-
-int find_eot (uint8_t *pkt, int maxlen)
-{
-    int i = 0;
-    
-    while (i < maxlen) {
-        if (pkt[i] == DLE)
-            i++;
-        if (pkt[i] == EOT)
-            break;
-        i++;
-    }
-    return i;
-}
-
-int decode_hex (char *buf, uint8_t *rec)
-{
-    int buflen, reclen;
-    uint8_t b;
-    char *p;
-    
-    reclen = 0;
-    
-    buflen = strlen(buf);
-    if (buflen < 6) {
-        fprintf(stderr, "** Hex file record too short: %s\n", buf);
-        return 0;
-    }
-    if (buf[0] != ':') {
-        fprintf(stderr, "** Hex file record doesn't start with colon: %s\n", buf);
-        return 0;
-    }
-    
-    rec[reclen++] = BOOT_PROG;    // Set up "program flash" command
-    
-    p = &buf[1];    // Skip initial colon
-    while (*p && ((p - buf) < buflen)) {
-        /* Upper nybble */
-        if (!isxdigit(*p)) {
-            fprintf(stderr, "** Bad hex digit in hex file record: %s\n", buf);
-            return 0;
-        }
-        if (*p < 'A') {
-            b = (*p & 0x0f) << 4;
-        }
-        else {
-            b = ((*p & 0x0f) + 9) << 4;
-        }
-        p++;
-        
-        /* Lower nybble */
-        if (!isxdigit(*p)) {
-            fprintf(stderr, "** Bad hex digit in hex file record: %s\n", buf);
-            return 0;
-        }
-        if (*p < 'A') {
-            b = b | (*p & 0x0f);
-        }
-        else {
-            b = b | ((*p & 0x0f) + 9);
-        }
-        p++;
-        
-        /* Save byte to binary record */
-        rec[reclen++] = b;
-    }
-    return reclen;
-}
-
-char *hexdump (uint8_t *data, int datalen)
+int hid_tp_write (void *ctx, const uint8_t *data, int len)
 {
-    char *s = st;
-    int i;
-    uint8_t b;
-    
-    *s = '\0';
-    for (i = 0; i < datalen; i++) {
-        b = data[i];
-        *s++ = hexdigit[(b & 0xf0) >> 4];
-        *s++ = hexdigit[b & 0x0f];
-        *s++ = ' ';
-        *s = '\0';
-    }
-    *(--s) = '\0';  // Overwrite final space
-    return st;
+    return hid_write(ctx, data, len);
 }
 
-int check_resp (hid_device *dev, uint8_t *pkt)
+int hid_tp_read (void *ctx, uint8_t *data, int len, int timeout_ms)
 {
-    int pktlen;
-    
-    if (hid_read(dev, pkt, 64) == -1) {
-        fprintf(stderr, "** Error reading response from robot: %s\n", st_hid_error(dev));
-        return -1;
-    }
-    pktlen = find_eot(pkt, 64);
-    if (pktlen >= 64) {
-        if (opt_dump) {
-            fprintf(stdout, "PKT < %s\n", hexdump(pkt, 64));
-        }
-        fprintf(stderr, "** Bad response from robot - no EOT: %s...\n",   hexdump(pkt, 16));
-        return -2;
-    }
-    if (opt_dump) {
-        fprintf(stdout, "PKT < %s\n", hexdump(pkt, pktlen+1));
-    }
-    if (pkt[0] != SOH) {
-        fprintf(stderr, "** Bad response from robot - no SOH: %s...\n",   hexdump(pkt, 16));
-        return -3;
-    }
-    return pktlen+1;
+    return hid_read_timeout(ctx, data, len, timeout_ms);
 }
 
 void crack_params (int argc, char *argv[]) {
@@ -330,6 +156,14 @@ void crack_params (int argc, char *argv[]) {
                 opt_dump = 1;
                 break;
                 
+            case 'E':   // Bootloader emulator instead of hidapi
+                opt_emulate = 1;
+                break;
+                
+            case 'F':   // Whole-flash erase before loading
+                opt_full_erase = 1;
+                break;
+                
             case 'h':   // Print help message & exit
                 help_flag++;
                 break;
@@ -375,30 +209,14 @@ void crack_params (int argc, char *argv[]) {
 int main (int argc, char *argv[])
 {
     hid_device *dev = NULL;
+    static fa_emu emu;
+    fa_transport tp;
+    fa_session s;
     int res;
-    int nrec;
-    FILE *hf;
-    char buf[MAXSTR];
-    uint8_t rec[MAXSTR];
-    uint8_t pkt[MAXSTR];
-    
-    int reclen, pktlen; 
+    FILE *hf = NULL;
     
     /* Process parameters */
     crack_params(argc, argv);
-    /* Debugging */
-    /*
-    fprintf(stderr, "---> opt_dump:  %d\n", opt_dump);
-    fprintf(stderr, "---> opt_erase: %d\n", opt_erase);
-    fprintf(stderr, "---> opt_load:  %d\n", opt_load);
-    fprintf(stderr, "---> opt_exec:  %d\n", opt_exec);
-    fprintf(stderr, "---> opt_check: %d\n", opt_check);
-    if (hf_name)
-        fprintf(stderr, "---> hexfile: %s\n", hf_name);
-    else
-        fprintf(stderr, "---> hexfile: %s\n", "<NONE>");
-    exit(0);
-    */
     
     /* Open hex file for input */
     if (hf_name != NULL) {
@@ -409,97 +227,55 @@ int main (int argc, char *argv[])
         }
     }
     
-    /* Initialise HID library */
-    res = hid_init();
-    if (res) {
-        fprintf(stderr, "** Error opening HID API library\n");
-        exit(1);
-    }
-    
-    /* Open first robot found (if any) */
-    dev = hid_open(ROBOT_VID, ROBOT_PID, NULL);
-    if (dev == NULL) {
-        fprintf(stderr, "** No robot device found\n   Press reset on robot to enter bootloader\n");
-        exit(1);
+    if (opt_emulate) {
+        fa_emu_init(&emu, &fa_emu_defaults);
+        fa_emu_transport(&emu, &tp);
     }
-    
-    if (opt_erase) {
-        /* Erase flash memory */
-        fprintf(stdout, "--- Sending ERASE command...\n");
-        rec[0] = BOOT_ERASE;
-        reclen = 1;
-        pktlen = mkpacket(pkt, rec, reclen);
-        /* DEBUG: Dump the packet */
-        if (opt_dump) {
-            fprintf(stdout, "PKT > %s\n", hexdump(pkt, pktlen));
-        }
-        if (hid_write(dev, pkt, pktlen) == -1) {
-                fprintf(stderr, "** Error writing to robot: %s\n", st_hid_error(dev));
-                goto bail_out;
+    else {
+        /* Initialise HID library */
+        res = hid_init();
+        if (res) {
+            fprintf(stderr, "** Error opening HID API library\n");
+            exit(1);
         }
-        /* Check response */
-        pktlen = check_resp(dev, pkt);
-        if (pktlen < 0)
-            goto bail_out;
-    }
-
-    if (opt_load) {
-        /* Read and process records */
-        fprintf(stdout, "--- Sending PROGRAM records...\n");
-        nrec = 0;
-        while (fgets(buf, MAXSTR, hf) != NULL) {
-            trim(buf);
-            reclen = decode_hex(buf, rec);
-            if (reclen == 0) {
-                goto bail_out;
-            }
-            /* Make a program packet */
-            pktlen = mkpacket(pkt, rec, reclen);
-            if (opt_dump) {
-                fprintf(stdout, "PKT > %s\n", hexdump(pkt, pktlen));
-            }
-            /* Send the packet as a HID report */
-            if (hid_write(dev, pkt, pktlen) == -1) {
-                fprintf(stderr, "** Error writing to robot: %s\n", st_hid_error(dev));
-                goto bail_out;
-            }
-            nrec++;
-            if (opt_check) {
-                pktlen = check_resp(dev, pkt);
-                if (pktlen < 0)
-                    goto bail_out;
-            }
+        
+        /* Open first robot found (if any) */
+        dev = hid_open(ROBOT_VID, ROBOT_PID, NULL);
+        if (dev == NULL) {
+            fprintf(stderr, "** No robot device found\n   Press reset on robot to enter bootloader\n");
+            exit(1);
         }
-        fprintf(stdout, "    %d records sent.\n", nrec);
+        tp.ctx = dev;
+        tp.write = hid_tp_write;
+        tp.read = hid_tp_read;
+        tp.error = st_hid_error;
     }
     
-    if (opt_exec) {
-        fprintf(stdout, "--- Sending EXECUTE command...\n");
-        rec[0] = BOOT_EXEC;
-        reclen = 1;
-        pktlen = mkpacket(pkt, rec, reclen);
-        if (opt_dump) {
-            fprintf(stdout, "PKT > %s\n", hexdump(pkt, pktlen));
-        }
-        if (hid_write(dev, pkt, pktlen) == -1) {
-                fprintf(stderr, "** Error writing to robot: %s\n", st_hid_error(dev));
-                goto bail_out;
-        }
-    }
-
-    /* No return from that, so close down */
-    fclose(hf);
-    hid_close(dev);
-    hid_exit();
-    return 0;
+    memset(&s, 0, sizeof(s));
+    s.tp = &tp;
+    s.dump = opt_dump;
+    s.check = opt_check;
+    s.full_erase = opt_full_erase;
     
-    /* Error exit */
+    res = 0;
+    if (opt_erase && res == 0)
+        res = opt_load ? fa_erase_image(&s, hf) : fa_erase(&s);
+    if (opt_load && res == 0)
+        res = fa_program(&s, hf);
+    if (opt_exec && res == 0)
+        res = fa_exec(&s);
     
-bail_out:
-    fclose(hf);
-    hid_close(dev);
-    hid_exit();
-    exit(1);
-
-}    
-
+    if (opt_emulate) {
+        fprintf(stdout, "--- Emulator: %ld reports, %ld pages erased, %ld NAKs, %ld program errors, %.3f s modelled, CRC %04X\n",
+            s.stats.reports, emu.pages_erased, emu.naks, emu.prog_errors, emu.clock_us / 1e6, fa_emu_crc(&emu));
+    }
+    
+    /* No return from EXECUTE, so close down */
+    if (hf != NULL)
+        fclose(hf);
+    if (dev != NULL) {
+        hid_close(dev);
+        hid_exit();
+    }
+    return res == 0 ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+/*****************************************
+ * Formula AllCode Robot Buggy bootloader
+ *
+ * Frame protocol: SOH <data> <crc lo>
+ * <crc hi> EOT, with SOH/EOT/DLE bytes
+ * in the body escaped by a DLE prefix.
+ *
+ *****************************************/
+
+#include <stdint.h>
+
+#include "faproto.h"
+
+const char *hexdigit = "0123456789ABCDEF";
+char st[1024];
+
+uint16_t crc_table[] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+
+uint16_t crc16 (const uint8_t *data, int datalen)
+{
+    uint16_t crc, n;
+    int i;
+
+    crc = 0;
+    for (i = 0; i < datalen; i++) {
+        n = (crc >> 12) ^ (data[i] >> 4);
+        crc = crc_table[n & 0x0f] ^ (crc << 4);
+        n = (crc >> 12) ^ data[i];
+        crc = crc_table[n & 0x0f] ^ (crc << 4);
+    }
+
+    return crc;
+}
+
+static void put(uint8_t **seq, uint8_t val)
+{
+    uint8_t *p = *seq;
+    if (val == SOH || val == EOT || val == DLE)
+        *p++ = DLE;
+    *p++ = val;
+    *seq = p;
+}
+
+int mkpacket (uint8_t *pkt, const uint8_t *data, int datalen)
+{
+    int i;
+    uint8_t *p;
+    uint16_t c;
+    uint8_t b;
+
+    p = pkt;
+    *p++ = 0;   // HID report ID
+    *p++ = SOH; // Start of data frame
+
+    for (i = 0; i < datalen; i++) {
+        put(&p, data[i]);
+    }
+
+    c = crc16(data, datalen);
+    b = c & 0xff;
+    put(&p, b);     // Checksum low
+    b = (c >> 8) & 0xff;
+    put(&p, b);     // Checksum high
+
+    *p++ = EOT; // End of data frame
+
+    return (p - pkt);
+}
+
+int find_eot (const uint8_t *pkt, int maxlen)
+{
+    int i = 0;
+
+    while (i < maxlen) {
+        if (pkt[i] == DLE) {
+            i += 2;     // An escaped byte is never the EOT
+            continue;
+        }
+        if (pkt[i] == EOT)
+            break;
+        i++;
+    }
+    return i;
+}
+
+/* Decode a frame starting at SOH into its data bytes */
+/* Returns data length, -1 if badly framed, -2 on CRC mismatch */
+
+int unpacket (const uint8_t *pkt, int pktlen, uint8_t *data)
+{
+    int i, len;
+    uint16_t c;
+
+    if (pktlen < 1 || pkt[0] != SOH)
+        return -1;
+
+    len = 0;
+    for (i = 1; i < pktlen; i++) {
+        if (pkt[i] == EOT)
+            break;
+        if (pkt[i] == DLE) {
+            if (++i >= pktlen)
+                return -1;
+        }
+        data[len++] = pkt[i];
+    }
+    if (i >= pktlen || len < 2)
+        return -1;
+
+    len -= 2;   // Strip checksum
+    c = crc16(data, len);
+    if (data[len] != (c & 0xff) || data[len+1] != ((c >> 8) & 0xff))
+        return -2;
+    return len;
+}
+
+char *hexdump (const uint8_t *data, int datalen)
+{
+    char *s = st;
+    int i;
+    uint8_t b;
+
+    *s = '\0';
+    if (datalen > (int)(sizeof(st) / 3))
+        datalen = sizeof(st) / 3;
+    for (i = 0; i < datalen; i++) {
+        b = data[i];
+        *s++ = hexdigit[(b & 0xf0) >> 4];
+        *s++ = hexdigit[b & 0x0f];
+        *s++ = ' ';
+        *s = '\0';
+    }
+    if (s != st)
+        *(--s) = '\0';  // Overwrite final space
+    return st;
+}
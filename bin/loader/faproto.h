@@ -0,0 +1,57 @@
+/*****************************************
+ * Formula AllCode Robot Buggy bootloader
+ *
+ * Frame protocol shared by the loader,
+ * the bootloader emulator and the
+ * throughput benchmark.
+ *
+ *****************************************/
+
+#ifndef FAPROTO_H
+#define FAPROTO_H
+
+#include <stdint.h>
+
+#define SOH 1
+#define EOT 4
+#define DLE 16
+
+#define BOOT_VERS   1 // Get bootloader version
+#define BOOT_ERASE  2 // Erase flash memory
+#define BOOT_PROG   3 // Program flash memory
+#define BOOT_CRC    4 // Get program CRC
+#define BOOT_EXEC   5 // Execute user program
+#define BOOT_ERASE_PAGES 6  // Erase a range of flash pages (bootloader 1.1+)
+
+#define BOOT_NAK    0x15    // Response: frame rejected (bad CRC, bad command)
+
+/* dsPIC33EP256MU810 program flash, in hex file (byte) addresses */
+#define FLASH_PAGE_BYTES    0x1000      // 1024 instructions per erase page
+#define FLASH_BYTES         0x56000     // 0x000000 - 0x02ABFF program counter
+#define FLASH_PAGES         (FLASH_BYTES / FLASH_PAGE_BYTES)
+
+#define REPORT_LEN  64      // Size of one HID report
+#define MAXSTR      256
+
+/*
+ * A transport moves raw HID reports to and from the robot.
+ * faload uses hidapi; the emulator and benchmark plug in
+ * faemu instead.  read() returns the number of bytes read,
+ * 0 on timeout (timeout_ms < 0 blocks) or -1 on error.
+ */
+typedef struct fa_transport {
+    void *ctx;
+    int (*write) (void *ctx, const uint8_t *data, int len);
+    int (*read) (void *ctx, uint8_t *data, int len, int timeout_ms);
+    const char *(*error) (void *ctx);
+} fa_transport;
+
+extern char st[1024];
+
+uint16_t crc16 (const uint8_t *data, int datalen);
+int mkpacket (uint8_t *pkt, const uint8_t *data, int datalen);
+int find_eot (const uint8_t *pkt, int maxlen);
+int unpacket (const uint8_t *pkt, int pktlen, uint8_t *data);
+char *hexdump (const uint8_t *data, int datalen);
+
+#endif
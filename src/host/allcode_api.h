@@ -0,0 +1,50 @@
+/**
+  * Host stand-in for the Formula AllCode API header
+  * Declares the subset of the robot API used by the controller so that
+  * src/maze_runner can be compiled and run on a PC (see bin/host/hostcc).
+  * Calls are forwarded to the active HostBackend (host.h).
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef ALLCODE_API_H
+#define ALLCODE_API_H
+
+#include <stdbool.h>
+
+#define CHANNEL_LEFT    0
+#define CHANNEL_RIGHT   1
+
+void FA_RobotInit();
+
+void FA_LEDOn(unsigned char led);
+void FA_LEDOff(unsigned char led);
+
+unsigned char FA_ReadSwitch(unsigned char sw);
+unsigned int FA_ReadIR(unsigned char channel);
+unsigned int FA_ReadLine(unsigned char channel);
+unsigned int FA_ReadLight();
+unsigned int FA_ReadBattery();
+
+void FA_SetMotors(unsigned char left, unsigned char right);
+void FA_Forwards(unsigned int distance);
+void FA_Backwards(unsigned int distance);
+void FA_Left(unsigned int angle);
+void FA_Right(unsigned int angle);
+
+void FA_DelayMillis(unsigned int ms);
+unsigned long FA_ClockMS();
+
+void FA_LCDClear();
+void FA_LCDPlot(unsigned char x, unsigned char y);
+void FA_LCDBacklight(unsigned char level);
+
+void FA_PlayNote(unsigned int frequency, unsigned int ms);
+
+unsigned char FA_BTConnected();
+void FA_BTSendString(char *string, unsigned char length);
+void FA_BTSendNumber(long number);
+void FA_BTSendByte(unsigned char byte);
+unsigned char FA_BTGetByte();
+unsigned char FA_BTAvailable();
+
+#endif
@@ -0,0 +1,158 @@
+/**
+  * Host implementation of the Formula AllCode API
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "allcode_api.h"
+#include "host.h"
+
+static const HostBackend nullBackend;
+
+const HostBackend *hostBackend = &nullBackend;
+unsigned long hostClockMs = 0;
+
+/**
+  * Select the backend that subsequent API calls are forwarded to
+*/
+void hostUse(const HostBackend *backend){
+  hostBackend = backend ? backend : &nullBackend;
+  hostClockMs = 0;
+}
+
+/**
+  * Tell the backend the controller has entered a new state
+*/
+void hostStateChanged(int state){
+  if(hostBackend->stateChanged){
+    hostBackend->stateChanged(state);
+  }
+}
+
+void FA_RobotInit(){
+}
+
+void FA_LEDOn(unsigned char led){
+}
+
+void FA_LEDOff(unsigned char led){
+}
+
+unsigned char FA_ReadSwitch(unsigned char sw){
+  return hostBackend->readSwitch ? hostBackend->readSwitch(sw) : 0;
+}
+
+unsigned int FA_ReadIR(unsigned char channel){
+  return hostBackend->readIR ? hostBackend->readIR(channel) : 0;
+}
+
+unsigned int FA_ReadLine(unsigned char channel){
+  return hostBackend->readLine ? hostBackend->readLine(channel) : 0;
+}
+
+unsigned int FA_ReadLight(){
+  return hostBackend->readLight ? hostBackend->readLight() : 0;
+}
+
+unsigned int FA_ReadBattery(){
+  return 0;
+}
+
+void FA_SetMotors(unsigned char left, unsigned char right){
+  if(hostBackend->setMotors){
+    hostBackend->setMotors(left, right);
+  }
+}
+
+void FA_Forwards(unsigned int distance){
+  if(hostBackend->forwards){
+    hostBackend->forwards(distance);
+  }
+}
+
+void FA_Backwards(unsigned int distance){
+  if(hostBackend->backwards){
+    hostBackend->backwards(distance);
+  }
+}
+
+void FA_Left(unsigned int angle){
+  if(hostBackend->left){
+    hostBackend->left(angle);
+  }
+}
+
+void FA_Right(unsigned int angle){
+  if(hostBackend->right){
+    hostBackend->right(angle);
+  }
+}
+
+void FA_DelayMillis(unsigned int ms){
+  hostClockMs += ms;
+  if(hostBackend->delay){
+    hostBackend->delay(ms);
+  }
+}
+
+unsigned long FA_ClockMS(){
+  if(hostBackend->clock){
+    return hostBackend->clock();
+  }
+  return hostClockMs;
+}
+
+void FA_LCDClear(){
+  if(hostBackend->lcdClear){
+    hostBackend->lcdClear();
+  }
+}
+
+void FA_LCDPlot(unsigned char x, unsigned char y){
+  if(hostBackend->lcdPlot){
+    hostBackend->lcdPlot(x, y);
+  }
+}
+
+void FA_LCDBacklight(unsigned char level){
+}
+
+void FA_PlayNote(unsigned int frequency, unsigned int ms){
+}
+
+unsigned char FA_BTConnected(){
+  return hostBackend->btConnected ? hostBackend->btConnected() : 0;
+}
+
+void FA_BTSendByte(unsigned char byte){
+  if(hostBackend->btSend){
+    hostBackend->btSend(byte);
+  }
+}
+
+void FA_BTSendString(char *string, unsigned char length){
+  // Like the robot API, stop at the terminator or the given length
+  while(length-- > 0 && *string){
+    FA_BTSendByte(*string++);
+  }
+}
+
+void FA_BTSendNumber(long number){
+  char text[24];
+  int i;
+
+  snprintf(text, sizeof(text), "%ld", number);
+  for(i = 0; text[i]; i++){
+    FA_BTSendByte(text[i]);
+  }
+}
+
+unsigned char FA_BTAvailable(){
+  return hostBackend->btAvailable ? hostBackend->btAvailable() : 0;
+}
+
+unsigned char FA_BTGetByte(){
+  return hostBackend->btGet ? hostBackend->btGet() : 0;
+}
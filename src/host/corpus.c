@@ -0,0 +1,127 @@
+/**
+  * Maze corpus
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "corpus.h"
+#include "sim.h"
+
+_Static_assert(sizeof(CorpusHeader) == CORPUS_HEADER_LEN, "corpus header must be packed");
+_Static_assert(sizeof(CorpusMaze) == CORPUS_RECORD_HEAD, "corpus record head must be packed");
+
+/**
+  * Map a corpus file into memory and check its header, returning 0 on success
+*/
+int corpusOpen(const char *path, Corpus *corpus){
+  struct stat info;
+  const CorpusHeader *header;
+  void *data;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0){
+    return -1;
+  }
+  if(fstat(fd, &info) != 0 || (size_t)info.st_size < CORPUS_HEADER_LEN){
+    close(fd);
+    return -1;
+  }
+  data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED){
+    return -1;
+  }
+
+  header = data;
+  if(memcmp(header->magic, CORPUS_MAGIC, 4) != 0 || header->version != CORPUS_VERSION
+    || header->width == 0 || header->height == 0 || header->width > 255 || header->height > 255
+    || header->recordSize != corpusRecordSize(header->width, header->height)
+    || (size_t)info.st_size < CORPUS_HEADER_LEN + (size_t)header->count * header->recordSize){
+    munmap(data, info.st_size);
+    return -1;
+  }
+
+  // Mazes are read in order by the benchmarks
+  madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+  corpus->header = header;
+  corpus->records = (const unsigned char *)data + CORPUS_HEADER_LEN;
+  corpus->size = info.st_size;
+  return 0;
+}
+
+void corpusClose(Corpus *corpus){
+  munmap((void *)corpus->header, corpus->size);
+  corpus->header = NULL;
+  corpus->records = NULL;
+}
+
+/**
+  * Load the i'th maze into the simulator, returning 0 on success, or -1 if it isn't
+  * the simulator's size or doesn't start where the simulated buggy does
+*/
+int corpusLoadSim(const Corpus *corpus, uint32_t i){
+  const CorpusMaze *maze;
+  int x, y, direction;
+
+  if(i >= corpus->header->count || corpus->header->width != SIZE_X || corpus->header->height != SIZE_Y){
+    return -1;
+  }
+  maze = corpusMaze(corpus, i);
+  if(maze->startX != START_X || maze->startY != START_Y || maze->startDirection != DIR_NORTH){
+    return -1;
+  }
+
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      simMaze.walls[x][y] = 0;
+      // SIM_WALL_N..SIM_WALL_W are 1 << heading
+      for(direction = DIR_NORTH; direction <= DIR_WEST; direction++){
+        if(corpusWall(maze, SIZE_X, SIZE_Y, x, y, direction)){
+          simMaze.walls[x][y] |= 1 << direction;
+        }
+      }
+    }
+  }
+  simMaze.nestX = maze->nestX;
+  simMaze.nestY = maze->nestY;
+  return 0;
+}
+
+/**
+  * Print the i'th maze in the simulator's text format (see sim.h), with S marking the start
+*/
+void corpusPrint(FILE *file, const Corpus *corpus, uint32_t i){
+  const CorpusMaze *maze = corpusMaze(corpus, i);
+  int width = corpus->header->width;
+  int height = corpus->header->height;
+  int x, y;
+
+  for(y = height - 1; y >= 0; y--){
+    for(x = 0; x < width; x++){
+      fputs(corpusWall(maze, width, height, x, y, DIR_NORTH) ? "+---" : "+   ", file);
+    }
+    fputs("+\n", file);
+    for(x = 0; x < width; x++){
+      fputc(corpusWall(maze, width, height, x, y, DIR_WEST) ? '|' : ' ', file);
+      if(x == maze->nestX && y == maze->nestY){
+        fputs(" N ", file);
+      }else if(x == maze->startX && y == maze->startY){
+        fputs(" S ", file);
+      }else{
+        fputs("   ", file);
+      }
+    }
+    fputs("|\n", file);
+  }
+  for(x = 0; x < width; x++){
+    fputs("+---", file);
+  }
+  fputs("+\n", file);
+}
@@ -0,0 +1,110 @@
+/**
+  * Maze corpus
+  * A binary file of many mazes for benchmarking, laid out so it can be memory mapped
+  * and used in place: a fixed header, then fixed size records, so maze i is at
+  * header + i * recordSize and any wall is a shift and mask away. All values are
+  * little endian, as on every host this runs on.
+  *
+  * Header (CORPUS_HEADER_LEN bytes):
+  *   magic "MZC1", version, width, height, record size (2 bytes each), maze count (4 bytes),
+  *   4 bytes reserved
+  * Record:
+  *   start x, start y, start heading, nest x, nest y, kind (CorpusKind), 2 bytes reserved,
+  *   then 2 bits per cell (x major: cell x * height + y, four cells to a byte from the
+  *   low bits up): CORPUS_WALL_N and CORPUS_WALL_E. South and west walls are the north
+  *   and east walls of the neighbouring cells; the outside of the maze is always walled.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CORPUS_MAGIC        "MZC1"
+#define CORPUS_VERSION      1
+#define CORPUS_HEADER_LEN   20
+#define CORPUS_RECORD_HEAD  8
+
+// The two walls stored for each cell
+#define CORPUS_WALL_N       1
+#define CORPUS_WALL_E       2
+
+typedef enum{
+  // Exactly one path between any two cells
+  CORPUS_PERFECT,
+  // A perfect maze with walls knocked out, so there are several routes
+  CORPUS_LOOPED,
+  // A perfect maze with one run of walls cut loose from the outside wall,
+  // which wall following can circle forever
+  CORPUS_ISLAND,
+  CORPUS_KINDS,
+} CorpusKind;
+
+typedef struct{
+  char magic[4];
+  uint16_t version;
+  uint16_t width, height;
+  uint16_t recordSize;
+  uint32_t count;
+  uint32_t reserved;
+} __attribute__((packed)) CorpusHeader;
+
+typedef struct{
+  uint8_t startX, startY, startDirection;
+  uint8_t nestX, nestY;
+  uint8_t kind;
+  uint8_t reserved[2];
+  uint8_t walls[];
+} __attribute__((packed)) CorpusMaze;
+
+// An open (memory mapped) corpus
+typedef struct{
+  const CorpusHeader *header;
+  const unsigned char *records;
+  size_t size;
+} Corpus;
+
+/**
+  * Bytes in a record for a maze of the given size
+*/
+static inline size_t corpusRecordSize(int width, int height){
+  return CORPUS_RECORD_HEAD + (width * height + 3) / 4;
+}
+
+/**
+  * The i'th maze of an open corpus
+*/
+static inline const CorpusMaze *corpusMaze(const Corpus *corpus, uint32_t i){
+  return (const CorpusMaze *)(corpus->records + (size_t)i * corpus->header->recordSize);
+}
+
+/**
+  * The stored (north and east) wall bits of a cell
+*/
+static inline int corpusCellBits(const CorpusMaze *maze, int height, int x, int y){
+  int cell = x * height + y;
+  return (maze->walls[cell / 4] >> (cell % 4 * 2)) & 3;
+}
+
+/**
+  * Whether a cell has a wall on the given side (heading as DIR_NORTH..DIR_WEST)
+*/
+static inline bool corpusWall(const CorpusMaze *maze, int width, int height, int x, int y, int direction){
+  switch(direction){
+    case 0: return y == height - 1 || (corpusCellBits(maze, height, x, y) & CORPUS_WALL_N);
+    case 1: return x == width - 1 || (corpusCellBits(maze, height, x, y) & CORPUS_WALL_E);
+    case 2: return y == 0 || (corpusCellBits(maze, height, x, y - 1) & CORPUS_WALL_N);
+    default: return x == 0 || (corpusCellBits(maze, height, x - 1, y) & CORPUS_WALL_E);
+  }
+}
+
+int corpusOpen(const char *path, Corpus *corpus);
+void corpusClose(Corpus *corpus);
+int corpusLoadSim(const Corpus *corpus, uint32_t i);
+void corpusPrint(FILE *file, const Corpus *corpus, uint32_t i);
+
+#endif
@@ -0,0 +1,535 @@
+/**
+  * Controller hot path benchmark
+  * Times the controller's per-cell work (detect(), turn(), newCellEntered() and drawMaze())
+  * and the planners in every cell and heading of a fixed set of mazes. The buggy is a
+  * stub robot that answers sensor reads from the maze at once and counts the calls made
+  * to each FA_* function, so only the controller's own time is measured. Reports ns per
+  * call, the fastest of several trials (as many as fit in BENCH_MIN_SECONDS, if more),
+  * and FA_* calls per call.
+  *
+  * Results can be saved as a baseline and later builds compared with it: a benchmark
+  * regresses if it is more than the threshold slower, or makes more FA_* calls of any kind.
+  * Call counts don't depend on the machine, so a change in them is the code's; they are
+  * allowed CALL_TOLERANCE only because the profiler's reports (profile.h) are sent as
+  * decimal text, whose length varies with the times measured.
+  *
+  * Usage: ctlbench [-n calls] [-r trials] [-t percent] [-o saved] [-b baseline] [-c count corpus]
+  *   corpus      maze corpus (see corpus.h) to take the first count usable mazes of with -c,
+  *               else mazesim's built in 4x4 maze
+  *   -n calls    calls of each benchmark per trial (default 20000)
+  *   -r trials   least trials of each benchmark, the fastest counting (default 5)
+  *   -o saved    save the results as a baseline
+  *   -b baseline compare with a saved baseline
+  *   -t percent  slow down allowed against the baseline (default 20)
+  *
+  * Exits with 2 if any benchmark regressed against the baseline.
+  *
+  * Build: bin/host/hostcc -o out/host/ctlbench src/host/ctlbench.c src/host/sim.c src/host/sensors.c src/host/corpus.c -lm
+  * bin/host/bench builds it and compares with the last baseline saved on this machine.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "allcode_api.h"
+#include "host.h"
+#include "main.h"
+#include "sim.h"
+#include "corpus.h"
+#include "planner.h"
+#include "share.h"
+
+#define BENCH_NAME_LEN  24
+// Least time to spend timing each benchmark, so the fastest trial is a steady one
+#define BENCH_MIN_SECONDS 0.25
+// Fraction by which a call count may grow before it is a regression
+#define CALL_TOLERANCE  0.01
+
+// The FA_* functions the stub robot counts, one per HostBackend entry
+typedef enum{
+  CALL_READ_IR,
+  CALL_READ_LINE,
+  CALL_READ_LIGHT,
+  CALL_READ_SWITCH,
+  CALL_SET_MOTORS,
+  CALL_FORWARDS,
+  CALL_BACKWARDS,
+  CALL_LEFT,
+  CALL_RIGHT,
+  CALL_DELAY,
+  CALL_CLOCK,
+  CALL_LCD_CLEAR,
+  CALL_LCD_PLOT,
+  CALL_BT_CONNECTED,
+  CALL_BT_SEND,
+  CALL_BT_AVAILABLE,
+  CALL_BT_GET,
+  CALLS,
+} Call;
+
+static const char *callNames[CALLS] = {
+  "FA_ReadIR", "FA_ReadLine", "FA_ReadLight", "FA_ReadSwitch", "FA_SetMotors", "FA_Forwards",
+  "FA_Backwards", "FA_Left", "FA_Right", "FA_DelayMillis", "FA_ClockMS", "FA_LCDClear",
+  "FA_LCDPlot", "FA_BTConnected", "FA_BTSendByte", "FA_BTAvailable", "FA_BTGetByte",
+};
+
+// A benchmark: which cells and headings it is called in, how to set up the model, and the call
+typedef struct{
+  const char *name;
+  // Set up the model for a maze, once before its calls
+  void (*setUp)();
+  // Whether to call it with the buggy in a cell facing a heading
+  bool (*applies)(int x, int y, int direction);
+  void (*call)();
+} Bench;
+
+// A benchmark's results, measured or from a baseline
+typedef struct{
+  char name[BENCH_NAME_LEN];
+  double ns;
+  double calls[CALLS];
+} Result;
+
+static unsigned long calls[CALLS];
+
+static double seconds(){
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+  * The stub robot: it is always where the controller thinks it is, in the middle of
+  * the cell, so each IR channel that faces a side sees that side's wall or nothing
+*/
+static unsigned int stubIR(unsigned char channel){
+  calls[CALL_READ_IR]++;
+  if(channel % 2 != 0){
+    return 0;
+  }
+  // IR_LEFT, IR_FRONT, IR_RIGHT and IR_REAR are a quarter turn apart, starting on the left
+  return simMaze.walls[currentPosX][currentPosY] & (1 << ((currentDirection + channel / 2 + 3) % 4)) ?
+    WALL_DIST_THRESHOLD * 2 : 0;
+}
+
+static unsigned int stubLine(unsigned char channel){
+  calls[CALL_READ_LINE]++;
+  return CELL_LINE_THRESHOLD * 2;
+}
+
+static unsigned int stubLight(){
+  calls[CALL_READ_LIGHT]++;
+  return currentPosX == simMaze.nestX && currentPosY == simMaze.nestY ? 0 : LIGHT_LEVEL_THRESHOLD * 2;
+}
+
+static unsigned char stubSwitch(unsigned char sw){
+  calls[CALL_READ_SWITCH]++;
+  return 0;
+}
+
+static void stubMotors(unsigned char left, unsigned char right){
+  calls[CALL_SET_MOTORS]++;
+}
+
+static void stubForwards(unsigned int distance){
+  calls[CALL_FORWARDS]++;
+}
+
+static void stubBackwards(unsigned int distance){
+  calls[CALL_BACKWARDS]++;
+}
+
+static void stubLeft(unsigned int angle){
+  calls[CALL_LEFT]++;
+}
+
+static void stubRight(unsigned int angle){
+  calls[CALL_RIGHT]++;
+}
+
+static void stubDelay(unsigned int ms){
+  calls[CALL_DELAY]++;
+}
+
+static unsigned long stubClock(){
+  calls[CALL_CLOCK]++;
+  return hostClockMs;
+}
+
+static void stubLCDClear(){
+  calls[CALL_LCD_CLEAR]++;
+}
+
+static void stubLCDPlot(unsigned char x, unsigned char y){
+  calls[CALL_LCD_PLOT]++;
+}
+
+// Connected, so debug output and log frames are sent as they would be on a watched run
+static unsigned char stubConnected(){
+  calls[CALL_BT_CONNECTED]++;
+  return 1;
+}
+
+static void stubSend(unsigned char byte){
+  calls[CALL_BT_SEND]++;
+}
+
+static unsigned char stubAvailable(){
+  calls[CALL_BT_AVAILABLE]++;
+  return 0;
+}
+
+static unsigned char stubGet(){
+  calls[CALL_BT_GET]++;
+  return 0;
+}
+
+static const HostBackend stubBackend = {
+  .readIR = stubIR,
+  .readLine = stubLine,
+  .readLight = stubLight,
+  .readSwitch = stubSwitch,
+  .setMotors = stubMotors,
+  .forwards = stubForwards,
+  .backwards = stubBackwards,
+  .left = stubLeft,
+  .right = stubRight,
+  .delay = stubDelay,
+  .clock = stubClock,
+  .lcdClear = stubLCDClear,
+  .lcdPlot = stubLCDPlot,
+  .btConnected = stubConnected,
+  .btSend = stubSend,
+  .btAvailable = stubAvailable,
+  .btGet = stubGet,
+};
+
+/**
+  * Model set ups: the whole maze known, as once explored
+*/
+static void knownMaze(){
+  simModelMaze();
+  noVisitedCells = SIZE_X * SIZE_Y;
+  routePhase = ROUTE_EXPLORE;
+#ifdef SHARE_MAP
+  resetShare();
+#endif
+}
+
+/**
+  * The whole maze known but the far corner, so turn() follows the left wall
+*/
+static void exploringMaze(){
+  knownMaze();
+  maze[SIZE_X - 1][SIZE_Y - 1].visited = false;
+  maze[SIZE_X - 1][SIZE_Y - 1].timesSensed = 0;
+  noVisitedCells = SIZE_X * SIZE_Y - 1;
+}
+
+#ifdef ROUTE_PLANNER
+/**
+  * The western half of the maze known, as part way through exploring
+*/
+static void halfKnownMaze(){
+  int x, y;
+
+  knownMaze();
+  for(x = SIZE_X / 2; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      maze[x][y].visited = false;
+      maze[x][y].timesSensed = 0;
+    }
+  }
+  noVisitedCells = SIZE_X / 2 * SIZE_Y;
+}
+#endif
+
+static bool everywhere(int x, int y, int direction){
+  return true;
+}
+
+static bool facingOpening(int x, int y, int direction){
+  return !(simMaze.walls[x][y] & (1 << direction));
+}
+
+#ifdef ROUTE_PLANNER
+static bool inKnownHalf(int x, int y, int direction){
+  return x < SIZE_X / 2;
+}
+#endif
+
+static void callTurn(){
+  routePhase = ROUTE_EXPLORE;
+  // Wall following starts afresh in each cell, rather than coming full circle in one of them
+  exploreFirstDirection = -1;
+  turn();
+}
+
+static void callNewCellEntered(){
+  routePhase = ROUTE_EXPLORE;
+  newCellEntered();
+}
+
+#ifdef ROUTE_PLANNER
+static void callPlanRoute(){
+  planRoute(currentPosX, currentPosY, currentDirection, simMaze.nestX, simMaze.nestY);
+}
+#endif
+
+#ifdef ROUTE_PLANNER
+static void callFindFrontier(){
+  findFrontier();
+}
+#endif
+
+static const Bench benches[] = {
+  {"detect", knownMaze, everywhere, detect},
+  {"turn/follow", exploringMaze, everywhere, callTurn},
+#ifdef ROUTE_PLANNER
+  // Explored: plans the route to the nest
+  {"turn/plan", knownMaze, everywhere, callTurn},
+#endif
+  {"newCellEntered", knownMaze, facingOpening, callNewCellEntered},
+  {"drawMaze", knownMaze, everywhere, drawMaze},
+#ifdef ROUTE_PLANNER
+  {"planRoute", knownMaze, everywhere, callPlanRoute},
+  {"findFrontier", halfKnownMaze, inKnownHalf, callFindFrontier},
+#endif
+};
+
+#define BENCHES ((int)(sizeof(benches) / sizeof(benches[0])))
+
+/**
+  * Run a benchmark for a number of calls over the mazes in turn, returning the time taken
+  * by the calls alone in seconds. FA_* calls are added to calls[]
+*/
+static double runBench(const Bench *bench, const SimMaze *mazes, int mazeCount, long count){
+  double elapsed = 0, start;
+  int m = 0, x, y, direction;
+  long done = 0;
+
+  while(done < count){
+    simMaze = mazes[m];
+    m = (m + 1) % mazeCount;
+    bench->setUp();
+
+    start = seconds();
+    for(x = 0; x < SIZE_X && done < count; x++){
+      for(y = 0; y < SIZE_Y && done < count; y++){
+        for(direction = DIR_NORTH; direction <= DIR_WEST && done < count; direction++){
+          if(!bench->applies(x, y, direction)){
+            continue;
+          }
+          // Put the buggy there, as the call may have moved or turned it
+          currentPosX = x;
+          currentPosY = y;
+          currentDirection = direction;
+          currentCell = &maze[x][y];
+          bench->call();
+          done++;
+        }
+      }
+    }
+    elapsed += seconds() - start;
+  }
+  return elapsed;
+}
+
+/**
+  * Read a saved baseline, returning how many results it holds or -1
+*/
+static int readBaseline(const char *path, Result *results, int most){
+  FILE *file = fopen(path, "r");
+  char line[512];
+  char *field, *end;
+  int count = 0, i;
+
+  if(file == NULL){
+    perror(path);
+    return -1;
+  }
+  while(count < most && fgets(line, sizeof(line), file) != NULL){
+    if(line[0] == '#' || sscanf(line, "%23s %lf", results[count].name, &results[count].ns) != 2){
+      continue;
+    }
+    // Skip the name and time, then one count per FA_* function
+    field = line;
+    for(i = 0; i < 2; i++){
+      field += strspn(field, " \t");
+      field += strcspn(field, " \t");
+    }
+    for(i = 0; i < CALLS; i++){
+      results[count].calls[i] = strtod(field, &end);
+      if(end == field){
+        fprintf(stderr, "%s: %s has %d of %d FA_* call counts\n", path, results[count].name, i, CALLS);
+        fclose(file);
+        return -1;
+      }
+      field = end;
+    }
+    count++;
+  }
+  fclose(file);
+  return count;
+}
+
+static int writeBaseline(const char *path, const Result *results, int count){
+  FILE *file = fopen(path, "w");
+  int i, j;
+
+  if(file == NULL){
+    perror(path);
+    return -1;
+  }
+  fprintf(file, "# ctlbench baseline: benchmark, ns per call, then calls per call of");
+  for(j = 0; j < CALLS; j++){
+    fprintf(file, " %s", callNames[j]);
+  }
+  fprintf(file, "\n");
+  for(i = 0; i < count; i++){
+    fprintf(file, "%s %.2f", results[i].name, results[i].ns);
+    for(j = 0; j < CALLS; j++){
+      fprintf(file, " %.4f", results[i].calls[j]);
+    }
+    fprintf(file, "\n");
+  }
+  fclose(file);
+  return 0;
+}
+
+/**
+  * Print a benchmark's result, compared with its baseline if there is one.
+  * Returns true if it regressed
+*/
+static bool report(const Result *result, const Result *base, double threshold){
+  bool regressed = false;
+  int i;
+
+  printf("%-16s %9.1f", result->name, result->ns);
+  if(base != NULL){
+    regressed = result->ns > base->ns * (1 + threshold / 100);
+    printf(" %9.1f %+7.1f%%%s", base->ns, (result->ns / base->ns - 1) * 100, regressed ? " SLOWER" : "");
+  }
+  printf("\n");
+
+  for(i = 0; i < CALLS; i++){
+    if(result->calls[i] == 0 && (base == NULL || base->calls[i] == 0)){
+      continue;
+    }
+    printf("  %-16s %9.2f", callNames[i], result->calls[i]);
+    // Counts are saved to 4 places
+    if(base != NULL && result->calls[i] > base->calls[i] * (1 + CALL_TOLERANCE) + 0.00005){
+      printf(" %9.2f MORE", base->calls[i]);
+      regressed = true;
+    }else if(base != NULL && result->calls[i] < base->calls[i] - 0.00005){
+      printf(" %9.2f fewer", base->calls[i]);
+    }
+    printf("\n");
+  }
+  return regressed;
+}
+
+int main(int argc, char *argv[]){
+  static Result results[BENCHES], baseline[BENCHES];
+  SimMaze *mazes;
+  Corpus corpus;
+  const char *savePath = NULL, *basePath = NULL;
+  const Result *base;
+  long count = 20000, corpusCount = 0;
+  int opt, trials = 5, mazeCount = 0, baseCount = 0, regressions = 0, i, j, trial;
+  double threshold = 20, elapsed, total;
+  uint32_t index;
+
+  while((opt = getopt(argc, argv, "n:r:t:o:b:c:")) != -1){
+    switch(opt){
+      case 'n': count = strtol(optarg, NULL, 0); break;
+      case 'r': trials = atoi(optarg); break;
+      case 't': threshold = strtod(optarg, NULL); break;
+      case 'o': savePath = optarg; break;
+      case 'b': basePath = optarg; break;
+      case 'c': corpusCount = strtol(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "Usage: ctlbench [-n calls] [-r trials] [-t percent] [-o saved] [-b baseline] [-c count corpus]\n");
+        return 1;
+    }
+  }
+  if(count < 1 || trials < 1 || corpusCount < 0 || (corpusCount > 0) != (optind == argc - 1) || optind < argc - 1){
+    fprintf(stderr, "Usage: ctlbench [-n calls] [-r trials] [-t percent] [-o saved] [-b baseline] [-c count corpus]\n");
+    return 1;
+  }
+
+  // The maze set: the first usable mazes of a corpus, or the built in maze
+  if(corpusCount > 0){
+    if(corpusOpen(argv[optind], &corpus) != 0){
+      fprintf(stderr, "%s: not a maze corpus\n", argv[optind]);
+      return 1;
+    }
+    mazes = malloc(corpusCount * sizeof(SimMaze));
+    for(index = 0; index < corpus.header->count && mazeCount < corpusCount; index++){
+      if(corpusLoadSim(&corpus, index) == 0 && simMaze.nestX >= 0){
+        mazes[mazeCount++] = simMaze;
+      }
+    }
+    corpusClose(&corpus);
+    if(mazeCount < corpusCount){
+      fprintf(stderr, "%s: only %d %dx%d mazes with a nest starting at (%d, %d)\n", argv[optind],
+        mazeCount, SIZE_X, SIZE_Y, START_X, START_Y);
+      return 1;
+    }
+  }else{
+    mazes = malloc(sizeof(SimMaze));
+    simDefaultMaze();
+    mazes[mazeCount++] = simMaze;
+  }
+
+  if(basePath != NULL && (baseCount = readBaseline(basePath, baseline, BENCHES)) < 0){
+    return 1;
+  }
+
+  // Start the controller as for a run, so the log, profiler and planner are set up
+  hostUse(&stubBackend);
+  simMaze = mazes[0];
+  initialize();
+
+  printf("%d %dx%d maze%s, %ld calls per trial, best of %d\n", mazeCount, SIZE_X, SIZE_Y,
+    mazeCount == 1 ? "" : "s", count, trials);
+  printf("Benchmark          ns/call%s\n", baseCount > 0 ? "  baseline   change" : "");
+  for(i = 0; i < BENCHES; i++){
+    strcpy(results[i].name, benches[i].name);
+    results[i].ns = 0;
+    memset(calls, 0, sizeof(calls));
+    for(trial = 0, total = 0; trial < trials || total < BENCH_MIN_SECONDS; trial++){
+      elapsed = runBench(&benches[i], mazes, mazeCount, count);
+      total += elapsed;
+      if(trial == 0 || elapsed * 1e9 / count < results[i].ns){
+        results[i].ns = elapsed * 1e9 / count;
+      }
+    }
+    for(j = 0; j < CALLS; j++){
+      results[i].calls[j] = (double)calls[j] / count / trial;
+    }
+
+    base = NULL;
+    for(j = 0; j < baseCount; j++){
+      if(strcmp(baseline[j].name, results[i].name) == 0){
+        base = &baseline[j];
+      }
+    }
+    regressions += report(&results[i], base, threshold);
+  }
+
+  if(savePath != NULL && writeBaseline(savePath, results, BENCHES) != 0){
+    return 1;
+  }
+  free(mazes);
+
+  if(basePath != NULL){
+    printf("%d of %d benchmarks regressed (threshold %.0f%%)\n", regressions, BENCHES, threshold);
+  }
+  return regressions > 0 ? 2 : 0;
+}
@@ -0,0 +1,46 @@
+/**
+  * Host harness for the maze runner controller
+  * A HostBackend supplies the robot's world: a replayed log, a simulated maze or
+  * a stub. Any entry left NULL falls back to a neutral default (reads return 0,
+  * commands do nothing). Time is virtual and only advances through the backend
+  * or FA_DelayMillis(), so runs are deterministic and go at CPU speed.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef HOST_H
+#define HOST_H
+
+typedef struct{
+  unsigned int (*readIR)(unsigned char channel);
+  unsigned int (*readLine)(unsigned char channel);
+  unsigned int (*readLight)();
+  unsigned char (*readSwitch)(unsigned char sw);
+  void (*setMotors)(unsigned char left, unsigned char right);
+  void (*forwards)(unsigned int distance);
+  void (*backwards)(unsigned int distance);
+  void (*left)(unsigned int angle);
+  void (*right)(unsigned int angle);
+  // Called after the virtual clock has advanced by ms
+  void (*delay)(unsigned int ms);
+  // Overrides the virtual clock for FA_ClockMS() when set
+  unsigned long (*clock)();
+  void (*lcdClear)();
+  void (*lcdPlot)(unsigned char x, unsigned char y);
+  // Bluetooth: connected flag, bytes sent by the robot, bytes received by the robot
+  unsigned char (*btConnected)();
+  void (*btSend)(unsigned char byte);
+  unsigned char (*btAvailable)();
+  unsigned char (*btGet)();
+  // Not an API call: the controller entering a MainState, from changeMainStateNow()
+  void (*stateChanged)(int state);
+} HostBackend;
+
+// The active backend
+extern const HostBackend *hostBackend;
+// Virtual time in milliseconds, as returned by FA_ClockMS()
+extern unsigned long hostClockMs;
+
+void hostUse(const HostBackend *backend);
+void hostStateChanged(int state);
+
+#endif
@@ -0,0 +1,155 @@
+/**
+  * Map upload tool
+  * Writes the FRAME_MAP (and with -r a FRAME_ROUTE) frames that give the maze runner a
+  * known maze at the start of its next run (see upload.h), ready to be sent to the robot's
+  * bluetooth serial port. The map comes from a maze text file (see sim.h) or from the last
+  * map the robot sent on finishing in a capture of its bluetooth output. Maps are checked
+  * exactly as the robot will check them before anything is written.
+  *
+  * Usage: mapsend [-r] [-c] [-o output] maze.txt|capture
+  *   -r          also send the quickest route from the start to the nest
+  *   -c          read the map from a capture rather than a maze text file
+  *   -o output   write to output (e.g. /dev/rfcomm0) rather than standard output
+  *
+  * Build: bin/host/hostcc -o out/host/mapsend src/host/mapsend.c src/host/sim.c src/host/sensors.c -lm
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "allcode_api.h"
+#include "host.h"
+#include "main.h"
+#include "btframe.h"
+#include "sim.h"
+#include "upload.h"
+
+static const char *statusNames[] = {
+  "ok", "bad format", "start or nest outside the maze", "walls disagree", "bad route",
+};
+
+static FILE *output;
+
+static void sendByte(unsigned char byte){
+  fputc(byte, output);
+}
+
+static const HostBackend sendBackend = {
+  .btSend = sendByte,
+};
+
+/**
+  * Find the last map frame in a capture, returning its length or -1
+*/
+static int captureMap(FILE *capture, unsigned char *body){
+  FrameParser parser;
+  int c, length, found = -1;
+
+  resetFrameParser(&parser);
+  while((c = fgetc(capture)) != EOF){
+    length = parseFrameByte(&parser, c);
+    if(length == UPLOAD_MAP_LEN && parser.body[0] == FRAME_MAP){
+      memcpy(body, parser.body, length);
+      found = length;
+    }
+  }
+  return found;
+}
+
+/**
+  * Clear the controller's maze model, as initialize() does before applying an upload
+*/
+static void clearModel(){
+  memset(maze, 0, sizeof(maze));
+  noVisitedCells = 0;
+  nestCell = 0;
+  startPosX = START_X;
+  startPosY = START_Y;
+  startDirection = DIR_NORTH;
+}
+
+int main(int argc, char *argv[]){
+  FILE *input;
+  unsigned char map[UPLOAD_MAP_LEN];
+  unsigned char routeBody[UPLOAD_ROUTE_LEN];
+  int opt, status, mapLength, routeBodyLength = 0;
+  bool withRoute = false, fromCapture = false;
+  const char *outputName = NULL;
+
+  while((opt = getopt(argc, argv, "rco:")) != -1){
+    switch(opt){
+      case 'r':
+        withRoute = true;
+      break;
+      case 'c':
+        fromCapture = true;
+      break;
+      case 'o':
+        outputName = optarg;
+      break;
+      default:
+        fprintf(stderr, "Usage: mapsend [-r] [-c] [-o output] maze.txt|capture\n");
+        return 1;
+    }
+  }
+  if(optind != argc - 1){
+    fprintf(stderr, "Usage: mapsend [-r] [-c] [-o output] maze.txt|capture\n");
+    return 1;
+  }
+
+  input = fopen(argv[optind], fromCapture ? "rb" : "r");
+  if(input == NULL){
+    perror(argv[optind]);
+    return 1;
+  }
+  if(fromCapture){
+    mapLength = captureMap(input, map);
+    if(mapLength < 0){
+      fprintf(stderr, "No map found in %s\n", argv[optind]);
+      return 1;
+    }
+  }else{
+    if(simLoadMaze(input) != 0){
+      fprintf(stderr, "%s: not a %dx%d maze\n", argv[optind], SIZE_X, SIZE_Y);
+      return 1;
+    }
+    clearModel();
+    simModelMaze();
+    mapLength = encodeMap(map);
+  }
+  fclose(input);
+
+  // Take the map as the robot would
+  status = receiveUpload(map, mapLength);
+  if(status != UPLOAD_OK){
+    fprintf(stderr, "%s: map rejected: %s\n", argv[optind], statusNames[status]);
+    return 1;
+  }
+
+  if(withRoute){
+    clearModel();
+    if(!applyUpload()){
+      fprintf(stderr, "%s: no known route from the start to the nest\n", argv[optind]);
+      return 1;
+    }
+    routeBodyLength = encodeRoute(routeBody, startPosX, startPosY, startDirection);
+    fprintf(stderr, "Route of %d cells from (%d, %d)\n", routeLength, startPosX, startPosY);
+  }
+
+  output = outputName ? fopen(outputName, "wb") : stdout;
+  if(output == NULL){
+    perror(outputName);
+    return 1;
+  }
+  hostUse(&sendBackend);
+  sendFrame(map, mapLength);
+  if(withRoute){
+    sendFrame(routeBody, routeBodyLength);
+  }
+  if(output != stdout){
+    fclose(output);
+  }
+  return 0;
+}
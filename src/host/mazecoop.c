@@ -0,0 +1,543 @@
+/**
+  * Cooperative exploration simulator
+  * Runs several buggies in one simulated maze, each its own controller (a forked copy of
+  * this process, so each has its own model and state) and its own simulated robot, sharing
+  * what they find over a modelled bluetooth link (see share.h). Each buggy's link to the
+  * host carries every byte it sends or receives at a fixed rate and latency, and the host
+  * relays FRAME_CELL and FRAME_CLAIM frames from each buggy to all the others, so debug
+  * text and log frames queue ahead of them just as on the robots. The buggies are kept in
+  * step in simulated time, in slices no longer than the round trip through the host.
+  *
+  * Buggies start one after another from the usual start cell, and don't collide with one
+  * another (only with walls). As each sets off the host greets it with a claim on the start
+  * cell, which switches it from wall following to shared exploring even when it is alone,
+  * so runs with different numbers of buggies compare like with like. The run ends once
+  * every buggy has finished.
+  *
+  * Usage: mazecoop [-r buggies] [-s] [-g gap] [-b rate] [-l latency] [-t seconds] [-n seed] [-c index] [maze]
+  *   maze        maze text file (see sim.h), else mazesim's built in 4x4 maze
+  *   -c index    run maze index of a maze corpus (see corpus.h) given as maze
+  *   -r buggies  buggies in the maze (default 2)
+  *   -s          run with 1, 2, ... buggies in turn and compare their times
+  *   -g gap      ms between the buggies setting off (default 5000)
+  *   -b rate     link rate each way in bytes per second (default 11520, 115200 baud)
+  *   -l latency  link latency each way in ms (default 20)
+  *   -t seconds  simulated time to run for (default 300)
+  *   -n seed     add noise to the IR readings (see sensors.h)
+  *
+  * Reports when every cell had been entered by some buggy, when the first and the last
+  * buggy had a complete map, and when all had finished. Exits with 2 if any buggy hit a wall.
+  *
+  * Build: bin/host/hostcc -o out/host/mazecoop src/host/mazecoop.c src/host/sim.c src/host/sensors.c src/host/corpus.c -lm
+  * Larger mazes need the controller built to match, e.g. -DSIZE_X=8 -DSIZE_Y=8 with an 8x8 corpus.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "allcode_api.h"
+#include "host.h"
+#include "main.h"
+#include "sim.h"
+#include "corpus.h"
+#include "btframe.h"
+#include "share.h"
+
+#define COOP_MAX        16
+#define NEVER           0xffffffffffffffffULL
+
+// A byte on a link and when it was sent or will arrive (us of shared simulated time)
+typedef struct{
+  unsigned long long us;
+  unsigned char byte;
+} TimedByte;
+
+// Bytes on their way, in arrival order
+typedef struct{
+  TimedByte *bytes;
+  int count, next, capacity;
+} ByteQueue;
+
+// What a buggy reports at the end of each slice, followed by the bytes it sent during it
+typedef struct{
+  MainState state;
+  int knownCells;
+  unsigned long collisions;
+  bool entered[SIZE_X][SIZE_Y];
+  int count;
+} CoopReport;
+
+// What the host sends a buggy before each slice, followed by the bytes for it
+typedef struct{
+  bool stop;
+  int count;
+} CoopDelivery;
+
+// A buggy as the host sees it
+typedef struct{
+  pid_t pid;
+  int toBuggy, fromBuggy;
+  CoopReport report;
+  // Link state: when each direction is next free
+  unsigned long long upFree, downFree;
+  FrameParser parser;
+  ByteQueue pending;
+  unsigned long bytesSent, framesRelayed;
+  unsigned long long mappedUs, finishedUs;
+} Buggy;
+
+// The link and run settings
+static int buggyCount = 2;
+static unsigned long gapMs = 5000;
+static unsigned long linkRate = 11520;
+static unsigned long latencyMs = 20;
+static unsigned long seconds = 300;
+static unsigned long long sliceUs;
+
+// In a buggy's process (after forking): its link to the host and when it set off
+static int toHost, fromHost;
+static unsigned long long setOffUs;
+static ByteQueue inbound, outbound;
+
+// Frames relayed by the host are captured here as sendFrame() writes them
+static ByteQueue relayed;
+
+static void pushByte(ByteQueue *queue, unsigned long long us, unsigned char byte){
+  if(queue->count == queue->capacity){
+    queue->capacity = queue->capacity ? queue->capacity * 2 : 256;
+    queue->bytes = realloc(queue->bytes, queue->capacity * sizeof(TimedByte));
+  }
+  queue->bytes[queue->count].us = us;
+  queue->bytes[queue->count++].byte = byte;
+}
+
+static void clearQueue(ByteQueue *queue){
+  queue->count = 0;
+  queue->next = 0;
+}
+
+static void readAll(int fd, void *data, size_t length){
+  ssize_t done;
+
+  while(length > 0){
+    done = read(fd, data, length);
+    if(done <= 0){
+      _exit(1);
+    }
+    data = (char *)data + done;
+    length -= done;
+  }
+}
+
+static void writeAll(int fd, const void *data, size_t length){
+  ssize_t done;
+
+  while(length > 0){
+    done = write(fd, data, length);
+    if(done <= 0){
+      _exit(1);
+    }
+    data = (const char *)data + done;
+    length -= done;
+  }
+}
+
+/**
+  * Shared simulated time in this buggy's process
+*/
+static unsigned long long coopNow(){
+  return simTimeUs + setOffUs;
+}
+
+static unsigned char coopConnected(){
+  return 1;
+}
+
+static void coopSend(unsigned char byte){
+  pushByte(&outbound, coopNow(), byte);
+}
+
+static unsigned char coopAvailable(){
+  return inbound.next < inbound.count && inbound.bytes[inbound.next].us <= coopNow();
+}
+
+static unsigned char coopGet(){
+  return coopAvailable() ? inbound.bytes[inbound.next++].byte : 0;
+}
+
+static void relaySend(unsigned char byte){
+  pushByte(&relayed, 0, byte);
+}
+
+static const HostBackend relayBackend = {
+  .btSend = relaySend,
+};
+
+/**
+  * End a slice in a buggy's process: report to the host and take the bytes for the next slice.
+  * The process exits here when the host stops the run
+*/
+static void exchange(bool running){
+  CoopReport report;
+  CoopDelivery delivery;
+  TimedByte byte;
+  int x, y, i;
+
+  memset(&report, 0, sizeof(report));
+  report.state = running ? mainState : MAIN_START;
+  report.knownCells = running ? noVisitedCells : 0;
+  report.collisions = simStats.collisions;
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      report.entered[x][y] = running && simVisited(x, y);
+    }
+  }
+  report.count = outbound.count;
+  writeAll(toHost, &report, sizeof(report));
+  writeAll(toHost, outbound.bytes, outbound.count * sizeof(TimedByte));
+  clearQueue(&outbound);
+
+  readAll(fromHost, &delivery, sizeof(delivery));
+  if(delivery.stop){
+    _exit(0);
+  }
+  // Drop bytes already taken before adding more
+  if(inbound.next == inbound.count){
+    clearQueue(&inbound);
+  }
+  for(i = 0; i < delivery.count; i++){
+    readAll(fromHost, &byte, sizeof(byte));
+    pushByte(&inbound, byte.us, byte.byte);
+  }
+}
+
+/**
+  * simSync: the end of a slice whilst the controller runs
+*/
+static void coopSync(){
+  exchange(true);
+  simSyncUs += sliceUs;
+}
+
+/**
+  * A buggy's process: wait for its turn to set off, then run the controller until stopped
+*/
+static void runBuggy(unsigned long long releaseUs){
+  HostBackend backend = simBackend;
+  unsigned long long now;
+
+  setOffUs = releaseUs;
+  for(now = 0; now < releaseUs; now += sliceUs){
+    exchange(false);
+  }
+
+  backend.btConnected = coopConnected;
+  backend.btSend = coopSend;
+  backend.btAvailable = coopAvailable;
+  backend.btGet = coopGet;
+  hostUse(&backend);
+  simReset();
+  simSync = coopSync;
+  simSyncUs = sliceUs;
+  mainState = MAIN_START;
+
+  while(1){
+    runMainState();
+  }
+}
+
+/**
+  * Queue a frame from the host down a buggy's link, to arrive from a given time
+*/
+static void hostFrame(Buggy *buggy, unsigned long long us, const unsigned char *body, int length){
+  int k;
+
+  clearQueue(&relayed);
+  hostUse(&relayBackend);
+  sendFrame(body, length);
+  hostUse(NULL);
+  for(k = 0; k < relayed.count; k++){
+    buggy->downFree = (us > buggy->downFree ? us : buggy->downFree) + 1000000ULL / linkRate;
+    pushByte(&buggy->pending, buggy->downFree + latencyMs * 1000ULL, relayed.bytes[k].byte);
+  }
+}
+
+/**
+  * Carry the bytes a buggy sent during a slice up its link, and relay any sharing frames
+  * down the links of all the others
+*/
+static void carry(Buggy buggies[], int from, const TimedByte *bytes, int count){
+  unsigned long long byteUs = 1000000ULL / linkRate;
+  unsigned long long latencyUs = latencyMs * 1000ULL;
+  unsigned long long arrival;
+  Buggy *buggy = &buggies[from];
+  int i, j, length;
+
+  for(i = 0; i < count; i++){
+    buggy->upFree = (bytes[i].us > buggy->upFree ? bytes[i].us : buggy->upFree) + byteUs;
+    arrival = buggy->upFree + latencyUs;
+    buggy->bytesSent++;
+
+    length = parseFrameByte(&buggy->parser, bytes[i].byte);
+    if(length <= 0 || (buggy->parser.body[0] != FRAME_CELL && buggy->parser.body[0] != FRAME_CLAIM)){
+      continue;
+    }
+
+    // Frame it afresh for the other buggies, queued behind whatever their links are carrying
+    buggy->framesRelayed++;
+    for(j = 0; j < buggyCount; j++){
+      if(j != from){
+        hostFrame(&buggies[j], arrival, buggy->parser.body, length);
+      }
+    }
+  }
+}
+
+/**
+  * Send each buggy the bytes for its next slice, or stop them all
+*/
+static void deliver(Buggy buggies[], bool stop){
+  CoopDelivery delivery;
+  int i;
+
+  delivery.stop = stop;
+  for(i = 0; i < buggyCount; i++){
+    delivery.count = stop ? 0 : buggies[i].pending.count;
+    writeAll(buggies[i].toBuggy, &delivery, sizeof(delivery));
+    writeAll(buggies[i].toBuggy, buggies[i].pending.bytes, delivery.count * sizeof(TimedByte));
+    clearQueue(&buggies[i].pending);
+  }
+}
+
+/**
+  * Run the buggies to the end, returning false if any hit a wall. Times are left in buggies[]
+  * and the time every cell had been entered in coveredUs
+*/
+static bool runCoop(Buggy buggies[], unsigned long long *coveredUs){
+  static TimedByte bytes[1 << 16];
+  bool entered[SIZE_X][SIZE_Y];
+  int toBuggy[2], fromBuggy[2];
+  int i, x, y, cells, finished, count, chunk;
+  unsigned long long now, releaseUs;
+  unsigned char greeting[SHARE_CLAIM_LEN] = {FRAME_CLAIM, START_X, START_Y};
+  unsigned long collisions = 0;
+  bool stop;
+
+  memset(entered, 0, sizeof(entered));
+  *coveredUs = NEVER;
+  fflush(stdout);
+  for(i = 0; i < buggyCount; i++){
+    memset(&buggies[i], 0, sizeof(buggies[i]));
+    buggies[i].mappedUs = NEVER;
+    buggies[i].finishedUs = NEVER;
+    resetFrameParser(&buggies[i].parser);
+    if(pipe(toBuggy) != 0 || pipe(fromBuggy) != 0){
+      perror("pipe");
+      exit(1);
+    }
+    releaseUs = (unsigned long long)i * gapMs * 1000 / sliceUs * sliceUs;
+    buggies[i].pid = fork();
+    if(buggies[i].pid == 0){
+      toHost = fromBuggy[1];
+      fromHost = toBuggy[0];
+      runBuggy(releaseUs);
+    }
+    hostFrame(&buggies[i], releaseUs, greeting, SHARE_CLAIM_LEN);
+    buggies[i].toBuggy = toBuggy[1];
+    buggies[i].fromBuggy = fromBuggy[0];
+    close(toBuggy[0]);
+    close(fromBuggy[1]);
+  }
+
+  deliver(buggies, false);
+  for(now = sliceUs; ; now += sliceUs){
+    finished = 0;
+    for(i = 0; i < buggyCount; i++){
+      readAll(buggies[i].fromBuggy, &buggies[i].report, sizeof(CoopReport));
+      for(count = buggies[i].report.count; count > 0; count -= chunk){
+        chunk = count < (int)(sizeof(bytes) / sizeof(bytes[0])) ? count : (int)(sizeof(bytes) / sizeof(bytes[0]));
+        readAll(buggies[i].fromBuggy, bytes, chunk * sizeof(TimedByte));
+        carry(buggies, i, bytes, chunk);
+      }
+
+      for(x = 0; x < SIZE_X; x++){
+        for(y = 0; y < SIZE_Y; y++){
+          entered[x][y] |= buggies[i].report.entered[x][y];
+        }
+      }
+      if(buggies[i].report.knownCells >= SIZE_X * SIZE_Y && buggies[i].mappedUs == NEVER){
+        buggies[i].mappedUs = now;
+      }
+      if(buggies[i].report.state == MAIN_FINISH && buggies[i].finishedUs == NEVER){
+        buggies[i].finishedUs = now;
+      }
+      finished += buggies[i].finishedUs != NEVER;
+    }
+
+    cells = 0;
+    for(x = 0; x < SIZE_X; x++){
+      for(y = 0; y < SIZE_Y; y++){
+        cells += entered[x][y];
+      }
+    }
+    if(cells == SIZE_X * SIZE_Y && *coveredUs == NEVER){
+      *coveredUs = now;
+    }
+
+    stop = finished == buggyCount || now >= seconds * 1000000ULL;
+    deliver(buggies, stop);
+    if(stop){
+      break;
+    }
+  }
+
+  for(i = 0; i < buggyCount; i++){
+    collisions += buggies[i].report.collisions;
+    waitpid(buggies[i].pid, NULL, 0);
+    close(buggies[i].toBuggy);
+    close(buggies[i].fromBuggy);
+    free(buggies[i].pending.bytes);
+  }
+  return collisions == 0;
+}
+
+/**
+  * Print a time in seconds, or "never"
+*/
+static void printTime(const char *label, unsigned long long us){
+  if(us == NEVER){
+    printf("%s   never", label);
+  }else{
+    printf("%s %7.1f", label, us / 1e6);
+  }
+}
+
+/**
+  * The latest of the buggies' times, or NEVER if any never got there
+*/
+static unsigned long long latest(const Buggy buggies[], bool finished){
+  unsigned long long last = 0, us;
+  int i;
+
+  for(i = 0; i < buggyCount; i++){
+    us = finished ? buggies[i].finishedUs : buggies[i].mappedUs;
+    if(us > last){
+      last = us;
+    }
+  }
+  return last;
+}
+
+static unsigned long long earliest(const Buggy buggies[]){
+  unsigned long long first = NEVER;
+  int i;
+
+  for(i = 0; i < buggyCount; i++){
+    if(buggies[i].mappedUs < first){
+      first = buggies[i].mappedUs;
+    }
+  }
+  return first;
+}
+
+int main(int argc, char *argv[]){
+  static Buggy buggies[COOP_MAX];
+  FILE *file;
+  Corpus corpus;
+  long corpusIndex = -1;
+  unsigned long long coveredUs, alone = NEVER;
+  bool sweep = false, clean = true;
+  int opt, i, most;
+
+  while((opt = getopt(argc, argv, "r:sg:b:l:t:n:c:")) != -1){
+    switch(opt){
+      case 'r': buggyCount = atoi(optarg); break;
+      case 's': sweep = true; break;
+      case 'g': gapMs = strtoul(optarg, NULL, 0); break;
+      case 'b': linkRate = strtoul(optarg, NULL, 0); break;
+      case 'l': latencyMs = strtoul(optarg, NULL, 0); break;
+      case 't': seconds = strtoul(optarg, NULL, 0); break;
+      case 'n': simNoiseSeed = strtoul(optarg, NULL, 0); break;
+      case 'c': corpusIndex = strtol(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "Usage: mazecoop [-r buggies] [-s] [-g gap] [-b rate] [-l latency] [-t seconds] [-n seed] [-c index] [maze]\n");
+        return 1;
+    }
+  }
+  if(buggyCount < 1 || buggyCount > COOP_MAX || linkRate < 1 || linkRate > 1000000 || latencyMs < 1){
+    fprintf(stderr, "Need 1 to %d buggies, a rate up to 1000000 bytes/s and at least 1 ms latency\n", COOP_MAX);
+    return 1;
+  }
+
+  if(corpusIndex >= 0 && optind == argc - 1){
+    if(corpusOpen(argv[optind], &corpus) != 0 || corpusLoadSim(&corpus, corpusIndex) != 0){
+      fprintf(stderr, "%s: no %dx%d maze %ld starting at (%d, %d)\n", argv[optind], SIZE_X, SIZE_Y,
+        corpusIndex, START_X, START_Y);
+      return 1;
+    }
+    corpusClose(&corpus);
+  }else if(optind == argc - 1){
+    file = fopen(argv[optind], "r");
+    if(file == NULL){
+      perror(argv[optind]);
+      return 1;
+    }
+    if(simLoadMaze(file) != 0){
+      fprintf(stderr, "%s: not a %dx%d maze\n", argv[optind], SIZE_X, SIZE_Y);
+      return 1;
+    }
+    fclose(file);
+  }else if(optind == argc){
+    simDefaultMaze();
+  }else{
+    fprintf(stderr, "Usage: mazecoop [-r buggies] [-s] [-g gap] [-b rate] [-l latency] [-t seconds] [-n seed] [-c index] [maze]\n");
+    return 1;
+  }
+
+  // A byte sent at the start of a slice can't reach another buggy before the slice ends
+  sliceUs = latencyMs * 2000ULL < 10000 ? latencyMs * 2000ULL : 10000;
+
+  printf("%dx%d maze, buggies %lu ms apart, link %lu bytes/s with %lu ms latency\n",
+    SIZE_X, SIZE_Y, gapMs, linkRate, latencyMs);
+  most = buggyCount;
+  if(sweep){
+    printf("Buggies  covered (s)  first map (s)  all maps (s)  all done (s)  covered vs 1\n");
+  }
+  for(buggyCount = sweep ? 1 : most; buggyCount <= most; buggyCount++){
+    clean &= runCoop(buggies, &coveredUs);
+    if(buggyCount == 1){
+      alone = coveredUs;
+    }
+
+    if(sweep){
+      printf("%7d", buggyCount);
+      printTime("     ", coveredUs);
+      printTime("        ", earliest(buggies));
+      printTime("       ", latest(buggies, false));
+      printTime("       ", latest(buggies, true));
+      if(coveredUs != NEVER && alone != NEVER){
+        printf("        x%.2f", (double)alone / coveredUs);
+      }
+      printf("\n");
+      continue;
+    }
+
+    printTime("Maze covered:    ", coveredUs);
+    printTime(" s\nFirst full map:  ", earliest(buggies));
+    printTime(" s\nAll full maps:   ", latest(buggies, false));
+    printTime(" s\nAll finished:    ", latest(buggies, true));
+    printf(" s\n");
+    for(i = 0; i < buggyCount; i++){
+      printf("Buggy %d: set off at %.1f s, %lu bytes sent, %lu frames shared, %lu collisions", i,
+        (double)i * gapMs / 1000, buggies[i].bytesSent, buggies[i].framesRelayed, buggies[i].report.collisions);
+      printTime(", map complete", buggies[i].mappedUs);
+      printf(" s\n");
+    }
+  }
+
+  return clean ? 0 : 2;
+}
@@ -0,0 +1,390 @@
+/**
+  * Maze corpus generator
+  * Writes a corpus (corpus.h) of random mazes for benchmarking: perfect mazes (a depth first
+  * backtracker), looped mazes (a perfect maze with some walls knocked out) and island mazes
+  * (a perfect maze with one wall cut loose from the rest, which wall following can circle
+  * forever). Mazes are generated in parallel straight into the memory mapped file, each from
+  * its own seed, so the corpus is the same whatever the thread count.
+  *
+  * Usage: mazegen [-n count] [-w width] [-h height] [-k kind] [-l percent] [-s seed] [-j threads] corpus
+  *        mazegen -p index corpus
+  *   -n count    mazes to generate (default 1000)
+  *   -w, -h      maze size in cells (default SIZE_X x SIZE_Y, at most 255)
+  *   -k kind     perfect, looped, island or mixed (default, the three in turn)
+  *   -l percent  share of a perfect maze's inner walls knocked out for looped mazes (default 25)
+  *   -s seed     random seed (default 1)
+  *   -j threads  generator threads (default one per CPU)
+  *   -p index    print a maze from an existing corpus rather than generating
+  *
+  * Build: bin/host/hostcc -o out/host/mazegen src/host/mazegen.c src/host/corpus.c src/host/sim.c src/host/sensors.c -lm -lpthread
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "main.h"
+#include "corpus.h"
+
+static const char *kindNames[CORPUS_KINDS] = {
+  "perfect", "looped", "island",
+};
+
+// What to generate, shared by all threads
+typedef struct{
+  unsigned char *records;
+  int width, height;
+  size_t recordSize;
+  uint32_t count;
+  int kind;
+  int loopPercent;
+  uint64_t seed;
+} GenJob;
+
+// A thread's share of the corpus and its working space
+typedef struct{
+  const GenJob *job;
+  uint32_t first, last;
+  unsigned char *cells;
+  int *stack;
+  uint64_t rng;
+  pthread_t thread;
+} GenWorker;
+
+/**
+  * splitmix64, to turn (seed, maze index) into a well mixed starting state
+*/
+static uint64_t mix(uint64_t x){
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/**
+  * xorshift64*, a random number below limit
+*/
+static uint32_t randomBelow(GenWorker *worker, uint32_t limit){
+  worker->rng ^= worker->rng >> 12;
+  worker->rng ^= worker->rng << 25;
+  worker->rng ^= worker->rng >> 27;
+  return (uint32_t)((worker->rng * 0x2545f4914f6cdd1dULL) >> 32) % limit;
+}
+
+/**
+  * Remove the wall on one side of a cell (working cells hold CORPUS_WALL_N | CORPUS_WALL_E)
+*/
+static void openWall(const GenJob *job, unsigned char *cells, int x, int y, int direction){
+  switch(direction){
+    case DIR_NORTH: cells[x * job->height + y] &= ~CORPUS_WALL_N; break;
+    case DIR_EAST:  cells[x * job->height + y] &= ~CORPUS_WALL_E; break;
+    case DIR_SOUTH: cells[x * job->height + y - 1] &= ~CORPUS_WALL_N; break;
+    case DIR_WEST:  cells[(x - 1) * job->height + y] &= ~CORPUS_WALL_E; break;
+  }
+}
+
+/**
+  * Carve a perfect maze with an iterative depth first backtracker
+*/
+static void carvePerfect(GenWorker *worker){
+  const GenJob *job = worker->job;
+  int cellCount = job->width * job->height;
+  int top = 0, cell, x, y, nx, ny, direction, options, choice;
+  int next[4], nextDirection[4];
+
+  // CORPUS_WALL_N | CORPUS_WALL_E everywhere; bit 2 marks a carved (visited) cell
+  memset(worker->cells, CORPUS_WALL_N | CORPUS_WALL_E, cellCount);
+
+  cell = randomBelow(worker, cellCount);
+  worker->cells[cell] |= 4;
+  worker->stack[top++] = cell;
+
+  while(top > 0){
+    cell = worker->stack[top - 1];
+    x = cell / job->height;
+    y = cell % job->height;
+
+    options = 0;
+    for(direction = DIR_NORTH; direction <= DIR_WEST; direction++){
+      nx = x + (direction == DIR_EAST) - (direction == DIR_WEST);
+      ny = y + (direction == DIR_NORTH) - (direction == DIR_SOUTH);
+      if(nx >= 0 && nx < job->width && ny >= 0 && ny < job->height && !(worker->cells[nx * job->height + ny] & 4)){
+        next[options] = nx * job->height + ny;
+        nextDirection[options++] = direction;
+      }
+    }
+
+    if(options == 0){
+      top--;
+      continue;
+    }
+    choice = randomBelow(worker, options);
+    openWall(job, worker->cells, x, y, nextDirection[choice]);
+    worker->cells[next[choice]] |= 4;
+    worker->stack[top++] = next[choice];
+  }
+
+  for(cell = 0; cell < cellCount; cell++){
+    worker->cells[cell] &= CORPUS_WALL_N | CORPUS_WALL_E;
+  }
+}
+
+/**
+  * Knock out a share of the inner walls left by carvePerfect()
+  * Removing walls only ever joins cells, so the maze stays fully connected
+*/
+static void addLoops(GenWorker *worker){
+  const GenJob *job = worker->job;
+  int x, y, inner = 0, knock;
+
+  // Inner walls are the stored walls that aren't on the outside of the maze
+  for(x = 0; x < job->width; x++){
+    for(y = 0; y < job->height; y++){
+      inner += (y < job->height - 1 && (worker->cells[x * job->height + y] & CORPUS_WALL_N))
+        + (x < job->width - 1 && (worker->cells[x * job->height + y] & CORPUS_WALL_E));
+    }
+  }
+
+  knock = (inner * job->loopPercent + 99) / 100;
+  while(knock > 0 && inner > 0){
+    x = randomBelow(worker, job->width);
+    y = randomBelow(worker, job->height);
+    if(randomBelow(worker, 2) == 0){
+      if(y < job->height - 1 && (worker->cells[x * job->height + y] & CORPUS_WALL_N)){
+        openWall(job, worker->cells, x, y, DIR_NORTH);
+        knock--;
+        inner--;
+      }
+    }else if(x < job->width - 1 && (worker->cells[x * job->height + y] & CORPUS_WALL_E)){
+      openWall(job, worker->cells, x, y, DIR_EAST);
+      knock--;
+      inner--;
+    }
+  }
+}
+
+/**
+  * Remove the walls meeting at a post (the south west corner of cell px, py) that lies inside the maze
+*/
+static void clearPost(const GenJob *job, unsigned char *cells, int px, int py){
+  cells[px * job->height + py - 1] &= ~CORPUS_WALL_N;
+  cells[(px - 1) * job->height + py - 1] &= ~(CORPUS_WALL_N | CORPUS_WALL_E);
+  cells[(px - 1) * job->height + py] &= ~CORPUS_WALL_E;
+}
+
+/**
+  * Cut one wall loose from the rest to make an island. The perfect maze's walls all join
+  * the outside wall without any loops, so clearing the walls at both ends of one inner
+  * wall leaves it free standing without closing anything off.
+  * Returns the cell the island wall is the north or east side of
+*/
+static int addIsland(GenWorker *worker){
+  const GenJob *job = worker->job;
+  int x, y;
+
+  // A wall between two posts inside the maze: north of (x, y) with 1 <= x <= width - 2,
+  // y <= height - 2, or east of (x, y) with x <= width - 2, 1 <= y <= height - 2
+  if(job->width >= 3 && job->height >= 2 && (job->height < 3 || randomBelow(worker, 2) == 0)){
+    x = 1 + randomBelow(worker, job->width - 2);
+    y = randomBelow(worker, job->height - 1);
+    clearPost(job, worker->cells, x, y + 1);
+    clearPost(job, worker->cells, x + 1, y + 1);
+    worker->cells[x * job->height + y] |= CORPUS_WALL_N;
+  }else{
+    x = randomBelow(worker, job->width - 1);
+    y = 1 + randomBelow(worker, job->height - 2);
+    clearPost(job, worker->cells, x + 1, y);
+    clearPost(job, worker->cells, x + 1, y + 1);
+    worker->cells[x * job->height + y] |= CORPUS_WALL_E;
+  }
+  return x * job->height + y;
+}
+
+/**
+  * Generate one maze into its record
+*/
+static void generate(GenWorker *worker, uint32_t index){
+  const GenJob *job = worker->job;
+  CorpusMaze *maze = (CorpusMaze *)(job->records + (size_t)index * job->recordSize);
+  int cellCount = job->width * job->height;
+  int kind = job->kind >= 0 ? job->kind : (int)(index % CORPUS_KINDS);
+  int cell, nest, start;
+
+  worker->rng = mix(job->seed ^ mix(index)) | 1;
+
+  carvePerfect(worker);
+  if(kind == CORPUS_ISLAND && !(job->width >= 3 && job->height >= 2) && !(job->width >= 2 && job->height >= 3)){
+    // Too small for a free standing wall
+    kind = CORPUS_LOOPED;
+  }
+  if(kind == CORPUS_LOOPED){
+    addLoops(worker);
+  }
+
+  maze->startX = START_X < job->width ? START_X : 0;
+  maze->startY = START_Y < job->height ? START_Y : 0;
+  maze->startDirection = DIR_NORTH;
+  start = maze->startX * job->height + maze->startY;
+
+  if(kind == CORPUS_ISLAND){
+    // The nest goes beside the island wall, which wall following from the start never touches
+    nest = addIsland(worker);
+    if(nest == start){
+      nest += worker->cells[nest] & CORPUS_WALL_N ? 1 : job->height;
+    }
+  }else{
+    nest = randomBelow(worker, cellCount - 1);
+    if(nest >= start){
+      nest++;
+    }
+  }
+  maze->nestX = nest / job->height;
+  maze->nestY = nest % job->height;
+  maze->kind = kind;
+  maze->reserved[0] = 0;
+  maze->reserved[1] = 0;
+
+  memset(maze->walls, 0, (cellCount + 3) / 4);
+  for(cell = 0; cell < cellCount; cell++){
+    maze->walls[cell / 4] |= worker->cells[cell] << (cell % 4 * 2);
+  }
+}
+
+static void *generateRange(void *arg){
+  GenWorker *worker = arg;
+  uint32_t i;
+
+  for(i = worker->first; i < worker->last; i++){
+    generate(worker, i);
+  }
+  return NULL;
+}
+
+/**
+  * Print a maze from an existing corpus
+*/
+static int printMaze(const char *path, uint32_t index){
+  Corpus corpus;
+
+  if(corpusOpen(path, &corpus) != 0){
+    fprintf(stderr, "%s: not a maze corpus\n", path);
+    return 1;
+  }
+  if(index >= corpus.header->count){
+    fprintf(stderr, "%s: has %u mazes\n", path, corpus.header->count);
+    corpusClose(&corpus);
+    return 1;
+  }
+  printf("Maze %u of %u, %s, %dx%d\n", index, corpus.header->count,
+    corpusMaze(&corpus, index)->kind < CORPUS_KINDS ? kindNames[corpusMaze(&corpus, index)->kind] : "?",
+    corpus.header->width, corpus.header->height);
+  corpusPrint(stdout, &corpus, index);
+  corpusClose(&corpus);
+  return 0;
+}
+
+int main(int argc, char *argv[]){
+  GenJob job = {0};
+  GenWorker *workers;
+  CorpusHeader header;
+  unsigned char *data;
+  size_t size;
+  long printIndex = -1;
+  int opt, fd, i, threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  job.width = SIZE_X;
+  job.height = SIZE_Y;
+  job.count = 1000;
+  job.kind = -1;
+  job.loopPercent = 25;
+  job.seed = 1;
+
+  while((opt = getopt(argc, argv, "n:w:h:k:l:s:j:p:")) != -1){
+    switch(opt){
+      case 'n': job.count = strtoul(optarg, NULL, 0); break;
+      case 'w': job.width = atoi(optarg); break;
+      case 'h': job.height = atoi(optarg); break;
+      case 'l': job.loopPercent = atoi(optarg); break;
+      case 's': job.seed = strtoull(optarg, NULL, 0); break;
+      case 'j': threads = atoi(optarg); break;
+      case 'p': printIndex = strtol(optarg, NULL, 0); break;
+      case 'k':
+        for(job.kind = CORPUS_KINDS - 1; job.kind >= 0 && strcmp(optarg, kindNames[job.kind]) != 0; job.kind--);
+        if(job.kind < 0 && strcmp(optarg, "mixed") != 0){
+          fprintf(stderr, "Unknown kind %s\n", optarg);
+          return 1;
+        }
+      break;
+      default:
+        fprintf(stderr, "Usage: mazegen [-n count] [-w width] [-h height] [-k kind] [-l percent] [-s seed] [-j threads] corpus\n"
+          "       mazegen -p index corpus\n");
+        return 1;
+    }
+  }
+  if(optind != argc - 1){
+    fprintf(stderr, "Usage: mazegen [options] corpus\n");
+    return 1;
+  }
+  if(printIndex >= 0){
+    return printMaze(argv[optind], printIndex);
+  }
+  if(job.width < 1 || job.width > 255 || job.height < 1 || job.height > 255 || job.width * job.height < 2
+    || job.loopPercent < 0 || job.loopPercent > 100){
+    fprintf(stderr, "Mazes must be 1 to 255 cells a side, with at least 2 cells\n");
+    return 1;
+  }
+  if(threads < 1){
+    threads = 1;
+  }
+
+  // Size the file and map it, so every thread writes its mazes straight into place
+  job.recordSize = corpusRecordSize(job.width, job.height);
+  size = CORPUS_HEADER_LEN + (size_t)job.count * job.recordSize;
+  fd = open(argv[optind], O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0 || ftruncate(fd, size) != 0){
+    perror(argv[optind]);
+    return 1;
+  }
+  data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED){
+    perror(argv[optind]);
+    return 1;
+  }
+
+  memcpy(header.magic, CORPUS_MAGIC, 4);
+  header.version = CORPUS_VERSION;
+  header.width = job.width;
+  header.height = job.height;
+  header.recordSize = job.recordSize;
+  header.count = job.count;
+  header.reserved = 0;
+  memcpy(data, &header, CORPUS_HEADER_LEN);
+  job.records = data + CORPUS_HEADER_LEN;
+
+  workers = calloc(threads, sizeof(GenWorker));
+  for(i = 0; i < threads; i++){
+    workers[i].job = &job;
+    workers[i].first = (uint64_t)job.count * i / threads;
+    workers[i].last = (uint64_t)job.count * (i + 1) / threads;
+    workers[i].cells = malloc(job.width * job.height);
+    workers[i].stack = malloc(job.width * job.height * sizeof(int));
+    pthread_create(&workers[i].thread, NULL, generateRange, &workers[i]);
+  }
+  for(i = 0; i < threads; i++){
+    pthread_join(workers[i].thread, NULL);
+    free(workers[i].cells);
+    free(workers[i].stack);
+  }
+  free(workers);
+
+  munmap(data, size);
+  printf("%u %dx%d mazes (%s) written to %s, %zu bytes\n", job.count, job.width, job.height,
+    job.kind >= 0 ? kindNames[job.kind] : "mixed", argv[optind], size);
+  return 0;
+}
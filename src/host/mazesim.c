@@ -0,0 +1,311 @@
+/**
+  * Maze simulator front end
+  * Runs the maze runner controller against a simulated maze (sim.h) for a fixed time
+  * and reports how it drove: cells covered, stops, collisions, the accelerations the
+  * speed profile commanded, how far from the middle of each cell the buggy stopped and
+  * how many walls of the cells it visited it got wrong.
+  *
+  * Usage: mazesim [-t seconds] [-c index] [-n seed] [-r trace] [-b capture] [-z] [-u] [-v] [maze]
+  *   maze        maze text file (see sim.h), else a built in 4x4 maze
+  *   -c index    run maze index of a maze corpus (see corpus.h) given as maze
+  *   -n seed     add noise to the IR readings, from the given (non-zero) seed (see sensors.h)
+  *   -r trace    record the run's trajectory to a trace file (see trace.h), for traceview
+  *   -b capture  connect the simulated bluetooth link and save all the controller sends over
+  *               it to a capture file, as a terminal would from the robot: with SENSE_LOG,
+  *               replay then reproduces the run from it (uploaded maps are not captured)
+  *   -t seconds  simulated time to run for (default 120)
+  *   -u          upload the maze to the controller over the simulated bluetooth link
+  *               first (see upload.h), so the run skips exploring
+  *   -v          print each state change with the buggy's position
+  *   -z          compress the trace
+  *
+  * Connected (-b or -u), everything the controller sends takes time on the link (SIM_BT_RATE),
+  * sends waiting once SIM_BT_BUFFER bytes are queued, so the debug stream and the sensor log
+  * slow the run as they would on the robot.
+  *
+  * The run ends at MAIN_FINISH, which with ROUTE_PLANNER comes once the buggy has explored
+  * the maze, driven its planned route to the nest and back to the start. The action costs
+  * the planner measured along the way are printed at the end.
+  *
+  * Exits with 2 if the buggy hit a wall, never reached the nest (if the maze has one) or
+  * the commanded acceleration broke the MOTION_ACCEL / MOTION_DECEL limits.
+  *
+  * Build: bin/host/hostcc -o out/host/mazesim src/host/mazesim.c src/host/sim.c src/host/sensors.c src/host/corpus.c src/host/trace.c -lm -lpthread
+  * Compare with the speed profile disabled by adding -DNO_SPEED_PROFILE.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "allcode_api.h"
+#include "host.h"
+#include "main.h"
+#include "sim.h"
+#include "corpus.h"
+#include "planner.h"
+#include "senselog.h"
+#include "btframe.h"
+#include "upload.h"
+#include "trace.h"
+
+// The commanded speed is a whole number of units, so it can change one unit more over a
+// measuring window than the limits allow
+#define ACCEL_STEP      (1000.0 / SIM_ACCEL_WINDOW_MS)
+
+static const char *stateNames[] = {
+  "START", "DETECT", "TURN", "DRIVE", "FINISH",
+};
+
+static const char *actionNames[] = {
+  "run start", "run cell", "turn 90", "turn 180", "settle",
+};
+
+/**
+  * Count the walls of visited cells that the controller's model has wrong
+*/
+static int mapErrors(){
+  int x, y, i, errors = 0;
+
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      for(i = DIR_NORTH; i <= DIR_WEST; i++){
+        if(maze[x][y].visited && maze[x][y].walls[i] != ((simMaze.walls[x][y] & (1 << i)) != 0)){
+          errors++;
+        }
+      }
+    }
+  }
+  return errors;
+}
+
+// Bytes waiting to be received by the controller over bluetooth
+static unsigned char uploadBytes[2 * UPLOAD_MAP_LEN + 8];
+static int uploadCount = 0;
+static int uploadNext = 0;
+
+static void uploadSend(unsigned char byte){
+  if(uploadCount < (int)sizeof(uploadBytes)){
+    uploadBytes[uploadCount++] = byte;
+  }
+}
+
+static unsigned char linkConnected(){
+  return 1;
+}
+
+static unsigned char uploadAvailable(){
+  return uploadNext < uploadCount;
+}
+
+static unsigned char uploadGet(){
+  return uploadBytes[uploadNext++];
+}
+
+static const HostBackend uploadBackend = {
+  .btSend = uploadSend,
+};
+
+// Where the controller's bluetooth output is saved, if anywhere
+static FILE *captureFile = NULL;
+
+/**
+  * Send a byte from the controller over the simulated link, which takes time
+*/
+static void linkSend(unsigned char byte){
+  simSendByte();
+  if(captureFile != NULL){
+    fputc(byte, captureFile);
+  }
+}
+
+/**
+  * Print a state change with the buggy's position (-v)
+*/
+static void printState(int state){
+  printf("%8llu ms %-6s cell (%d, %d) dir %d  buggy at (%.0f, %.0f) mm\n", simTimeUs / 1000,
+    stateNames[state], currentPosX, currentPosY, currentDirection, simRobot.x, simRobot.y);
+}
+
+int main(int argc, char *argv[]){
+  FILE *file;
+  int opt, i;
+  bool verbose = false;
+  bool upload = false;
+  unsigned char map[UPLOAD_MAP_LEN];
+  HostBackend backend = simBackend;
+  Corpus corpus;
+  long corpusIndex = -1;
+  bool failed = false;
+  unsigned long seconds = 120;
+  const char *tracePath = NULL;
+  const char *capturePath = NULL;
+  bool compress = false;
+
+  while((opt = getopt(argc, argv, "t:c:n:r:b:zuv")) != -1){
+    switch(opt){
+      case 't':
+        seconds = strtoul(optarg, NULL, 0);
+      break;
+      case 'c':
+        corpusIndex = strtol(optarg, NULL, 0);
+      break;
+      case 'n':
+        simNoiseSeed = strtoul(optarg, NULL, 0);
+      break;
+      case 'r':
+        tracePath = optarg;
+      break;
+      case 'b':
+        capturePath = optarg;
+      break;
+      case 'z':
+        compress = true;
+      break;
+      case 'u':
+        upload = true;
+      break;
+      case 'v':
+        verbose = true;
+      break;
+      default:
+        fprintf(stderr, "Usage: mazesim [-t seconds] [-c index] [-n seed] [-r trace] [-b capture] [-z] [-u] [-v] [maze]\n");
+        return 1;
+    }
+  }
+
+  if(corpusIndex >= 0 && optind == argc - 1){
+    if(corpusOpen(argv[optind], &corpus) != 0){
+      fprintf(stderr, "%s: not a maze corpus\n", argv[optind]);
+      return 1;
+    }
+    if(corpusLoadSim(&corpus, corpusIndex) != 0){
+      fprintf(stderr, "%s: no %dx%d maze %ld starting at (%d, %d)\n", argv[optind], SIZE_X, SIZE_Y,
+        corpusIndex, START_X, START_Y);
+      return 1;
+    }
+    corpusClose(&corpus);
+  }else if(optind == argc - 1){
+    file = fopen(argv[optind], "r");
+    if(file == NULL){
+      perror(argv[optind]);
+      return 1;
+    }
+    if(simLoadMaze(file) != 0){
+      fprintf(stderr, "%s: not a %dx%d maze\n", argv[optind], SIZE_X, SIZE_Y);
+      return 1;
+    }
+    fclose(file);
+  }else if(optind == argc){
+    simDefaultMaze();
+  }else{
+    fprintf(stderr, "Usage: mazesim [-t seconds] [-c index] [-n seed] [-r trace] [-b capture] [-z] [-u] [-v] [maze]\n");
+    return 1;
+  }
+
+  if(upload){
+    // Frame the map as mapsend would, for the controller to receive whilst starting
+    simModelMaze();
+    hostUse(&uploadBackend);
+    sendFrame(map, encodeMap(map));
+    backend.btConnected = linkConnected;
+    backend.btSend = linkSend;
+    backend.btAvailable = uploadAvailable;
+    backend.btGet = uploadGet;
+  }
+  if(capturePath != NULL){
+    captureFile = fopen(capturePath, "wb");
+    if(captureFile == NULL){
+      perror(capturePath);
+      return 1;
+    }
+    backend.btConnected = linkConnected;
+    backend.btSend = linkSend;
+  }
+  if(verbose){
+    backend.stateChanged = printState;
+  }
+
+  hostUse(&backend);
+  simReset();
+  if(tracePath != NULL){
+    if(traceOpen(tracePath, compress) != 0){
+      perror(tracePath);
+      return 1;
+    }
+    hostUse(traceBackend(&backend));
+  }
+  mainState = MAIN_START;
+
+  while(simTimeUs < seconds * 1000000ULL && mainState != MAIN_FINISH){
+    runMainState();
+    if(tracePath != NULL){
+      traceStep();
+    }
+  }
+
+#ifdef SENSE_LOG
+  // Send the rest of the log, as finish() would on the robot
+  if(capturePath != NULL){
+    flushLog();
+  }
+#endif
+  if(tracePath != NULL && traceClose() != 0){
+    perror(tracePath);
+    failed = true;
+  }
+  if(capturePath != NULL && fclose(captureFile) != 0){
+    perror(capturePath);
+    failed = true;
+  }
+
+#ifdef SPEED_PROFILE
+  printf("Speed profile: cruise %d, accel %d/s, decel %d/s\n", CRUISE_SPEED, MOTION_ACCEL, MOTION_DECEL);
+#else
+  printf("Speed profile: off, speed %d\n", MOTOR_SPEED);
+#endif
+  if(upload){
+    printf("Uploaded map:     %s\n", uploadHasMap ? "accepted" : "rejected");
+  }
+  printf("Simulated time:   %llu ms\n", simTimeUs / 1000);
+  printf("Cells entered:    %lu (%.1f per minute)\n", simStats.cellsEntered,
+    simStats.cellsEntered * 60000000.0 / simTimeUs);
+  printf("All cells seen:   %s", simStats.allVisitedMs ? "" : "never\n");
+  if(simStats.allVisitedMs){
+    printf("%lu ms\n", simStats.allVisitedMs);
+  }
+  printf("Nest reached:     %s", simStats.nestReachedMs ? "" : "never\n");
+  if(simStats.nestReachedMs){
+    printf("%lu ms\n", simStats.nestReachedMs);
+  }
+  printf("Distance:         %.0f mm\n", simStats.distanceMm);
+  printf("Stops:            %lu, off centre by %.1f mm mean, %.1f mm max\n", simStats.stops,
+    simStats.stops ? simStats.stopErrorTotal / simStats.stops : 0.0, simStats.stopErrorMax);
+  printf("Peak speed:       %d\n", simStats.peakSpeed);
+  printf("Max accel/decel:  %.1f / %.1f per s\n", simStats.maxAccel, simStats.maxDecel);
+  printf("Collisions:       %lu\n", simStats.collisions);
+  printf("Map errors:       %d walls\n", mapErrors());
+#ifdef ROUTE_PLANNER
+  printf("Action costs:    ");
+  for(i = 0; i < ACTIONS; i++){
+    printf(" %s %u ms (%u)%s", actionNames[i], actionCost[i], actionSamples[i], i < ACTIONS - 1 ? "," : "\n");
+  }
+#endif
+
+  if(simStats.collisions > 0){
+    printf("FAIL: buggy hit a wall\n");
+    failed = true;
+  }
+  if(simMaze.nestX >= 0 && !simStats.nestReachedMs){
+    printf("FAIL: buggy never reached the nest\n");
+    failed = true;
+  }
+#ifdef SPEED_PROFILE
+  if(simStats.maxAccel > MOTION_ACCEL + ACCEL_STEP || simStats.maxDecel > MOTION_DECEL + ACCEL_STEP){
+    printf("FAIL: acceleration limits exceeded\n");
+    failed = true;
+  }
+#endif
+  return failed ? 2 : 0;
+}
@@ -0,0 +1,147 @@
+/**
+  * Profile viewer
+  * Prints the most recent controller profile (profile.h) found in a capture of the
+  * robot's bluetooth output: min/mean/max time of each timed function, main loop
+  * iteration rate in each state and API call counts, and the route planner's action
+  * cost model (planner.h) and power telemetry (power.h) if they were sent.
+  *
+  * Usage: profview capture
+  * Build: bin/host/hostcc -o out/host/profview src/host/profview.c
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdio.h>
+
+#include "main.h"
+#include "btframe.h"
+#include "senselog.h"
+#include "profile.h"
+#include "planner.h"
+#include "power.h"
+
+static const char *slotNames[PROF_SLOTS] = {
+  "loop START", "loop DETECT", "loop TURN", "loop DRIVE", "loop FINISH",
+  "detect()", "turn()", "drive()", "avoidObstacle()", "newCellEntered()",
+  "drawMaze()", "printDebugStream()",
+};
+
+static const char *kindNames[LOG_STATE + 1] = {
+  "FA_ReadIR", "FA_ReadLine", "FA_ReadLight", "FA_ReadSwitch", "FA_ClockMS",
+  "FA_SetMotors", "FA_Forwards", "FA_Backwards", "FA_Left", "FA_Right",
+  "FA_DelayMillis", "state changes",
+};
+
+static const char *actionNames[ACTIONS] = {
+  "run start", "run cell", "turn 90", "turn 180", "settle",
+};
+
+static unsigned long get32(const unsigned char *p){
+  return p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+int main(int argc, char *argv[]){
+  FrameParser parser;
+  FILE *capture;
+  ProfileStat stats[PROF_SLOTS] = {{0}};
+  unsigned long calls[LOG_STATE + 1] = {0};
+  unsigned long delayMs = 0;
+  unsigned int cells = 0;
+  int cyclesPerUs = PROFILE_CYCLES_PER_US;
+  int c, length, slot, kinds, i;
+  int reports = 0;
+  unsigned int costs[ACTIONS], samples[ACTIONS];
+  int actions = 0;
+  int powerReports = 0;
+  double us;
+
+  if(argc != 2){
+    fprintf(stderr, "Usage: profview capture\n");
+    return 1;
+  }
+  capture = fopen(argv[1], "rb");
+  if(capture == NULL){
+    perror(argv[1]);
+    return 1;
+  }
+
+  // Later frames replace earlier ones, leaving the latest report
+  resetFrameParser(&parser);
+  while((c = fgetc(capture)) != EOF){
+    length = parseFrameByte(&parser, c);
+    if(length == 24 && parser.body[0] == FRAME_PROFILE && parser.body[1] < PROF_SLOTS){
+      slot = parser.body[1];
+      cyclesPerUs = parser.body[2] | (parser.body[3] << 8);
+      stats[slot].count = get32(&parser.body[4]);
+      stats[slot].min = get32(&parser.body[8]);
+      stats[slot].max = get32(&parser.body[12]);
+      stats[slot].total = get32(&parser.body[16]) | ((unsigned long long)get32(&parser.body[20]) << 32);
+    }else if(length >= 8 && parser.body[0] == FRAME_COUNTS){
+      delayMs = get32(&parser.body[1]);
+      cells = parser.body[5] | (parser.body[6] << 8);
+      kinds = parser.body[7];
+      for(i = 0; i < kinds && i <= LOG_STATE && 8 + i * 4 + 4 <= length; i++){
+        calls[i] = get32(&parser.body[8 + i * 4]);
+      }
+      reports++;
+    }else if(length >= 2 && parser.body[0] == FRAME_COSTS){
+      actions = parser.body[1] < ACTIONS ? parser.body[1] : ACTIONS;
+      for(i = 0; i < actions && 2 + i * 4 + 4 <= length; i++){
+        costs[i] = parser.body[2 + i * 4] | (parser.body[3 + i * 4] << 8);
+        samples[i] = parser.body[4 + i * 4] | (parser.body[5 + i * 4] << 8);
+      }
+      actions = i;
+    }else if(length == 17 && parser.body[0] == FRAME_POWER){
+      // Each covers the time since the one before: the run, then periods whilst finished
+      if(powerReports++ == 0){
+        printf("Power\n  %-18s %10s %10s %10s %10s\n", "period ms", "idle %", "LED ms", "battery", "est. mA");
+      }
+      printf("  %-18lu %10.1f %10lu %10u %10.1f\n", get32(&parser.body[1]),
+        get32(&parser.body[1]) ? 100.0 * get32(&parser.body[5]) / get32(&parser.body[1]) : 0.0,
+        get32(&parser.body[9]), parser.body[13] | (parser.body[14] << 8),
+        (parser.body[15] | (parser.body[16] << 8)) / 10.0);
+    }
+  }
+  fclose(capture);
+
+  if(reports == 0){
+    fprintf(stderr, "No profile found in %s\n", argv[1]);
+    return 1;
+  }
+  if(powerReports > 0){
+    printf("\n");
+  }
+
+  printf("%-20s %10s %12s %12s %12s %10s\n", "slot", "count", "min us", "mean us", "max us", "total ms");
+  for(i = 0; i < PROF_SLOTS; i++){
+    if(stats[i].count == 0){
+      continue;
+    }
+    printf("%-20s %10lu %12.1f %12.1f %12.1f %10.1f\n", slotNames[i], stats[i].count,
+      (double)stats[i].min / cyclesPerUs,
+      (double)stats[i].total / stats[i].count / cyclesPerUs,
+      (double)stats[i].max / cyclesPerUs,
+      (double)stats[i].total / cyclesPerUs / 1000);
+  }
+
+  printf("\nMain loop rate\n");
+  for(i = PROF_LOOP_START; i <= PROF_LOOP_FINISH; i++){
+    if(stats[i].total == 0){
+      continue;
+    }
+    us = (double)stats[i].total / cyclesPerUs;
+    printf("  %-18s %10.1f iterations/s\n", slotNames[i], stats[i].count / (us / 1e6));
+  }
+
+  printf("\nCells entered %u, time in FA_DelayMillis %lu ms\n", cells, delayMs);
+  for(i = 0; i <= LOG_STATE; i++){
+    printf("  %-18s %10lu\n", kindNames[i], calls[i]);
+  }
+
+  if(actions > 0){
+    printf("\nRoute planner action costs\n");
+    for(i = 0; i < actions; i++){
+      printf("  %-18s %7u ms %8u samples\n", actionNames[i], costs[i], samples[i]);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,427 @@
+/**
+  * Sensor log replayer
+  * Feeds a run recorded by the controller's sensor log (senselog.h) back through
+  * the same state machine in main.c, so that a run on the table can be reproduced
+  * and stepped on a PC. Every API call the controller makes must match the next
+  * recorded entry; the first mismatch is reported as a divergence.
+  *
+  * Usage: replay [-s] [-v] [-r run] capture
+  *   capture  raw bytes received from the robot over bluetooth (debug text is skipped)
+  *   -s       stop after every state change until Enter is pressed
+  *   -v       print every log entry as it is replayed
+  *   -r run   replay the given run (1 = first) rather than the last one
+  *
+  * Exit status: 0 once the log has been replayed (to the end of the run, or of a capture
+  * that stops early), 1 on a bad command line or capture, 2 on a divergence and 3 where
+  * the robot dropped entries (a LOG_GAP entry), as nothing after them can be replayed.
+  *
+  * Build: bin/host/hostcc -DNO_SENSE_LOG -o out/host/replay src/host/replay.c
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+#include "allcode_api.h"
+#include "host.h"
+#include "main.h"
+#include "btframe.h"
+#include "senselog.h"
+
+// A decoded log entry with its time unwrapped to 32 bits
+typedef struct{
+  unsigned long time;
+  LogEntry entry;
+} ReplayEntry;
+
+static const char *kindNames[] = {
+  "IR", "LINE", "LIGHT", "SWITCH", "CLOCK", "MOTORS", "FORWARDS",
+  "BACKWARDS", "LEFT", "RIGHT", "DELAY", "STATE", "GAP",
+};
+
+static const char *stateNames[] = {
+  "START", "DETECT", "TURN", "DRIVE", "FINISH",
+};
+
+static ReplayEntry *entries;
+static int entryCount;
+static int cursor;
+static bool stepMode;
+static bool verbose;
+// Set once the run's MAIN_FINISH entry has been replayed; later calls were not recorded
+static bool finished;
+static jmp_buf stopReplay;
+
+/**
+  * Unpack a log frame's entries (packed as senselog.h describes), returning how many
+  * there are, or -1 if the frame is malformed
+*/
+static int unpackFrame(const unsigned char *body, int length, LogEntry *unpacked){
+  int count = body[3];
+  int at = 4, i;
+  unsigned int time = 0;
+  LogEntry *entry;
+
+  for(i = 0; i < count; i++){
+    if(at >= length){
+      return -1;
+    }
+    entry = &unpacked[i];
+    entry->kind = body[at] >> 4;
+    entry->channel = 0;
+    if((body[at] & 0x0f) == LOG_TIME_ABS){
+      if(at + 3 > length){
+        return -1;
+      }
+      time = body[at + 1] | (body[at + 2] << 8);
+      at += 3;
+    }else if(i == 0){
+      return -1;
+    }else{
+      time = (time + (body[at] & 0x0f)) & 0xffff;
+      at++;
+    }
+    entry->time = time;
+
+    switch(entry->kind){
+      case LOG_CLOCK:
+        entry->value = time;
+      break;
+      case LOG_IR:
+      case LOG_LINE:
+      case LOG_LIGHT:
+      case LOG_SWITCH:
+        if(at + 2 > length){
+          return -1;
+        }
+        entry->value = body[at] | ((body[at + 1] & 0x0f) << 8);
+        entry->channel = body[at + 1] >> 4;
+        at += 2;
+      break;
+      case LOG_MOTORS:
+        if(at + 2 > length){
+          return -1;
+        }
+        entry->channel = body[at];
+        entry->value = body[at + 1];
+        at += 2;
+      break;
+      default:
+        if(at + 2 > length || entry->kind > LOG_GAP){
+          return -1;
+        }
+        entry->value = (short)(body[at] | (body[at + 1] << 8));
+        at += 2;
+      break;
+    }
+  }
+  return at == length ? count : -1;
+}
+
+/**
+  * Load one run from a bluetooth capture, returning the number of runs found
+*/
+static int loadRun(FILE *capture, int wantedRun){
+  FrameParser parser;
+  LogEntry unpacked[LOG_FRAME_ENTRIES];
+  int c, length, count, i;
+  unsigned int first, expected = 0;
+  unsigned long time = 0;
+  unsigned int lastTime = 0;
+  int run = 0;
+  bool gap = false;
+  int capacity = 1024;
+
+  entries = malloc(capacity * sizeof(ReplayEntry));
+  resetFrameParser(&parser);
+
+  while((c = fgetc(capture)) != EOF){
+    length = parseFrameByte(&parser, c);
+    if(length < 4 || parser.body[0] != FRAME_LOG){
+      continue;
+    }
+
+    first = parser.body[1] | (parser.body[2] << 8);
+    if(parser.body[3] > LOG_FRAME_ENTRIES){
+      continue;
+    }
+    count = unpackFrame(parser.body, length, unpacked);
+    if(count < 0){
+      continue;
+    }
+
+    // Entry numbering restarts at 0 with each run, and wraps to 0 every 65536 entries
+    // within one, which a run that went on from the frame before must be
+    if(first == 0 && (run == 0 || expected != 0)){
+      run++;
+      gap = false;
+      expected = 0;
+      if(wantedRun == 0 || run == wantedRun){
+        entryCount = 0;
+      }
+    }
+    if(run == 0 || (wantedRun != 0 && run != wantedRun) || gap){
+      continue;
+    }
+    if(first != expected){
+      fprintf(stderr, "run %d: entries %u-%u missing, replay stops there\n", run, expected, first - 1);
+      gap = true;
+      continue;
+    }
+
+    for(i = 0; i < count; i++){
+      if(entryCount == capacity){
+        capacity *= 2;
+        entries = realloc(entries, capacity * sizeof(ReplayEntry));
+      }
+      ReplayEntry *e = &entries[entryCount++];
+      e->entry = unpacked[i];
+
+      // Unwrap the 16 bit timestamps
+      if(entryCount == 1){
+        time = e->entry.time;
+      }else{
+        time += (e->entry.time - lastTime) & 0xffff;
+      }
+      lastTime = e->entry.time;
+      e->time = time;
+    }
+    expected = (first + count) & 0xffff;
+  }
+
+  return run;
+}
+
+static void printEntry(int index, const ReplayEntry *e){
+  const char *kind = e->entry.kind <= LOG_GAP ? kindNames[e->entry.kind] : "?";
+
+  if(e->entry.kind == LOG_STATE){
+    printf("%8lu ms #%-6d STATE -> %s  pos (%d, %d) dir %d  visited %d\n", e->time, index,
+      e->entry.value <= MAIN_FINISH ? stateNames[e->entry.value] : "?",
+      currentPosX, currentPosY, currentDirection, noVisitedCells);
+  }else{
+    printf("%8lu ms #%-6d %-9s ch %-3d %d\n", e->time, index, kind, e->entry.channel, e->entry.value);
+  }
+}
+
+/**
+  * Take the next recorded entry, which must be of the given kind
+  * State change markers are checked against the controller's state on the way past
+*/
+static ReplayEntry *take(LogKind kind){
+  ReplayEntry *e;
+  int c;
+
+  while(1){
+    if(cursor >= entryCount){
+      printf("End of log after %d entries, state %s\n", cursor, stateNames[mainState]);
+      longjmp(stopReplay, 1);
+    }
+
+    e = &entries[cursor++];
+    hostClockMs = e->time;
+    if(verbose || (stepMode && e->entry.kind == LOG_STATE)){
+      printEntry(cursor - 1, e);
+    }
+    if(e->entry.kind == LOG_GAP){
+      printf("Log has a gap at entry #%d: %d%s entries dropped on the robot, replay stops there\n",
+        cursor - 1, e->entry.value, e->entry.value == LOG_GAP_MAX ? " or more" : "");
+      longjmp(stopReplay, 3);
+    }
+    if(e->entry.kind != LOG_STATE){
+      break;
+    }
+
+    if(e->entry.value != (int)mainState){
+      printf("DIVERGED at entry #%d: log changes state to %s, controller is in %s\n",
+        cursor - 1, stateNames[e->entry.value % 5], stateNames[mainState]);
+      longjmp(stopReplay, 2);
+    }
+    if(e->entry.value == MAIN_FINISH){
+      finished = true;
+      return NULL;
+    }
+    if(stepMode){
+      printf("  [Enter to continue] ");
+      fflush(stdout);
+      while((c = getchar()) != '\n' && c != EOF);
+    }
+  }
+
+  if(e->entry.kind != kind){
+    printf("DIVERGED at entry #%d: log has %s, controller called %s\n",
+      cursor - 1, e->entry.kind <= LOG_GAP ? kindNames[e->entry.kind] : "?", kindNames[kind]);
+    longjmp(stopReplay, 2);
+  }
+  return e;
+}
+
+/**
+  * Take the next entry for a sensor read on the given channel
+*/
+static int takeRead(LogKind kind, unsigned char channel){
+  ReplayEntry *e;
+
+  if(finished){
+    return 0;
+  }
+
+  e = take(kind);
+  if(e == NULL){
+    return 0;
+  }
+  if(e->entry.channel != channel){
+    printf("DIVERGED at entry #%d: log reads %s channel %d, controller read channel %d\n",
+      cursor - 1, kindNames[kind], e->entry.channel, channel);
+    longjmp(stopReplay, 2);
+  }
+  return e->entry.value;
+}
+
+/**
+  * Take the next entry for a command, which must have the same arguments
+*/
+static void takeCommand(LogKind kind, unsigned char channel, int value){
+  ReplayEntry *e;
+
+  if(finished){
+    return;
+  }
+
+  e = take(kind);
+  if(e == NULL){
+    return;
+  }
+  if(e->entry.channel != channel || e->entry.value != value){
+    printf("DIVERGED at entry #%d: log has %s %d %d, controller sent %s %d %d\n",
+      cursor - 1, kindNames[kind], e->entry.channel, e->entry.value,
+      kindNames[kind], channel, value);
+    longjmp(stopReplay, 2);
+  }
+}
+
+static unsigned int replayIR(unsigned char channel){
+  return takeRead(LOG_IR, channel);
+}
+
+static unsigned int replayLine(unsigned char channel){
+  return takeRead(LOG_LINE, channel);
+}
+
+static unsigned int replayLight(){
+  return takeRead(LOG_LIGHT, 0);
+}
+
+static unsigned char replaySwitch(unsigned char sw){
+  return takeRead(LOG_SWITCH, sw);
+}
+
+static unsigned long replayClock(){
+  ReplayEntry *e;
+
+  if(finished){
+    return hostClockMs;
+  }
+  // A clock read was logged as its own timestamp, which loadRun() has unwrapped
+  e = take(LOG_CLOCK);
+  return e != NULL ? e->time : hostClockMs;
+}
+
+static void replayMotors(unsigned char left, unsigned char right){
+  takeCommand(LOG_MOTORS, left, right);
+}
+
+static void replayForwards(unsigned int distance){
+  takeCommand(LOG_FORWARDS, 0, distance);
+}
+
+static void replayBackwards(unsigned int distance){
+  takeCommand(LOG_BACKWARDS, 0, distance);
+}
+
+static void replayLeft(unsigned int angle){
+  takeCommand(LOG_LEFT, 0, angle);
+}
+
+static void replayRight(unsigned int angle){
+  takeCommand(LOG_RIGHT, 0, angle);
+}
+
+static void replayDelay(unsigned int ms){
+  takeCommand(LOG_DELAY, 0, ms);
+}
+
+static const HostBackend replayBackend = {
+  .readIR = replayIR,
+  .readLine = replayLine,
+  .readLight = replayLight,
+  .readSwitch = replaySwitch,
+  .setMotors = replayMotors,
+  .forwards = replayForwards,
+  .backwards = replayBackwards,
+  .left = replayLeft,
+  .right = replayRight,
+  .delay = replayDelay,
+  .clock = replayClock,
+};
+
+int main(int argc, char *argv[]){
+  FILE *capture;
+  int opt, runs, result;
+  int wantedRun = 0;
+  // Kept over the longjmp() out of a divergence
+  static unsigned long iterations = 0;
+
+  while((opt = getopt(argc, argv, "svr:")) != -1){
+    switch(opt){
+      case 's':
+        stepMode = true;
+      break;
+      case 'v':
+        verbose = true;
+      break;
+      case 'r':
+        wantedRun = atoi(optarg);
+      break;
+      default:
+        fprintf(stderr, "Usage: replay [-s] [-v] [-r run] capture\n");
+        return 1;
+    }
+  }
+  if(optind != argc - 1){
+    fprintf(stderr, "Usage: replay [-s] [-v] [-r run] capture\n");
+    return 1;
+  }
+
+  capture = fopen(argv[optind], "rb");
+  if(capture == NULL){
+    perror(argv[optind]);
+    return 1;
+  }
+  runs = loadRun(capture, wantedRun);
+  fclose(capture);
+  if(runs == 0 || entryCount == 0){
+    fprintf(stderr, "No sensor log found in %s\n", argv[optind]);
+    return 1;
+  }
+  printf("Replaying run %d of %d: %d entries, %lu ms\n", wantedRun ? wantedRun : runs, runs,
+    entryCount, entries[entryCount - 1].time - entries[0].time);
+
+  hostUse(&replayBackend);
+  mainState = MAIN_START;
+  result = setjmp(stopReplay);
+  if(result == 0){
+    while(!finished){
+      runMainState();
+      iterations++;
+    }
+    printf("Run finished after %d entries\n", cursor);
+  }
+
+  printf("Main loop iterations: %lu, cells visited: %d, final position (%d, %d)\n",
+    iterations, noVisitedCells, currentPosX, currentPosY);
+  return result >= 2 ? result : 0;
+}
@@ -0,0 +1,187 @@
+/**
+  * Sensor model benchmark
+  * Scatters a batch of buggies over a maze at random poses, checks that the AVX2 and
+  * scalar sensor kernels (sensors.h) give identical readings, with and without noise,
+  * then times each and reports sensor reads per second. A read is one IR, line or light
+  * sensor of one buggy, so each buggy is 11 reads per update.
+  *
+  * Usage: sensorbench [-n buggies] [-r rounds] [-s seed] [-c index] [maze]
+  *   maze        maze text file (see sim.h), else mazesim's built in 4x4 maze
+  *   -c index    use maze index of a maze corpus (see corpus.h) given as maze
+  *   -n buggies  buggies in the batch (default 4096)
+  *   -r rounds   updates of the whole batch to time (default 200)
+  *   -s seed     seed for the poses and the noise (default 1)
+  *
+  * Exits with 2 if the kernels disagree.
+  *
+  * Build: bin/host/hostcc -o out/host/sensorbench src/host/sensorbench.c src/host/sensors.c src/host/sim.c src/host/corpus.c -lm
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "sim.h"
+#include "corpus.h"
+#include "sensors.h"
+
+#define PI 3.14159265358979
+
+// Reads per buggy per update: every IR channel, both line sensors and the light sensor
+#define READS_PER_BUGGY   (SENSOR_IR_CHANNELS + 2 + 1)
+
+typedef void (*UpdateFunction)(SensorBatch *batch, const SensorWalls *walls);
+
+static double seconds(){
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+  * Place every buggy of a batch at a random pose inside the maze
+*/
+static void scatter(SensorBatch *batch, uint32_t seed){
+  int i;
+
+  srand(seed);
+  for(i = 0; i < batch->capacity; i++){
+    batch->x[i] = (float)rand() / RAND_MAX * SIZE_X * SIM_CELL_MM;
+    batch->y[i] = (float)rand() / RAND_MAX * SIZE_Y * SIM_CELL_MM;
+    batch->heading[i] = (float)rand() / RAND_MAX * 2 * PI;
+  }
+}
+
+/**
+  * Update two identical batches, one with each kernel, and count the readings that differ
+*/
+static long compare(const SensorWalls *walls, int count, bool noisy, uint32_t seed){
+  SensorBatch scalar, vector;
+  long differences = 0;
+  int i, round;
+
+  if(sensorBatchInit(&scalar, count, noisy, seed) != 0 || sensorBatchInit(&vector, count, noisy, seed) != 0){
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  scatter(&scalar, seed);
+  scatter(&vector, seed);
+
+  // A few rounds, so the noise generators are compared as they advance
+  for(round = 0; round < 4; round++){
+    sensorBatchUpdateScalar(&scalar, walls);
+    sensorBatchUpdate(&vector, walls);
+    for(i = 0; i < scalar.count; i++){
+      differences += scalar.light[i] != vector.light[i];
+      differences += scalar.line[i] != vector.line[i] || scalar.line[scalar.capacity + i] != vector.line[vector.capacity + i];
+      differences += scalar.noise[i] != vector.noise[i];
+    }
+    for(i = 0; i < SENSOR_IR_CHANNELS * scalar.capacity; i++){
+      if(i % scalar.capacity < scalar.count){
+        differences += scalar.ir[i] != vector.ir[i];
+      }
+    }
+  }
+
+  sensorBatchFree(&scalar);
+  sensorBatchFree(&vector);
+  return differences;
+}
+
+/**
+  * Time a kernel over a batch, returning reads per second
+*/
+static double timeUpdate(UpdateFunction update, const SensorWalls *walls, int count, int rounds, bool noisy, uint32_t seed){
+  SensorBatch batch;
+  double start, elapsed;
+  int round;
+
+  if(sensorBatchInit(&batch, count, noisy, seed) != 0){
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  scatter(&batch, seed);
+
+  update(&batch, walls);
+  start = seconds();
+  for(round = 0; round < rounds; round++){
+    update(&batch, walls);
+  }
+  elapsed = seconds() - start;
+
+  sensorBatchFree(&batch);
+  return (double)count * READS_PER_BUGGY * rounds / elapsed;
+}
+
+int main(int argc, char *argv[]){
+  static SensorWalls walls;
+  FILE *file;
+  Corpus corpus;
+  long corpusIndex = -1;
+  long differences;
+  int opt, count = 4096, rounds = 200;
+  uint32_t seed = 1;
+  double scalarRate, vectorRate;
+  bool noisy;
+
+  while((opt = getopt(argc, argv, "n:r:s:c:")) != -1){
+    switch(opt){
+      case 'n': count = atoi(optarg); break;
+      case 'r': rounds = atoi(optarg); break;
+      case 's': seed = strtoul(optarg, NULL, 0); break;
+      case 'c': corpusIndex = strtol(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "Usage: sensorbench [-n buggies] [-r rounds] [-s seed] [-c index] [maze]\n");
+        return 1;
+    }
+  }
+  if(count < 1 || rounds < 1){
+    fprintf(stderr, "Need at least one buggy and one round\n");
+    return 1;
+  }
+
+  if(corpusIndex >= 0 && optind == argc - 1){
+    if(corpusOpen(argv[optind], &corpus) != 0 || corpusLoadSim(&corpus, corpusIndex) != 0){
+      fprintf(stderr, "%s: no %dx%d maze %ld\n", argv[optind], SIZE_X, SIZE_Y, corpusIndex);
+      return 1;
+    }
+    corpusClose(&corpus);
+  }else if(optind == argc - 1){
+    file = fopen(argv[optind], "r");
+    if(file == NULL){
+      perror(argv[optind]);
+      return 1;
+    }
+    if(simLoadMaze(file) != 0){
+      fprintf(stderr, "%s: not a %dx%d maze\n", argv[optind], SIZE_X, SIZE_Y);
+      return 1;
+    }
+    fclose(file);
+  }else if(optind == argc){
+    simDefaultMaze();
+  }else{
+    fprintf(stderr, "Usage: sensorbench [-n buggies] [-r rounds] [-s seed] [-c index] [maze]\n");
+    return 1;
+  }
+  sensorWalls(&walls, &simMaze);
+
+  printf("%d buggies, %d wall segments, AVX2 %s\n", count, walls.horizontalCount + walls.verticalCount,
+    sensorHaveAVX2() ? "available" : "not available");
+  for(noisy = false; ; noisy = true){
+    differences = compare(&walls, count, noisy, seed);
+    scalarRate = timeUpdate(sensorBatchUpdateScalar, &walls, count, rounds, noisy, seed);
+    vectorRate = timeUpdate(sensorBatchUpdate, &walls, count, rounds, noisy, seed);
+    printf("%-10s scalar %7.1f M reads/s   batched %7.1f M reads/s   x%.1f   %ld differences\n",
+      noisy ? "Noisy:" : "Noiseless:", scalarRate / 1e6, vectorRate / 1e6, vectorRate / scalarRate, differences);
+    if(differences != 0){
+      return 2;
+    }
+    if(noisy){
+      break;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,374 @@
+/**
+  * Batched sensor model for the simulator (see sensors.h)
+  * The AVX2 kernels do the same float operations in the same order as the scalar code,
+  * so both give identical readings; sensorbench checks that they do.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SENSOR_X86
+#endif
+
+#include "allcode_api.h"
+#include "sensors.h"
+
+// sin and cos of each IR channel's angle from the buggy's heading: IR_LEFT round to
+// IR_REAR_LEFT are spaced 45 degrees apart starting 90 degrees to the left
+#define ROOT_HALF 0.70710678f
+static const float channelSin[SENSOR_IR_CHANNELS] = {-1, -ROOT_HALF, 0, ROOT_HALF, 1, ROOT_HALF, 0, -ROOT_HALF};
+static const float channelCos[SENSOR_IR_CHANNELS] = {0, ROOT_HALF, 1, ROOT_HALF, 0, -ROOT_HALF, -1, -ROOT_HALF};
+
+/**
+  * Collect a maze's walls as segments, each once
+*/
+void sensorWalls(SensorWalls *walls, const SimMaze *maze){
+  int x, y;
+
+  walls->horizontalCount = 0;
+  walls->verticalCount = 0;
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      // Every wall is the north or east wall of a cell, or on the south or west edge
+      if(maze->walls[x][y] & SIM_WALL_N){
+        walls->hy[walls->horizontalCount] = (y + 1) * SIM_CELL_MM;
+        walls->hx0[walls->horizontalCount] = x * SIM_CELL_MM;
+        walls->hx1[walls->horizontalCount++] = (x + 1) * SIM_CELL_MM;
+      }
+      if(y == 0 && (maze->walls[x][y] & SIM_WALL_S)){
+        walls->hy[walls->horizontalCount] = 0;
+        walls->hx0[walls->horizontalCount] = x * SIM_CELL_MM;
+        walls->hx1[walls->horizontalCount++] = (x + 1) * SIM_CELL_MM;
+      }
+      if(maze->walls[x][y] & SIM_WALL_E){
+        walls->vx[walls->verticalCount] = (x + 1) * SIM_CELL_MM;
+        walls->vy0[walls->verticalCount] = y * SIM_CELL_MM;
+        walls->vy1[walls->verticalCount++] = (y + 1) * SIM_CELL_MM;
+      }
+      if(x == 0 && (maze->walls[x][y] & SIM_WALL_W)){
+        walls->vx[walls->verticalCount] = 0;
+        walls->vy0[walls->verticalCount] = y * SIM_CELL_MM;
+        walls->vy1[walls->verticalCount++] = (y + 1) * SIM_CELL_MM;
+      }
+    }
+  }
+  walls->nestX = maze->nestX;
+  walls->nestY = maze->nestY;
+}
+
+/**
+  * Distance along a ray from (px, py) in direction (dx, dy) to the nearest wall,
+  * or SENSOR_IR_RANGE_MM if none is nearer
+*/
+float sensorRay(const SensorWalls *walls, float px, float py, float dx, float dy){
+  float nearest = SENSOR_IR_RANGE_MM;
+  float inverse, t, hit;
+  int i;
+
+  // A ray parallel to a wall gets an infinite or undefined t, which never compares as nearer
+  inverse = 1.0f / dy;
+  for(i = 0; i < walls->horizontalCount; i++){
+    t = (walls->hy[i] - py) * inverse;
+    hit = px + t * dx;
+    if(t >= 0 && t < nearest && hit >= walls->hx0[i] && hit <= walls->hx1[i]){
+      nearest = t;
+    }
+  }
+  inverse = 1.0f / dx;
+  for(i = 0; i < walls->verticalCount; i++){
+    t = (walls->vx[i] - px) * inverse;
+    hit = py + t * dy;
+    if(t >= 0 && t < nearest && hit >= walls->vy0[i] && hit <= walls->vy1[i]){
+      nearest = t;
+    }
+  }
+  return nearest;
+}
+
+/**
+  * xorshift32, as a float in [0, 1)
+*/
+static float noiseUniform(uint32_t *state){
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+/**
+  * The IR reading for a wall at a distance, with noise if a generator is given
+*/
+unsigned int sensorIR(float distance, uint32_t *noise){
+  float normal;
+
+  if(distance >= SENSOR_IR_RANGE_MM){
+    return 0;
+  }
+  if(noise != 0){
+    // The sum of four uniforms, scaled to unit variance
+    normal = noiseUniform(noise) + noiseUniform(noise);
+    normal += noiseUniform(noise) + noiseUniform(noise);
+    distance *= 1.0f + SENSOR_IR_NOISE * ((normal - 2.0f) * 1.7320508f);
+  }
+  if(distance < SENSOR_IR_SCALE / 1023){
+    return 1023;
+  }
+  return (unsigned int)(SENSOR_IR_SCALE / distance);
+}
+
+/**
+  * One IR channel's reading for a buggy
+*/
+unsigned int sensorIRAt(const SensorWalls *walls, float x, float y, float heading, int channel, uint32_t *noise){
+  float sh = sinf(heading), ch = cosf(heading);
+  float sa = sh * channelCos[channel] + ch * channelSin[channel];
+  float ca = ch * channelCos[channel] - sh * channelSin[channel];
+
+  return sensorIR(sensorRay(walls, x + SIM_IR_RADIUS_MM * sa, y + SIM_IR_RADIUS_MM * ca, sa, ca), noise);
+}
+
+/**
+  * A line sensor's reading: lines are marked along every cell boundary
+*/
+unsigned int sensorLine(float x, float y, float heading, int channel){
+  float side = channel == CHANNEL_LEFT ? -SIM_LINE_SIDE_MM : SIM_LINE_SIDE_MM;
+  float sh = sinf(heading), ch = cosf(heading);
+  float px = x - SIM_LINE_BEHIND_MM * sh + side * ch;
+  float py = y - SIM_LINE_BEHIND_MM * ch - side * sh;
+  float fx = px - floorf(px / SIM_CELL_MM) * SIM_CELL_MM;
+  float fy = py - floorf(py / SIM_CELL_MM) * SIM_CELL_MM;
+
+  if(fx < SIM_LINE_WIDTH_MM / 2.0f || fx > SIM_CELL_MM - SIM_LINE_WIDTH_MM / 2.0f
+    || fy < SIM_LINE_WIDTH_MM / 2.0f || fy > SIM_CELL_MM - SIM_LINE_WIDTH_MM / 2.0f){
+    return SENSOR_LINE_ON;
+  }
+  return SENSOR_LINE_OFF;
+}
+
+/**
+  * The light sensor's reading, which is dark only in the nest
+*/
+unsigned int sensorLight(const SensorWalls *walls, float x, float y){
+  return (int)floorf(x / SIM_CELL_MM) == walls->nestX && (int)floorf(y / SIM_CELL_MM) == walls->nestY
+    ? SENSOR_LIGHT_NEST : SENSOR_LIGHT_OFF;
+}
+
+/**
+  * Allocate a batch of buggies, all at the origin facing north. Returns 0 on success
+*/
+int sensorBatchInit(SensorBatch *batch, int count, bool noisy, uint32_t seed){
+  int i, capacity = (count + SENSOR_LANES - 1) / SENSOR_LANES * SENSOR_LANES;
+  size_t floats = capacity * sizeof(float);
+
+  memset(batch, 0, sizeof(*batch));
+  batch->count = count;
+  batch->capacity = capacity;
+  batch->noisy = noisy;
+  batch->x = aligned_alloc(32, floats);
+  batch->y = aligned_alloc(32, floats);
+  batch->heading = aligned_alloc(32, floats);
+  batch->noise = aligned_alloc(32, capacity * sizeof(uint32_t));
+  batch->ir = aligned_alloc(32, capacity * SENSOR_IR_CHANNELS * sizeof(uint16_t));
+  batch->line = aligned_alloc(32, capacity * 2 * sizeof(uint16_t));
+  batch->light = aligned_alloc(32, (capacity * sizeof(uint16_t) + 31) / 32 * 32);
+  if(!batch->x || !batch->y || !batch->heading || !batch->noise || !batch->ir || !batch->line || !batch->light){
+    sensorBatchFree(batch);
+    return -1;
+  }
+
+  for(i = 0; i < capacity; i++){
+    batch->x[i] = 0;
+    batch->y[i] = 0;
+    batch->heading[i] = 0;
+    // Each buggy's generator starts from its own non-zero state
+    batch->noise[i] = (seed + i) * 2654435761U | 1;
+  }
+  return 0;
+}
+
+void sensorBatchFree(SensorBatch *batch){
+  free(batch->x);
+  free(batch->y);
+  free(batch->heading);
+  free(batch->noise);
+  free(batch->ir);
+  free(batch->line);
+  free(batch->light);
+  memset(batch, 0, sizeof(*batch));
+}
+
+/**
+  * Evaluate every sensor of every buggy one at a time
+*/
+void sensorBatchUpdateScalar(SensorBatch *batch, const SensorWalls *walls){
+  int i, channel;
+
+  for(channel = 0; channel < SENSOR_IR_CHANNELS; channel++){
+    for(i = 0; i < batch->capacity; i++){
+      batch->ir[channel * batch->capacity + i] = sensorIRAt(walls, batch->x[i], batch->y[i], batch->heading[i],
+        channel, batch->noisy ? &batch->noise[i] : 0);
+    }
+  }
+  for(channel = CHANNEL_LEFT; channel <= CHANNEL_RIGHT; channel++){
+    for(i = 0; i < batch->capacity; i++){
+      batch->line[channel * batch->capacity + i] = sensorLine(batch->x[i], batch->y[i], batch->heading[i], channel);
+    }
+  }
+  for(i = 0; i < batch->capacity; i++){
+    batch->light[i] = sensorLight(walls, batch->x[i], batch->y[i]);
+  }
+}
+
+#ifdef SENSOR_X86
+/**
+  * Store eight 32 bit readings (0 to 1023) as 16 bit ones
+*/
+__attribute__((target("avx2")))
+static inline void storeReadings(uint16_t *out, __m256i readings){
+  __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(readings, readings), 0x08);
+  _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(packed));
+}
+
+/**
+  * xorshift32 on eight generators, as floats in [0, 1)
+*/
+__attribute__((target("avx2")))
+static inline __m256 noiseUniform8(__m256i *state){
+  *state = _mm256_xor_si256(*state, _mm256_slli_epi32(*state, 13));
+  *state = _mm256_xor_si256(*state, _mm256_srli_epi32(*state, 17));
+  *state = _mm256_xor_si256(*state, _mm256_slli_epi32(*state, 5));
+  return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(*state, 8)), _mm256_set1_ps(1.0f / 16777216.0f));
+}
+
+/**
+  * sensorBatchUpdateScalar() eight buggies at a time
+*/
+__attribute__((target("avx2")))
+static void sensorBatchUpdateAVX2(SensorBatch *batch, const SensorWalls *walls){
+  int i, w, channel;
+  float sines[SENSOR_LANES] __attribute__((aligned(32)));
+  float cosines[SENSOR_LANES] __attribute__((aligned(32)));
+  __m256 x, y, sh, ch, sa, ca, px, py, inverse, nearest, t, hit, hit0, hit1, wall, distance, normal;
+  __m256 range = _mm256_set1_ps(SENSOR_IR_RANGE_MM);
+  __m256 zero = _mm256_setzero_ps();
+  __m256 radius = _mm256_set1_ps(SIM_IR_RADIUS_MM);
+  __m256 cell = _mm256_set1_ps(SIM_CELL_MM);
+  __m256 edge = _mm256_set1_ps(SIM_LINE_WIDTH_MM / 2.0f);
+  __m256 farEdge = _mm256_set1_ps(SIM_CELL_MM - SIM_LINE_WIDTH_MM / 2.0f);
+  __m256 behind = _mm256_set1_ps(SIM_LINE_BEHIND_MM);
+  __m256 closest = _mm256_set1_ps(SENSOR_IR_SCALE / 1023);
+  __m256 mask, fx, fy;
+  __m256i reading, noise, cellX, cellY;
+
+  for(i = 0; i < batch->capacity; i += SENSOR_LANES){
+    x = _mm256_load_ps(&batch->x[i]);
+    y = _mm256_load_ps(&batch->y[i]);
+    for(w = 0; w < SENSOR_LANES; w++){
+      sines[w] = sinf(batch->heading[i + w]);
+      cosines[w] = cosf(batch->heading[i + w]);
+    }
+    sh = _mm256_load_ps(sines);
+    ch = _mm256_load_ps(cosines);
+    noise = _mm256_load_si256((__m256i *)&batch->noise[i]);
+
+    for(channel = 0; channel < SENSOR_IR_CHANNELS; channel++){
+      sa = _mm256_add_ps(_mm256_mul_ps(sh, _mm256_set1_ps(channelCos[channel])),
+        _mm256_mul_ps(ch, _mm256_set1_ps(channelSin[channel])));
+      ca = _mm256_sub_ps(_mm256_mul_ps(ch, _mm256_set1_ps(channelCos[channel])),
+        _mm256_mul_ps(sh, _mm256_set1_ps(channelSin[channel])));
+      px = _mm256_add_ps(x, _mm256_mul_ps(radius, sa));
+      py = _mm256_add_ps(y, _mm256_mul_ps(radius, ca));
+      nearest = range;
+
+      inverse = _mm256_div_ps(_mm256_set1_ps(1.0f), ca);
+      for(w = 0; w < walls->horizontalCount; w++){
+        wall = _mm256_set1_ps(walls->hy[w]);
+        hit0 = _mm256_set1_ps(walls->hx0[w]);
+        hit1 = _mm256_set1_ps(walls->hx1[w]);
+        t = _mm256_mul_ps(_mm256_sub_ps(wall, py), inverse);
+        hit = _mm256_add_ps(px, _mm256_mul_ps(t, sa));
+        mask = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GE_OQ), _mm256_cmp_ps(t, nearest, _CMP_LT_OQ)),
+          _mm256_and_ps(_mm256_cmp_ps(hit, hit0, _CMP_GE_OQ), _mm256_cmp_ps(hit, hit1, _CMP_LE_OQ)));
+        nearest = _mm256_blendv_ps(nearest, t, mask);
+      }
+      inverse = _mm256_div_ps(_mm256_set1_ps(1.0f), sa);
+      for(w = 0; w < walls->verticalCount; w++){
+        wall = _mm256_set1_ps(walls->vx[w]);
+        hit0 = _mm256_set1_ps(walls->vy0[w]);
+        hit1 = _mm256_set1_ps(walls->vy1[w]);
+        t = _mm256_mul_ps(_mm256_sub_ps(wall, px), inverse);
+        hit = _mm256_add_ps(py, _mm256_mul_ps(t, ca));
+        mask = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GE_OQ), _mm256_cmp_ps(t, nearest, _CMP_LT_OQ)),
+          _mm256_and_ps(_mm256_cmp_ps(hit, hit0, _CMP_GE_OQ), _mm256_cmp_ps(hit, hit1, _CMP_LE_OQ)));
+        nearest = _mm256_blendv_ps(nearest, t, mask);
+      }
+
+      // Out of range reads 0; noise only advances for a wall in range, as in sensorIR()
+      mask = _mm256_cmp_ps(nearest, range, _CMP_LT_OQ);
+      distance = nearest;
+      if(batch->noisy){
+        __m256i before = noise;
+        normal = _mm256_add_ps(noiseUniform8(&noise), noiseUniform8(&noise));
+        normal = _mm256_add_ps(normal, _mm256_add_ps(noiseUniform8(&noise), noiseUniform8(&noise)));
+        normal = _mm256_mul_ps(_mm256_sub_ps(normal, _mm256_set1_ps(2.0f)), _mm256_set1_ps(1.7320508f));
+        distance = _mm256_mul_ps(distance, _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(SENSOR_IR_NOISE), normal)));
+        noise = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(before), _mm256_castsi256_ps(noise), mask));
+      }
+      reading = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_set1_ps(SENSOR_IR_SCALE), distance));
+      reading = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(reading),
+        _mm256_castsi256_ps(_mm256_set1_epi32(1023)), _mm256_cmp_ps(distance, closest, _CMP_LT_OQ)));
+      reading = _mm256_and_si256(reading, _mm256_castps_si256(mask));
+      storeReadings(&batch->ir[channel * batch->capacity + i], reading);
+    }
+    _mm256_store_si256((__m256i *)&batch->noise[i], noise);
+
+    for(channel = CHANNEL_LEFT; channel <= CHANNEL_RIGHT; channel++){
+      wall = _mm256_set1_ps(channel == CHANNEL_LEFT ? -SIM_LINE_SIDE_MM : SIM_LINE_SIDE_MM);
+      px = _mm256_add_ps(_mm256_sub_ps(x, _mm256_mul_ps(behind, sh)), _mm256_mul_ps(wall, ch));
+      py = _mm256_sub_ps(_mm256_sub_ps(y, _mm256_mul_ps(behind, ch)), _mm256_mul_ps(wall, sh));
+      fx = _mm256_sub_ps(px, _mm256_mul_ps(_mm256_floor_ps(_mm256_div_ps(px, cell)), cell));
+      fy = _mm256_sub_ps(py, _mm256_mul_ps(_mm256_floor_ps(_mm256_div_ps(py, cell)), cell));
+      mask = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(fx, edge, _CMP_LT_OQ), _mm256_cmp_ps(fx, farEdge, _CMP_GT_OQ)),
+        _mm256_or_ps(_mm256_cmp_ps(fy, edge, _CMP_LT_OQ), _mm256_cmp_ps(fy, farEdge, _CMP_GT_OQ)));
+      reading = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(_mm256_set1_epi32(SENSOR_LINE_OFF)),
+        _mm256_castsi256_ps(_mm256_set1_epi32(SENSOR_LINE_ON)), mask));
+      storeReadings(&batch->line[channel * batch->capacity + i], reading);
+    }
+
+    cellX = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_div_ps(x, cell)));
+    cellY = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_div_ps(y, cell)));
+    mask = _mm256_castsi256_ps(_mm256_and_si256(_mm256_cmpeq_epi32(cellX, _mm256_set1_epi32(walls->nestX)),
+      _mm256_cmpeq_epi32(cellY, _mm256_set1_epi32(walls->nestY))));
+    reading = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(_mm256_set1_epi32(SENSOR_LIGHT_OFF)),
+      _mm256_castsi256_ps(_mm256_set1_epi32(SENSOR_LIGHT_NEST)), mask));
+    storeReadings(&batch->light[i], reading);
+  }
+}
+#endif
+
+/**
+  * Whether the AVX2 kernels can run on this CPU
+*/
+bool sensorHaveAVX2(){
+#ifdef SENSOR_X86
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+/**
+  * Evaluate every sensor of every buggy, with AVX2 if the CPU has it
+*/
+void sensorBatchUpdate(SensorBatch *batch, const SensorWalls *walls){
+#ifdef SENSOR_X86
+  if(sensorHaveAVX2()){
+    sensorBatchUpdateAVX2(batch, walls);
+    return;
+  }
+#endif
+  sensorBatchUpdateScalar(batch, walls);
+}
@@ -0,0 +1,76 @@
+/**
+  * Batched sensor model for the simulator
+  * Evaluates the IR, line and light sensors of many simulated buggies in one maze at once.
+  * Buggy poses and sensor readings are held as structure of arrays, so each kernel works
+  * down one array at a time: with AVX2 eight buggies are handled per instruction, else a
+  * scalar loop produces exactly the same readings. The maze's walls are kept as lists of
+  * horizontal and vertical segments, which is all a 4-way maze has.
+  *
+  * IR readings follow the curve the controller's thresholds assume, IR_SCALE / distance (mm):
+  * WALL_DIST_THRESHOLD (50) is a wall 150mm away, CRASH_THRESHOLD (900) one 8mm away, and a
+  * centred buggy reads about 250 from a side wall. With noise on, the distance is scaled by
+  * 1 + SENSOR_IR_NOISE * n, n roughly standard normal, before the reading is worked out.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sim.h"
+
+// Longest distance the IR sensors can see a wall at
+#define SENSOR_IR_RANGE_MM  500
+// IR reading is SENSOR_IR_SCALE / distance (mm), up to 1023
+#define SENSOR_IR_SCALE     7500.0f
+// Standard deviation of the IR distance error, as a fraction of the distance
+#define SENSOR_IR_NOISE     0.05f
+// IR channels, and buggies per vector
+#define SENSOR_IR_CHANNELS  8
+#define SENSOR_LANES        8
+
+// Readings of the line sensors over a line and over bare floor, and of the light sensor in and out of the nest
+#define SENSOR_LINE_ON      10
+#define SENSOR_LINE_OFF     100
+#define SENSOR_LIGHT_NEST   100
+#define SENSOR_LIGHT_OFF    600
+
+// A maze's walls as axis aligned segments (mm): horizontal ones at y from x0 to x1,
+// vertical ones at x from y0 to y1
+#define SENSOR_MAX_WALLS    ((SIZE_X + 1) * (SIZE_Y + 1))
+typedef struct{
+  int horizontalCount, verticalCount;
+  float hy[SENSOR_MAX_WALLS], hx0[SENSOR_MAX_WALLS], hx1[SENSOR_MAX_WALLS];
+  float vx[SENSOR_MAX_WALLS], vy0[SENSOR_MAX_WALLS], vy1[SENSOR_MAX_WALLS];
+  int nestX, nestY;
+} SensorWalls;
+
+// Many buggies in one maze. Arrays hold capacity entries (a whole number of
+// SENSOR_LANES), readings channel by channel: ir[channel * capacity + buggy]
+typedef struct{
+  int count, capacity;
+  // Pose: mm from the maze's south west corner, radians clockwise from north
+  float *x, *y, *heading;
+  // Readings
+  uint16_t *ir, *line, *light;
+  // Noise generator state for each buggy (never 0)
+  uint32_t *noise;
+  bool noisy;
+} SensorBatch;
+
+void sensorWalls(SensorWalls *walls, const SimMaze *maze);
+float sensorRay(const SensorWalls *walls, float px, float py, float dx, float dy);
+unsigned int sensorIR(float distance, uint32_t *noise);
+unsigned int sensorIRAt(const SensorWalls *walls, float x, float y, float heading, int channel, uint32_t *noise);
+unsigned int sensorLine(float x, float y, float heading, int channel);
+unsigned int sensorLight(const SensorWalls *walls, float x, float y);
+
+int sensorBatchInit(SensorBatch *batch, int count, bool noisy, uint32_t seed);
+void sensorBatchFree(SensorBatch *batch);
+void sensorBatchUpdate(SensorBatch *batch, const SensorWalls *walls);
+void sensorBatchUpdateScalar(SensorBatch *batch, const SensorWalls *walls);
+bool sensorHaveAVX2();
+
+#endif
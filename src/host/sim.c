@@ -0,0 +1,436 @@
+/**
+  * Maze simulator for the maze runner controller (see sim.h)
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "allcode_api.h"
+#include "sim.h"
+#include "sensors.h"
+#include "walls.h"
+
+#define PI 3.14159265358979
+
+SimMaze simMaze;
+SimRobot simRobot;
+SimStats simStats;
+unsigned long long simTimeUs;
+uint32_t simNoiseSeed;
+void (*simSync)();
+unsigned long long simSyncUs;
+
+// The maze's walls for the sensor model, and its IR noise generator
+static SensorWalls sensorMaze;
+static uint32_t noise;
+
+// Mean motor command sampled every 10ms, for measuring acceleration: the slot about to be
+// overwritten holds the sample from SIM_ACCEL_WINDOW_MS ago
+#define SPEED_SAMPLES   (SIM_ACCEL_WINDOW_MS / 10)
+static int speedSamples[SPEED_SAMPLES];
+static int speedSampleNext;
+static unsigned long long nextSampleUs;
+// When the bluetooth link will have sent all the bytes waiting for it
+static unsigned long long btFreeUs = 0;
+
+static bool touching;
+static bool visited[SIZE_X][SIZE_Y];
+static int visitedCount;
+static int lastCellX, lastCellY;
+
+static const char *defaultMaze[] = {
+  "+---+---+---+---+",
+  "|               |",
+  "+   +---+---+   +",
+  "|   |     N |   |",
+  "+   +   +---+   +",
+  "|   |       |   |",
+  "+   +   +   +   +",
+  "|       |       |",
+  "+---+---+---+---+",
+};
+
+/**
+  * Parse a maze from text lines (see sim.h), returning 0 on success
+*/
+static int parseMaze(const char *lines[], int count){
+  int x, y, row, column;
+  const char *line;
+
+  if(count < 2 * SIZE_Y + 1){
+    return -1;
+  }
+  // Every other line holds the corners, which tells maze text from any other file
+  for(row = 0; row <= 2 * SIZE_Y; row += 2){
+    for(x = 0; x <= SIZE_X; x++){
+      column = 4 * x;
+      if((int)strlen(lines[row]) <= column || lines[row][column] != '+'){
+        return -1;
+      }
+    }
+  }
+  memset(&simMaze, 0, sizeof(simMaze));
+  simMaze.nestX = -1;
+  simMaze.nestY = -1;
+
+  for(y = 0; y < SIZE_Y; y++){
+    // Text rows run from north to south
+    row = 2 * (SIZE_Y - 1 - y);
+    for(x = 0; x < SIZE_X; x++){
+      column = 4 * x;
+      line = lines[row];
+      if((int)strlen(line) > column + 2 && line[column + 2] == '-'){
+        simMaze.walls[x][y] |= SIM_WALL_N;
+      }
+      line = lines[row + 2];
+      if((int)strlen(line) > column + 2 && line[column + 2] == '-'){
+        simMaze.walls[x][y] |= SIM_WALL_S;
+      }
+      line = lines[row + 1];
+      if((int)strlen(line) > column && line[column] == '|'){
+        simMaze.walls[x][y] |= SIM_WALL_W;
+      }
+      if((int)strlen(line) > column + 4 && line[column + 4] == '|'){
+        simMaze.walls[x][y] |= SIM_WALL_E;
+      }
+      if((int)strlen(line) > column + 2 && line[column + 2] == 'N'){
+        simMaze.nestX = x;
+        simMaze.nestY = y;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+  * Load a maze from a text file, returning 0 on success
+*/
+int simLoadMaze(FILE *file){
+  static char text[2 * SIZE_Y + 1][4 * SIZE_X + 8];
+  const char *lines[2 * SIZE_Y + 1];
+  int count = 0;
+
+  while(count < 2 * SIZE_Y + 1 && fgets(text[count], sizeof(text[count]), file)){
+    text[count][strcspn(text[count], "\r\n")] = 0;
+    lines[count] = text[count];
+    count++;
+  }
+  return parseMaze(lines, count);
+}
+
+void simDefaultMaze(){
+  parseMaze(defaultMaze, sizeof(defaultMaze) / sizeof(defaultMaze[0]));
+}
+
+/**
+  * Fill the controller's maze model with the simulated maze, as though every cell had been sensed
+  * (for uploading the maze to the controller, see upload.h)
+*/
+void simModelMaze(){
+  int x, y, i;
+
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      for(i = DIR_NORTH; i <= DIR_WEST; i++){
+        setWall(&maze[x][y], i, (simMaze.walls[x][y] & (1 << i)) != 0);
+      }
+      maze[x][y].visited = true;
+      maze[x][y].timesSensed = KNOWN_CELL_SENSES;
+    }
+  }
+  nestCell = simMaze.nestX >= 0 ? &maze[simMaze.nestX][simMaze.nestY] : 0;
+  startPosX = START_X;
+  startPosY = START_Y;
+  startDirection = DIR_NORTH;
+}
+
+/**
+  * Put the buggy back in the middle of the start cell facing north, and clear the statistics
+*/
+void simReset(){
+  memset(&simRobot, 0, sizeof(simRobot));
+  memset(&simStats, 0, sizeof(simStats));
+  memset(visited, 0, sizeof(visited));
+  memset(speedSamples, 0, sizeof(speedSamples));
+  simRobot.x = 1.5 * SIM_CELL_MM;
+  simRobot.y = 0.5 * SIM_CELL_MM;
+  simTimeUs = 0;
+  hostClockMs = 0;
+  btFreeUs = 0;
+  nextSampleUs = 0;
+  speedSampleNext = 0;
+  touching = false;
+  lastCellX = 1;
+  lastCellY = 0;
+  visited[1][0] = true;
+  visitedCount = 1;
+  sensorWalls(&sensorMaze, &simMaze);
+  noise = simNoiseSeed;
+}
+
+/**
+  * Distance from a point to a wall segment
+*/
+static double segmentDistance(double px, double py, double ax, double ay, double bx, double by){
+  double dx = bx - ax, dy = by - ay;
+  double t = ((px - ax) * dx + (py - ay) * dy) / (dx * dx + dy * dy);
+
+  if(t < 0){
+    t = 0;
+  }else if(t > 1){
+    t = 1;
+  }
+  dx = ax + t * dx - px;
+  dy = ay + t * dy - py;
+  return sqrt(dx * dx + dy * dy);
+}
+
+/**
+  * Get the ends of one wall of a cell, in mm
+*/
+static void wallEnds(int x, int y, int wall, double *ax, double *ay, double *bx, double *by){
+  double left = x * SIM_CELL_MM, bottom = y * SIM_CELL_MM;
+  double right = left + SIM_CELL_MM, top = bottom + SIM_CELL_MM;
+
+  switch(wall){
+    case SIM_WALL_N: *ax = left;  *ay = top;    *bx = right; *by = top;    break;
+    case SIM_WALL_E: *ax = right; *ay = bottom; *bx = right; *by = top;    break;
+    case SIM_WALL_S: *ax = left;  *ay = bottom; *bx = right; *by = bottom; break;
+    default:         *ax = left;  *ay = bottom; *bx = left;  *by = top;    break;
+  }
+}
+
+/**
+  * Check whether the buggy, centred at (px, py), overlaps any wall
+*/
+static bool hitsWall(double px, double py){
+  int x, y, wall;
+  double ax, ay, bx, by;
+
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      for(wall = SIM_WALL_N; wall <= SIM_WALL_W; wall <<= 1){
+        if(!(simMaze.walls[x][y] & wall)){
+          continue;
+        }
+        wallEnds(x, y, wall, &ax, &ay, &bx, &by);
+        if(segmentDistance(px, py, ax, ay, bx, by) < SIM_ROBOT_RADIUS_MM){
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+/**
+  * Record the buggy's progress through the maze's cells
+*/
+static void trackCell(){
+  int x = (int)floor(simRobot.x / SIM_CELL_MM);
+  int y = (int)floor(simRobot.y / SIM_CELL_MM);
+
+  if(x < 0 || x >= SIZE_X || y < 0 || y >= SIZE_Y || (x == lastCellX && y == lastCellY)){
+    return;
+  }
+  lastCellX = x;
+  lastCellY = y;
+  simStats.cellsEntered++;
+  if(x == simMaze.nestX && y == simMaze.nestY && !simStats.nestReachedMs){
+    simStats.nestReachedMs = simTimeUs / 1000;
+  }
+  if(!visited[x][y]){
+    visited[x][y] = true;
+    if(++visitedCount == SIZE_X * SIZE_Y){
+      simStats.allVisitedMs = simTimeUs / 1000;
+    }
+  }
+}
+
+/**
+  * Sample the mean motor command and measure acceleration over the window
+*/
+static void sampleSpeed(){
+  int now = (simRobot.left + simRobot.right) / 2;
+  int then = speedSamples[speedSampleNext];
+  double rate;
+
+  speedSamples[speedSampleNext] = now;
+  speedSampleNext = (speedSampleNext + 1) % SPEED_SAMPLES;
+  if(now > simStats.peakSpeed){
+    simStats.peakSpeed = now;
+  }
+  if(simTimeUs < SIM_ACCEL_WINDOW_MS * 1000ULL || now < MOTOR_SPEED || then < MOTOR_SPEED){
+    return;
+  }
+
+  rate = (now - then) * 1000.0 / SIM_ACCEL_WINDOW_MS;
+  if(rate > simStats.maxAccel){
+    simStats.maxAccel = rate;
+  }
+  if(-rate > simStats.maxDecel){
+    simStats.maxDecel = -rate;
+  }
+}
+
+/**
+  * Move the buggy at constant speeds and turning rate for the given time
+*/
+static void move(unsigned long us, double speed, double rate){
+  double dt, x, y;
+
+  while(us > 0){
+    dt = (us > 1000 ? 1000 : us) / 1e6;
+    us -= us > 1000 ? 1000 : us;
+    simTimeUs += (unsigned long long)(dt * 1e6);
+    hostClockMs = simTimeUs / 1000;
+
+    simRobot.heading += rate * dt;
+    x = simRobot.x + speed * sin(simRobot.heading) * dt;
+    y = simRobot.y + speed * cos(simRobot.heading) * dt;
+    if(hitsWall(x, y)){
+      // The wheels slip against the wall
+      if(!touching){
+        simStats.collisions++;
+      }
+      touching = true;
+    }else{
+      touching = false;
+      simStats.distanceMm += fabs(speed) * dt;
+      simRobot.x = x;
+      simRobot.y = y;
+      trackCell();
+    }
+
+    while(simTimeUs >= nextSampleUs){
+      sampleSpeed();
+      nextSampleUs += 10000;
+    }
+    if(simSync != 0 && simTimeUs >= simSyncUs){
+      simSync();
+    }
+  }
+}
+
+/**
+  * Whether the buggy has entered a cell since simReset()
+*/
+bool simVisited(int x, int y){
+  return visited[x][y];
+}
+
+/**
+  * Charge a byte sent over bluetooth to the link, first waiting (the buggy carrying on as
+  * commanded) until there is room for it, as a send on the robot blocks
+*/
+void simSendByte(){
+  unsigned long long byteUs = 1000000ULL / SIM_BT_RATE;
+
+  if(btFreeUs > simTimeUs + SIM_BT_BUFFER * byteUs){
+    simAdvance(btFreeUs - SIM_BT_BUFFER * byteUs - simTimeUs);
+  }
+  btFreeUs = (btFreeUs > simTimeUs ? btFreeUs : simTimeUs) + byteUs;
+}
+
+/**
+  * Let time pass with the motors running at their current command
+*/
+void simAdvance(unsigned long us){
+  double left = simRobot.left * (double)SIM_MM_PER_S;
+  double right = simRobot.right * (double)SIM_MM_PER_S;
+
+  move(us, (left + right) / 2, (left - right) / SIM_WHEELBASE_MM);
+}
+
+unsigned int simReadIR(unsigned char channel){
+  return sensorIRAt(&sensorMaze, simRobot.x, simRobot.y, simRobot.heading, channel, noise != 0 ? &noise : 0);
+}
+
+static unsigned int simIR(unsigned char channel){
+  simAdvance(SIM_CALL_US);
+  return simReadIR(channel);
+}
+
+static unsigned int simLine(unsigned char channel){
+  simAdvance(SIM_CALL_US);
+  return sensorLine(simRobot.x, simRobot.y, simRobot.heading, channel);
+}
+
+static unsigned int simLight(){
+  float x = simRobot.x, y = simRobot.y;
+
+  simAdvance(SIM_CALL_US);
+  return sensorLight(&sensorMaze, x, y);
+}
+
+static unsigned char simSwitch(unsigned char sw){
+  simAdvance(SIM_CALL_US);
+  return 0;
+}
+
+static void simMotors(unsigned char left, unsigned char right){
+  double x, y, error;
+
+  simAdvance(SIM_CALL_US);
+  if(left == 0 && right == 0 && (simRobot.left != 0 || simRobot.right != 0)){
+    x = simRobot.x - (floor(simRobot.x / SIM_CELL_MM) + 0.5) * SIM_CELL_MM;
+    y = simRobot.y - (floor(simRobot.y / SIM_CELL_MM) + 0.5) * SIM_CELL_MM;
+    error = sqrt(x * x + y * y);
+    simStats.stops++;
+    simStats.stopErrorTotal += error;
+    if(error > simStats.stopErrorMax){
+      simStats.stopErrorMax = error;
+    }
+  }
+  simRobot.left = left;
+  simRobot.right = right;
+}
+
+/**
+  * The buggy's blocking moves run at 100mm/s and 180 degrees/s
+*/
+static void simForwards(unsigned int distance){
+  move(distance * 10000UL, 100, 0);
+}
+
+static void simBackwards(unsigned int distance){
+  move(distance * 10000UL, -100, 0);
+}
+
+// The buggy turns 90 degrees for a commanded TURN_DEGREE (85)
+static void simLeft(unsigned int angle){
+  double turned = angle * 90.0 / 85;
+
+  move((unsigned long)(turned * 1e6 / 180), 0, -PI);
+}
+
+static void simRight(unsigned int angle){
+  double turned = angle * 90.0 / 85;
+
+  move((unsigned long)(turned * 1e6 / 180), 0, PI);
+}
+
+static void simDelay(unsigned int ms){
+  simAdvance(ms * 1000UL);
+}
+
+static unsigned long simClock(){
+  simAdvance(SIM_CALL_US / 10);
+  return simTimeUs / 1000;
+}
+
+const HostBackend simBackend = {
+  .readIR = simIR,
+  .readLine = simLine,
+  .readLight = simLight,
+  .readSwitch = simSwitch,
+  .setMotors = simMotors,
+  .forwards = simForwards,
+  .backwards = simBackwards,
+  .left = simLeft,
+  .right = simRight,
+  .delay = simDelay,
+  .clock = simClock,
+};
@@ -0,0 +1,103 @@
+/**
+  * Maze simulator for the maze runner controller
+  * Models a SIZE_X x SIZE_Y maze of 160mm cells and a differential drive buggy with
+  * its IR, line and light sensors, and serves them to the controller as a HostBackend.
+  * Time advances with every API call, so the controller's timing loops behave as on the robot.
+  *
+  * Mazes are text files, north at the top, one character per wall:
+  *   +---+---+
+  *   | N     |     '|' and '-' are walls, N marks the nest
+  *   +   +---+     '+' marks every corner, and is required
+  *   |       |     The buggy starts in cell (1, 0), bottom row, facing north
+  *   +---+---+
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "host.h"
+#include "main.h"
+
+// Wall bits of a simulated cell
+#define SIM_WALL_N      1
+#define SIM_WALL_E      2
+#define SIM_WALL_S      4
+#define SIM_WALL_W      8
+
+// Maze and buggy geometry
+#define SIM_CELL_MM     160
+#define SIM_ROBOT_RADIUS_MM   60
+#define SIM_WHEELBASE_MM      100
+#define SIM_IR_RADIUS_MM      50
+#define SIM_LINE_BEHIND_MM    48
+#define SIM_LINE_SIDE_MM      20
+#define SIM_LINE_WIDTH_MM     10
+// mm/s per unit of motor speed
+#define SIM_MM_PER_S    4
+// Modelled time taken by each API call
+#define SIM_CALL_US     200
+// Window over which acceleration is measured
+#define SIM_ACCEL_WINDOW_MS   250
+// Bluetooth link rate in bytes per second (115200 baud, as mazecoop), and how many bytes
+// can wait to go before FA_BTSendByte() has to wait for the link
+#define SIM_BT_RATE     11520
+#define SIM_BT_BUFFER   64
+
+typedef struct{
+  unsigned char walls[SIZE_X][SIZE_Y];
+  int nestX, nestY;
+} SimMaze;
+
+typedef struct{
+  // Position (mm from the maze's south west corner) and heading (radians clockwise from north)
+  double x, y, heading;
+  // Current motor command
+  int left, right;
+} SimRobot;
+
+// What happened during a run, for judging the controller
+typedef struct{
+  unsigned long cellsEntered;
+  unsigned long stops;
+  unsigned long collisions;
+  double distanceMm;
+  // Largest change in the mean motor command over SIM_ACCEL_WINDOW_MS, in speed units per second,
+  // measured only while driving at or above MOTOR_SPEED (starting and stopping are steps)
+  double maxAccel, maxDecel;
+  int peakSpeed;
+  // Distance of the buggy from the middle of the cell each time it stops
+  double stopErrorTotal, stopErrorMax;
+  // When every cell had been entered, 0 if never
+  unsigned long allVisitedMs;
+  // When the buggy first entered the nest cell, 0 if never
+  unsigned long nestReachedMs;
+} SimStats;
+
+extern SimMaze simMaze;
+extern SimRobot simRobot;
+extern SimStats simStats;
+// Simulated time in microseconds
+extern unsigned long long simTimeUs;
+// Seed for the IR noise generator as simReset() leaves it, 0 for noiseless readings (see sensors.h)
+extern uint32_t simNoiseSeed;
+// Called whenever simulated time reaches simSyncUs, if set, which it must move on
+// (mazecoop keeps several simulated buggies in step with it)
+extern void (*simSync)();
+extern unsigned long long simSyncUs;
+extern const HostBackend simBackend;
+
+int simLoadMaze(FILE *file);
+void simDefaultMaze();
+void simModelMaze();
+void simReset();
+void simAdvance(unsigned long us);
+void simSendByte();
+bool simVisited(int x, int y);
+unsigned int simReadIR(unsigned char channel);
+
+#endif
@@ -0,0 +1,410 @@
+/**
+  * Trajectory trace: the buffered background writer and the reader
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "main.h"
+#include "trace.h"
+
+#define PI 3.14159265358979
+
+// Largest stored block: every literal run costs a control byte per 128 bytes
+#define TRACE_STORED_MAX    (TRACE_BLOCK_STEPS * sizeof(TraceStep) * 129 / 128 + 1)
+
+// The trace being written, and the sensor readings and command for its next step
+static FILE *traceFile;
+static bool traceCompress;
+static HostBackend traceWrapped;
+static const HostBackend *traceInner;
+static TraceStep traceNext;
+
+// Two blocks of steps: one filling, and one being written by the writer thread
+static TraceStep traceBlocks[2][TRACE_BLOCK_STEPS];
+static int traceFilling, traceCount;
+static int traceHandedCount;
+static bool traceHanded, traceStopping, traceFailed;
+static pthread_t traceThread;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t traceChanged = PTHREAD_COND_INITIALIZER;
+
+static void putLong(unsigned char *bytes, uint32_t value){
+  bytes[0] = value;
+  bytes[1] = value >> 8;
+  bytes[2] = value >> 16;
+  bytes[3] = value >> 24;
+}
+
+static uint32_t getLong(const unsigned char *bytes){
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+/**
+  * Compress a block of steps (see trace.h), returning the stored length
+*/
+static size_t compress(const TraceStep *steps, int count, unsigned char *stored){
+  const unsigned char *raw = (const unsigned char *)steps;
+  size_t length = count * sizeof(TraceStep), i = 0, out = 0, run;
+  unsigned char delta[TRACE_BLOCK_STEPS * sizeof(TraceStep)];
+
+  for(i = 0; i < length; i++){
+    delta[i] = raw[i] ^ (i < sizeof(TraceStep) ? 0 : raw[i - sizeof(TraceStep)]);
+  }
+
+  i = 0;
+  while(i < length){
+    for(run = 0; i + run < length && delta[i + run] == 0 && run < 128; run++);
+    if(run > 0){
+      stored[out++] = run + 127;
+      i += run;
+      continue;
+    }
+    // Literals, up to the next pair of zeros (a lone zero is cheaper kept in)
+    for(run = 1; i + run < length && run < 128 && !(delta[i + run] == 0 && i + run + 1 < length && delta[i + run + 1] == 0); run++);
+    stored[out++] = run - 1;
+    memcpy(&stored[out], &delta[i], run);
+    out += run;
+    i += run;
+  }
+  return out;
+}
+
+/**
+  * Undo compress(), returning the raw length or -1 if the block is corrupt
+*/
+static long expand(const unsigned char *stored, size_t length, TraceStep *steps, size_t rawLength){
+  unsigned char *raw = (unsigned char *)steps;
+  size_t in = 0, out = 0, run, i;
+
+  while(in < length){
+    if(stored[in] >= 128){
+      run = stored[in++] - 127;
+      if(out + run > rawLength){
+        return -1;
+      }
+      memset(&raw[out], 0, run);
+    }else{
+      run = stored[in++] + 1;
+      if(out + run > rawLength || in + run > length){
+        return -1;
+      }
+      memcpy(&raw[out], &stored[in], run);
+      in += run;
+    }
+    out += run;
+  }
+
+  for(i = sizeof(TraceStep); i < out; i++){
+    raw[i] ^= raw[i - sizeof(TraceStep)];
+  }
+  return out;
+}
+
+/**
+  * Write a block of steps to the trace file, returning false on failure
+*/
+static bool writeBlock(const TraceStep *steps, int count){
+  static unsigned char stored[TRACE_STORED_MAX];
+  unsigned char lengths[8];
+  size_t rawLength = count * sizeof(TraceStep), storedLength = rawLength;
+  const void *bytes = steps;
+
+  if(traceCompress){
+    storedLength = compress(steps, count, stored);
+    bytes = stored;
+  }
+  putLong(lengths, rawLength);
+  putLong(&lengths[4], storedLength);
+  return fwrite(lengths, sizeof(lengths), 1, traceFile) == 1 && fwrite(bytes, storedLength, 1, traceFile) == 1;
+}
+
+/**
+  * The writer thread: write each block handed over until told to stop
+*/
+static void *writer(void *unused){
+  int block, count;
+
+  pthread_mutex_lock(&traceLock);
+  while(1){
+    while(!traceHanded && !traceStopping){
+      pthread_cond_wait(&traceChanged, &traceLock);
+    }
+    if(!traceHanded){
+      break;
+    }
+    block = 1 - traceFilling;
+    count = traceHandedCount;
+    pthread_mutex_unlock(&traceLock);
+
+    if(!writeBlock(traceBlocks[block], count)){
+      traceFailed = true;
+    }
+
+    pthread_mutex_lock(&traceLock);
+    traceHanded = false;
+    pthread_cond_broadcast(&traceChanged);
+  }
+  pthread_mutex_unlock(&traceLock);
+  return NULL;
+}
+
+/**
+  * Hand the filling block to the writer, once it has finished with the other
+*/
+static void handOver(){
+  pthread_mutex_lock(&traceLock);
+  while(traceHanded){
+    pthread_cond_wait(&traceChanged, &traceLock);
+  }
+  traceHandedCount = traceCount;
+  traceHanded = true;
+  traceFilling = 1 - traceFilling;
+  traceCount = 0;
+  pthread_cond_broadcast(&traceChanged);
+  pthread_mutex_unlock(&traceLock);
+}
+
+/**
+  * Start tracing a run in the simulated maze to a file, writing its header.
+  * Returns 0, or -1 if the file can't be written
+*/
+int traceOpen(const char *path, bool compress){
+  TraceHeader header;
+  uint8_t walls[SIZE_X][SIZE_Y];
+  int x, y;
+
+  traceFile = fopen(path, "wb");
+  if(traceFile == NULL){
+    return -1;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_MAGIC, 4);
+  header.version = TRACE_VERSION;
+  header.width = SIZE_X;
+  header.height = SIZE_Y;
+  header.stepSize = sizeof(TraceStep);
+  header.startX = START_X;
+  header.startY = START_Y;
+  header.nestX = simMaze.nestX >= 0 ? simMaze.nestX : 255;
+  header.nestY = simMaze.nestY >= 0 ? simMaze.nestY : 255;
+  header.flags = compress ? TRACE_COMPRESSED : 0;
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      walls[x][y] = simMaze.walls[x][y];
+    }
+  }
+  if(fwrite(&header, sizeof(header), 1, traceFile) != 1 || fwrite(walls, sizeof(walls), 1, traceFile) != 1){
+    fclose(traceFile);
+    return -1;
+  }
+
+  traceCompress = compress;
+  memset(&traceNext, 0, sizeof(traceNext));
+  traceFilling = 0;
+  traceCount = 0;
+  traceHanded = false;
+  traceStopping = false;
+  traceFailed = false;
+  if(pthread_create(&traceThread, NULL, writer, NULL) != 0){
+    fclose(traceFile);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * The wrapping backend's calls: note the reading or command, then pass it on
+*/
+static unsigned int traceIR(unsigned char channel){
+  unsigned int value = traceInner->readIR ? traceInner->readIR(channel) : 0;
+
+  if(channel < 8){
+    traceNext.ir[channel] = value;
+  }
+  return value;
+}
+
+static unsigned int traceLine(unsigned char channel){
+  unsigned int value = traceInner->readLine ? traceInner->readLine(channel) : 0;
+
+  if(channel < 2){
+    traceNext.line[channel] = value;
+  }
+  return value;
+}
+
+static unsigned int traceLight(){
+  unsigned int value = traceInner->readLight ? traceInner->readLight() : 0;
+
+  traceNext.light = value;
+  return value;
+}
+
+static void traceMotors(unsigned char left, unsigned char right){
+  traceNext.command = TRACE_MOTORS;
+  traceNext.left = left;
+  traceNext.right = right;
+  if(traceInner->setMotors){
+    traceInner->setMotors(left, right);
+  }
+}
+
+static void traceForwards(unsigned int distance){
+  traceNext.command = TRACE_FORWARDS;
+  if(traceInner->forwards){
+    traceInner->forwards(distance);
+  }
+}
+
+static void traceBackwards(unsigned int distance){
+  traceNext.command = TRACE_BACKWARDS;
+  if(traceInner->backwards){
+    traceInner->backwards(distance);
+  }
+}
+
+static void traceLeft(unsigned int angle){
+  traceNext.command = TRACE_LEFT;
+  if(traceInner->left){
+    traceInner->left(angle);
+  }
+}
+
+static void traceRight(unsigned int angle){
+  traceNext.command = TRACE_RIGHT;
+  if(traceInner->right){
+    traceInner->right(angle);
+  }
+}
+
+/**
+  * A backend that passes every call on to another, noting sensor readings and motion
+  * commands for the steps. Only one is wrapped at a time
+*/
+const HostBackend *traceBackend(const HostBackend *inner){
+  traceInner = inner;
+  traceWrapped = *inner;
+  traceWrapped.readIR = traceIR;
+  traceWrapped.readLine = traceLine;
+  traceWrapped.readLight = traceLight;
+  traceWrapped.setMotors = traceMotors;
+  traceWrapped.forwards = traceForwards;
+  traceWrapped.backwards = traceBackwards;
+  traceWrapped.left = traceLeft;
+  traceWrapped.right = traceRight;
+  return &traceWrapped;
+}
+
+/**
+  * Record a step: call after each runMainState()
+*/
+void traceStep(){
+  TraceStep *step = &traceBlocks[traceFilling][traceCount];
+  double turns = simRobot.heading / (2 * PI);
+  int i;
+
+  *step = traceNext;
+  step->us = simTimeUs;
+  step->x = simRobot.x > 0 ? (uint16_t)simRobot.x : 0;
+  step->y = simRobot.y > 0 ? (uint16_t)simRobot.y : 0;
+  step->heading = (uint16_t)(long)floor((turns - floor(turns)) * 65536);
+  step->state = mainState;
+  step->cellX = currentPosX;
+  step->cellY = currentPosY;
+  step->direction = currentDirection;
+  step->cell = (currentCell == nestCell ? TRACE_CELL_NEST : 0) | (cellKnown(currentCell) ? TRACE_CELL_KNOWN : 0);
+  for(i = DIR_NORTH; i <= DIR_WEST; i++){
+    if(currentCell->walls[i]){
+      step->cell |= 1 << i;
+    }
+  }
+
+  if(++traceCount == TRACE_BLOCK_STEPS){
+    handOver();
+  }
+}
+
+/**
+  * Write out the last steps and finish the trace. Returns 0, or -1 if any write failed
+*/
+int traceClose(){
+  if(traceCount > 0){
+    handOver();
+  }
+  pthread_mutex_lock(&traceLock);
+  traceStopping = true;
+  pthread_cond_broadcast(&traceChanged);
+  pthread_mutex_unlock(&traceLock);
+  pthread_join(traceThread, NULL);
+
+  if(fclose(traceFile) != 0){
+    traceFailed = true;
+  }
+  return traceFailed ? -1 : 0;
+}
+
+/**
+  * Open a trace for reading, returning 0, or -1 if it isn't a trace of a maze this size
+*/
+int traceReadOpen(const char *path, TraceReader *reader){
+  memset(reader, 0, sizeof(*reader));
+  reader->file = fopen(path, "rb");
+  if(reader->file == NULL){
+    return -1;
+  }
+  if(fread(&reader->header, sizeof(reader->header), 1, reader->file) != 1
+    || memcmp(reader->header.magic, TRACE_MAGIC, 4) != 0 || reader->header.version != TRACE_VERSION
+    || reader->header.width != SIZE_X || reader->header.height != SIZE_Y
+    || reader->header.stepSize != sizeof(TraceStep)
+    || fread(reader->walls, sizeof(reader->walls), 1, reader->file) != 1){
+    fclose(reader->file);
+    return -1;
+  }
+  reader->steps = malloc(TRACE_BLOCK_STEPS * sizeof(TraceStep));
+  reader->stored = malloc(TRACE_STORED_MAX);
+  return 0;
+}
+
+/**
+  * Read the next step, returning 1, or 0 at the end of the trace (or at a block cut short)
+*/
+int traceRead(TraceReader *reader, TraceStep *step){
+  unsigned char lengths[8];
+  uint32_t rawLength, storedLength;
+
+  if(reader->next == reader->count){
+    if(fread(lengths, sizeof(lengths), 1, reader->file) != 1){
+      return 0;
+    }
+    rawLength = getLong(lengths);
+    storedLength = getLong(&lengths[4]);
+    if(rawLength == 0 || rawLength > TRACE_BLOCK_STEPS * sizeof(TraceStep) || rawLength % sizeof(TraceStep) != 0
+      || storedLength > TRACE_STORED_MAX || fread(reader->stored, storedLength, 1, reader->file) != 1){
+      return 0;
+    }
+    if(!(reader->header.flags & TRACE_COMPRESSED)){
+      if(storedLength != rawLength){
+        return 0;
+      }
+      memcpy(reader->steps, reader->stored, rawLength);
+    }else if(expand(reader->stored, storedLength, reader->steps, rawLength) != (long)rawLength){
+      return 0;
+    }
+    reader->count = rawLength / sizeof(TraceStep);
+    reader->next = 0;
+  }
+
+  *step = reader->steps[reader->next++];
+  return 1;
+}
+
+void traceReadClose(TraceReader *reader){
+  fclose(reader->file);
+  free(reader->steps);
+  free(reader->stored);
+}
@@ -0,0 +1,104 @@
+/**
+  * Trajectory trace
+  * An append only binary record of a simulated run, one step per main loop iteration:
+  * the buggy's true pose, the controller's state, cell and heading, what it knows of
+  * that cell, the last reading of every sensor, the last motion command and the virtual
+  * time. Steps are gathered in blocks which a background thread writes out, compressed
+  * if asked, so tracing costs the simulation little more than copying each step.
+  * A run cut short leaves every complete block readable. All values are little endian.
+  *
+  * Header (TRACE_HEADER_LEN bytes, then width * height bytes):
+  *   magic "MZT1", version, width, height, step size (2 bytes each), start x, start y,
+  *   nest x, nest y (1 byte each, 255 if none), flags (TRACE_COMPRESSED), 3 bytes reserved,
+  *   then the simulated maze's walls (SIM_WALL_* bits, x major: cell x * height + y)
+  * Block:
+  *   raw length and stored length (4 bytes each), then the stored bytes. Uncompressed,
+  *   these are whole TraceSteps. Compressed, each step is XORed with the one before it
+  *   in the block (the first with zeros) and runs of zero bytes are squeezed out: a
+  *   control byte below 128 is followed by that many plus one literal bytes, and one of
+  *   128 or over stands for that many less 127 zero bytes.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "host.h"
+#include "sim.h"
+
+#define TRACE_MAGIC         "MZT1"
+#define TRACE_VERSION       1
+#define TRACE_HEADER_LEN    20
+
+// Header flags
+#define TRACE_COMPRESSED    1
+
+// Steps gathered before a block is handed to the writer
+#define TRACE_BLOCK_STEPS   1024
+
+// TraceStep.cell: the controller's model of the cell it thinks it is in
+#define TRACE_CELL_WALLS    0x0f
+#define TRACE_CELL_NEST     0x10
+#define TRACE_CELL_KNOWN    0x20
+
+// TraceStep.command: the last motion command made
+typedef enum{
+  TRACE_NONE,
+  TRACE_MOTORS,
+  TRACE_FORWARDS,
+  TRACE_BACKWARDS,
+  TRACE_LEFT,
+  TRACE_RIGHT,
+} TraceCommand;
+
+typedef struct{
+  char magic[4];
+  uint16_t version;
+  uint16_t width, height;
+  uint16_t stepSize;
+  uint8_t startX, startY;
+  uint8_t nestX, nestY;
+  uint8_t flags;
+  uint8_t reserved[3];
+} __attribute__((packed)) TraceHeader;
+
+typedef struct{
+  // Virtual time (us, wrapping after 71 minutes)
+  uint32_t us;
+  // True pose: mm from the maze's south west corner, and heading in 65536ths of a turn clockwise from north
+  uint16_t x, y, heading;
+  // The controller: MainState, the cell and heading it thinks it is in, and that cell's TRACE_CELL_* bits
+  uint8_t state, cellX, cellY, direction, cell;
+  // The last motion command (TraceCommand) and motor speeds
+  uint8_t command, left, right;
+  // The last reading of each sensor
+  uint16_t ir[8];
+  uint16_t line[2];
+  uint16_t light;
+} __attribute__((packed)) TraceStep;
+
+// A trace being read
+typedef struct{
+  FILE *file;
+  TraceHeader header;
+  uint8_t walls[SIZE_X][SIZE_Y];
+  TraceStep *steps;
+  int count, next;
+  unsigned char *stored;
+  size_t storedCapacity;
+} TraceReader;
+
+int traceOpen(const char *path, bool compress);
+const HostBackend *traceBackend(const HostBackend *inner);
+void traceStep();
+int traceClose();
+
+int traceReadOpen(const char *path, TraceReader *reader);
+int traceRead(TraceReader *reader, TraceStep *step);
+void traceReadClose(TraceReader *reader);
+
+#endif
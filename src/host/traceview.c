@@ -0,0 +1,378 @@
+/**
+  * Trajectory trace viewer
+  * Summarises a trace recorded by mazesim -r (see trace.h) and pictures the controller's
+  * maze model as it stood at any step. The picture is drawn by drawMaze() itself onto a
+  * stand-in LCD, so it is just what the buggy's screen showed: 7 pixels to a cell, with
+  * a dot in the cell the buggy thought it was in. One picture is written as a PBM image,
+  * or the whole run as an animated GIF, a frame per interval of virtual time.
+  *
+  * Usage: traceview [-p picture] [-g animation] [-s step] [-f ms] [-z scale] [-d] trace
+  *   -p picture    write the picture at -s step (default the last) as a PBM image
+  *   -g animation  write the run as an animated GIF
+  *   -s step       the step to picture
+  *   -f ms         virtual time between animation frames, each shown for as long (default 250)
+  *   -z scale      image pixels per LCD pixel (default 4)
+  *   -d            print every step
+  *
+  * Build: bin/host/hostcc -o out/host/traceview src/host/traceview.c src/host/trace.c src/host/sim.c src/host/sensors.c -lm -lpthread
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "allcode_api.h"
+#include "host.h"
+#include "main.h"
+#include "trace.h"
+
+// The robot's LCD, which drawMaze() is clipped to
+#define LCD_WIDTH       128
+#define LCD_HEIGHT      32
+
+// GIF LZW codes for a two colour image: the smallest code size GIF allows is 2 bits
+#define GIF_MIN_CODE_SIZE   2
+#define GIF_CLEAR           (1 << GIF_MIN_CODE_SIZE)
+#define GIF_MAX_CODE        4095
+
+// How long the last frame of an animation is held (cs)
+#define GIF_HOLD_CS         300
+
+static const char *stateNames[] = {
+  "START", "DETECT", "TURN", "DRIVE", "FINISH",
+};
+
+static const char *commandNames[] = {
+  "-", "motors", "forwards", "backwards", "left", "right",
+};
+
+// The stand-in LCD and the part of it the picture covers
+static unsigned char lcd[LCD_HEIGHT][LCD_WIDTH];
+static int pictureWidth, pictureHeight;
+
+// An animation's last picture, not yet written as it may be shown for longer, and for how long (cs)
+static unsigned char shown[LCD_HEIGHT][LCD_WIDTH];
+static unsigned int shownCs;
+
+static void lcdClear(){
+  memset(lcd, 0, sizeof(lcd));
+}
+
+static void lcdPlot(unsigned char x, unsigned char y){
+  if(x < LCD_WIDTH && y < LCD_HEIGHT){
+    lcd[y][x] = 1;
+  }
+}
+
+static const HostBackend lcdBackend = {
+  .lcdClear = lcdClear,
+  .lcdPlot = lcdPlot,
+};
+
+/**
+  * Bring the controller's model up to a step: the buggy's cell, heading and what it knew of the cell
+*/
+static void applyStep(const TraceStep *step){
+  int i;
+
+  if(step->cellX >= SIZE_X || step->cellY >= SIZE_Y){
+    return;
+  }
+  currentPosX = step->cellX;
+  currentPosY = step->cellY;
+  currentDirection = step->direction;
+  currentCell = &maze[currentPosX][currentPosY];
+  for(i = DIR_NORTH; i <= DIR_WEST; i++){
+    currentCell->walls[i] = (step->cell & (1 << i)) != 0;
+  }
+  currentCell->visited = true;
+  if(step->cell & TRACE_CELL_NEST){
+    nestCell = currentCell;
+  }
+}
+
+/**
+  * Reset the model to an unexplored maze
+*/
+static void resetModel(){
+  memset(maze, 0, sizeof(maze));
+  nestCell = 0;
+  currentPosX = START_X;
+  currentPosY = START_Y;
+  currentDirection = DIR_NORTH;
+  currentCell = &maze[currentPosX][currentPosY];
+}
+
+static int writePicture(const char *path, int scale, unsigned char picture[LCD_HEIGHT][LCD_WIDTH]){
+  FILE *file = fopen(path, "wb");
+  unsigned char byte;
+  int x, y, row, bit;
+
+  if(file == NULL){
+    return -1;
+  }
+  fprintf(file, "P4\n%d %d\n", pictureWidth * scale, pictureHeight * scale);
+  for(y = 0; y < pictureHeight * scale; y++){
+    row = y / scale;
+    for(x = 0; x < pictureWidth * scale; x += 8){
+      byte = 0;
+      for(bit = 0; bit < 8 && x + bit < pictureWidth * scale; bit++){
+        byte |= picture[row][(x + bit) / scale] << (7 - bit);
+      }
+      fputc(byte, file);
+    }
+  }
+  return fclose(file);
+}
+
+/**
+  * GIF writing: LZW codes are packed low bit first into sub-blocks of up to 255 bytes
+*/
+typedef struct{
+  FILE *file;
+  unsigned char block[255];
+  int length;
+  unsigned long bits;
+  int bitCount;
+} GifWriter;
+
+static void gifCode(GifWriter *gif, int code, int size){
+  gif->bits |= (unsigned long)code << gif->bitCount;
+  gif->bitCount += size;
+  while(gif->bitCount >= 8){
+    gif->block[gif->length++] = gif->bits & 0xff;
+    gif->bits >>= 8;
+    gif->bitCount -= 8;
+    if(gif->length == 255){
+      fputc(255, gif->file);
+      fwrite(gif->block, 255, 1, gif->file);
+      gif->length = 0;
+    }
+  }
+}
+
+/**
+  * Write a picture as a GIF frame shown for a time, LZW compressed
+*/
+static void gifFrame(FILE *file, int scale, unsigned char picture[LCD_HEIGHT][LCD_WIDTH], unsigned int delayCs){
+  static short next[GIF_MAX_CODE + 1][2];
+  GifWriter gif;
+  int width = pictureWidth * scale, height = pictureHeight * scale;
+  int x, y, pixel, code = -1, maxCode = GIF_CLEAR + 1, size = GIF_MIN_CODE_SIZE + 1;
+
+  // Graphic control extension (the delay), then the image descriptor for the whole screen
+  fputc(0x21, file);
+  fputc(0xf9, file);
+  fputc(4, file);
+  fputc(0, file);
+  fputc(delayCs & 0xff, file);
+  fputc(delayCs >> 8, file);
+  fputc(0, file);
+  fputc(0, file);
+  fputc(0x2c, file);
+  fputc(0, file);
+  fputc(0, file);
+  fputc(0, file);
+  fputc(0, file);
+  fputc(width & 0xff, file);
+  fputc(width >> 8, file);
+  fputc(height & 0xff, file);
+  fputc(height >> 8, file);
+  fputc(0, file);
+  fputc(GIF_MIN_CODE_SIZE, file);
+
+  memset(&gif, 0, sizeof(gif));
+  gif.file = file;
+  memset(next, 0, sizeof(next));
+  gifCode(&gif, GIF_CLEAR, size);
+  for(y = 0; y < height; y++){
+    for(x = 0; x < width; x++){
+      pixel = picture[y / scale][x / scale];
+      if(code < 0){
+        code = pixel;
+      }else if(next[code][pixel] != 0){
+        code = next[code][pixel];
+      }else{
+        gifCode(&gif, code, size);
+        next[code][pixel] = ++maxCode;
+        if(maxCode >= (1 << size)){
+          size++;
+        }
+        // The table is full: start afresh
+        if(maxCode == GIF_MAX_CODE){
+          gifCode(&gif, GIF_CLEAR, size);
+          memset(next, 0, sizeof(next));
+          maxCode = GIF_CLEAR + 1;
+          size = GIF_MIN_CODE_SIZE + 1;
+        }
+        code = pixel;
+      }
+    }
+  }
+  gifCode(&gif, code, size);
+  gifCode(&gif, GIF_CLEAR, size);
+  gifCode(&gif, GIF_CLEAR + 1, GIF_MIN_CODE_SIZE + 1);
+  gifCode(&gif, 0, 7);
+  if(gif.length > 0){
+    fputc(gif.length, file);
+    fwrite(gif.block, gif.length, 1, file);
+  }
+  fputc(0, file);
+}
+
+/**
+  * Start an animated GIF: the screen, a white and black palette, and looping forever
+*/
+static void gifStart(FILE *file, int scale){
+  int width = pictureWidth * scale, height = pictureHeight * scale;
+  static const unsigned char loop[] = {
+    0x21, 0xff, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 3, 1, 0, 0, 0,
+  };
+
+  fwrite("GIF89a", 6, 1, file);
+  fputc(width & 0xff, file);
+  fputc(width >> 8, file);
+  fputc(height & 0xff, file);
+  fputc(height >> 8, file);
+  fputc(0x80, file);
+  fputc(0, file);
+  fputc(0, file);
+  fwrite("\xff\xff\xff\x00\x00\x00", 6, 1, file);
+  fwrite(loop, sizeof(loop), 1, file);
+}
+
+/**
+  * Move an animation on by a frame interval: the picture shown has been shown for that much
+  * longer, and is written out and replaced if the model now draws differently
+*/
+static void gifNext(FILE *file, int scale, unsigned int intervalCs){
+  shownCs += intervalCs;
+  drawMaze();
+  if(memcmp(lcd, shown, sizeof(lcd)) != 0){
+    gifFrame(file, scale, shown, shownCs);
+    memcpy(shown, lcd, sizeof(lcd));
+    shownCs = 0;
+  }
+}
+
+int main(int argc, char *argv[]){
+  static unsigned char picture[LCD_HEIGHT][LCD_WIDTH];
+  static unsigned long stateUs[5];
+  TraceReader reader;
+  TraceStep step, last;
+  FILE *animation = NULL;
+  const char *picturePath = NULL, *animationPath = NULL;
+  long pictureStep = -1, steps = 0;
+  unsigned long frameMs = 250;
+  unsigned long long frameUs = 0;
+  int opt, scale = 4, i;
+  bool dump = false, pictured = false;
+
+  while((opt = getopt(argc, argv, "p:g:s:f:z:d")) != -1){
+    switch(opt){
+      case 'p': picturePath = optarg; break;
+      case 'g': animationPath = optarg; break;
+      case 's': pictureStep = strtol(optarg, NULL, 0); break;
+      case 'f': frameMs = strtoul(optarg, NULL, 0); break;
+      case 'z': scale = atoi(optarg); break;
+      case 'd': dump = true; break;
+      default:
+        fprintf(stderr, "Usage: traceview [-p picture] [-g animation] [-s step] [-f ms] [-z scale] [-d] trace\n");
+        return 1;
+    }
+  }
+  if(optind != argc - 1 || scale < 1 || scale > 16 || frameMs < 10){
+    fprintf(stderr, "Usage: traceview [-p picture] [-g animation] [-s step] [-f ms] [-z scale] [-d] trace\n");
+    return 1;
+  }
+  if(traceReadOpen(argv[optind], &reader) != 0){
+    fprintf(stderr, "%s: not a trace of a %dx%d maze\n", argv[optind], SIZE_X, SIZE_Y);
+    return 1;
+  }
+
+  pictureWidth = MAZE_DRAW_LENGTH + 1 < LCD_WIDTH ? MAZE_DRAW_LENGTH + 1 : LCD_WIDTH;
+  pictureHeight = MAZE_DRAW_WIDTH + 1 < LCD_HEIGHT ? MAZE_DRAW_WIDTH + 1 : LCD_HEIGHT;
+  hostUse(&lcdBackend);
+  resetModel();
+  if(animationPath != NULL){
+    animation = fopen(animationPath, "wb");
+    if(animation == NULL){
+      perror(animationPath);
+      return 1;
+    }
+    gifStart(animation, scale);
+    drawMaze();
+    memcpy(shown, lcd, sizeof(lcd));
+    shownCs = 0;
+  }
+
+  memset(&last, 0, sizeof(last));
+  while(traceRead(&reader, &step)){
+    if(steps > 0 && last.state < 5){
+      stateUs[last.state] += step.us - last.us;
+    }
+
+    // Frames due before this step show the model as it was
+    while(animation != NULL && step.us >= frameUs + frameMs * 1000){
+      frameUs += frameMs * 1000;
+      gifNext(animation, scale, frameMs / 10);
+    }
+
+    applyStep(&step);
+    if(dump){
+      printf("%6ld %9.3f s %-6s cell (%d, %d) dir %d walls %x%s  at (%d, %d) mm %5.1f deg  ir",
+        steps, step.us / 1e6, step.state < 5 ? stateNames[step.state] : "?", step.cellX, step.cellY,
+        step.direction, step.cell & TRACE_CELL_WALLS, step.cell & TRACE_CELL_KNOWN ? " known" : "",
+        step.x, step.y, step.heading * 360.0 / 65536);
+      for(i = 0; i < 8; i++){
+        printf(" %d", step.ir[i]);
+      }
+      printf("  line %d %d  light %d  %s %d %d\n", step.line[0], step.line[1], step.light,
+        step.command < 6 ? commandNames[step.command] : "?", step.left, step.right);
+    }
+    if(steps == pictureStep){
+      drawMaze();
+      memcpy(picture, lcd, sizeof(lcd));
+      pictured = true;
+    }
+    last = step;
+    steps++;
+  }
+  traceReadClose(&reader);
+
+  if(animation != NULL){
+    // The end of the run, held a while
+    gifNext(animation, scale, (last.us - frameUs) / 10000);
+    gifFrame(animation, scale, shown, shownCs + GIF_HOLD_CS);
+    fputc(0x3b, animation);
+    if(fclose(animation) != 0){
+      perror(animationPath);
+      return 1;
+    }
+  }
+  if(picturePath != NULL){
+    if(pictureStep >= 0 && !pictured){
+      fprintf(stderr, "%s has only %ld steps\n", argv[optind], steps);
+      return 1;
+    }
+    if(!pictured){
+      drawMaze();
+      memcpy(picture, lcd, sizeof(lcd));
+    }
+    if(writePicture(picturePath, scale, picture) != 0){
+      perror(picturePath);
+      return 1;
+    }
+  }
+
+  printf("%dx%d maze, %ld steps over %.1f s%s\n", SIZE_X, SIZE_Y, steps, last.us / 1e6,
+    reader.header.flags & TRACE_COMPRESSED ? ", compressed" : "");
+  printf("Time in each state:");
+  for(i = 0; i < 5; i++){
+    printf(" %s %.1f s%s", stateNames[i], stateUs[i] / 1e6, i < 4 ? "," : "\n");
+  }
+  printf("Ended in cell (%d, %d) facing %d, buggy at (%d, %d) mm\n", last.cellX, last.cellY, last.direction, last.x, last.y);
+  return 0;
+}
@@ -0,0 +1,113 @@
+/**
+  * Bluetooth framing for binary messages between the robot and host tools
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include "allcode_api.h"
+#include "btframe.h"
+
+// CRC16 (CCITT polynomial, zero seed) nibble table, as used by the bootloader
+static const unsigned int crcTable[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+/**
+  * Calculate the CRC16 of a frame body
+*/
+unsigned int frameCrc(const unsigned char *data, int length){
+  unsigned int crc = 0;
+  unsigned int n;
+  int i;
+
+  for(i = 0; i < length; i++){
+    n = (crc >> 12) ^ (data[i] >> 4);
+    crc = (crcTable[n & 0x0f] ^ (crc << 4)) & 0xffff;
+    n = (crc >> 12) ^ data[i];
+    crc = (crcTable[n & 0x0f] ^ (crc << 4)) & 0xffff;
+  }
+
+  return crc;
+}
+
+/**
+  * Send a byte, escaping it if it clashes with a framing byte
+*/
+static void sendEscaped(unsigned char byte){
+  if(byte == FRAME_SOH || byte == FRAME_EOT || byte == FRAME_DLE){
+    FA_BTSendByte(FRAME_DLE);
+  }
+  FA_BTSendByte(byte);
+}
+
+/**
+  * Send a frame body over bluetooth with its checksum
+*/
+void sendFrame(const unsigned char *body, int length){
+  unsigned int crc = frameCrc(body, length);
+  int i;
+
+  FA_BTSendByte(FRAME_SOH);
+  for(i = 0; i < length; i++){
+    sendEscaped(body[i]);
+  }
+  sendEscaped(crc & 0xff);
+  sendEscaped((crc >> 8) & 0xff);
+  FA_BTSendByte(FRAME_EOT);
+}
+
+/**
+  * Discard any partially received frame
+*/
+void resetFrameParser(FrameParser *parser){
+  parser->inFrame = false;
+  parser->escaped = false;
+  parser->length = 0;
+}
+
+/**
+  * Feed one received byte to the parser. Bytes outside of frames (e.g. debug text) are ignored.
+  * Returns the body length once a complete frame with a valid checksum has arrived, otherwise -1
+*/
+int parseFrameByte(FrameParser *parser, unsigned char byte){
+  unsigned int crc;
+  int length;
+
+  if(parser->escaped){
+    parser->escaped = false;
+  }else if(byte == FRAME_SOH){
+    // Start of a new frame, abandoning any unfinished one
+    parser->inFrame = true;
+    parser->length = 0;
+    return -1;
+  }else if(!parser->inFrame){
+    return -1;
+  }else if(byte == FRAME_DLE){
+    parser->escaped = true;
+    return -1;
+  }else if(byte == FRAME_EOT){
+    parser->inFrame = false;
+    if(parser->length < 3){
+      return -1;
+    }
+
+    length = parser->length - 2;
+    crc = frameCrc(parser->body, length);
+    if(parser->body[length] != (crc & 0xff) || parser->body[length + 1] != ((crc >> 8) & 0xff)){
+      return -1;
+    }
+    return length;
+  }
+
+  if(!parser->inFrame){
+    return -1;
+  }
+
+  // Frames too long for the buffer are dropped
+  if(parser->length >= FRAME_MAX_LEN + 2){
+    resetFrameParser(parser);
+    return -1;
+  }
+  parser->body[parser->length++] = byte;
+  return -1;
+}
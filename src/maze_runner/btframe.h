@@ -0,0 +1,52 @@
+/**
+  * Bluetooth framing for binary messages between the robot and host tools
+  * Frames use the bootloader's format (SOH, DLE-escaped body, CRC16 low/high, EOT)
+  * so they can be picked out of the plain text debug stream.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef BTFRAME_H
+#define BTFRAME_H
+
+#include <stdbool.h>
+
+#define FRAME_SOH       1
+#define FRAME_EOT       4
+#define FRAME_DLE       16
+
+// Largest frame body accepted by the parser (type byte + payload)
+#define FRAME_MAX_LEN   200
+
+// Frame types (first byte of the body)
+#define FRAME_LOG       'L'
+#define FRAME_PROFILE   'P'
+#define FRAME_COUNTS    'N'
+#define FRAME_COSTS     'C'
+#define FRAME_POWER     'W'
+// Host to robot uploads and the robot's reply (see upload.h)
+#define FRAME_MAP       'M'
+#define FRAME_ROUTE     'R'
+#define FRAME_ACK       'A'
+// Between buggies exploring one maze together (see share.h)
+#define FRAME_CELL      'K'
+#define FRAME_CLAIM     'T'
+
+/**
+  * Incremental frame decoder, fed one byte at a time
+*/
+typedef struct{
+  // Whether an SOH has been seen and a body is being collected
+  bool inFrame;
+  // Whether the previous byte was a DLE escape
+  bool escaped;
+  // The frame body collected so far, including the two CRC bytes until complete
+  unsigned char body[FRAME_MAX_LEN + 2];
+  int length;
+} FrameParser;
+
+unsigned int frameCrc(const unsigned char *data, int length);
+void sendFrame(const unsigned char *body, int length);
+void resetFrameParser(FrameParser *parser);
+int parseFrameByte(FrameParser *parser, unsigned char byte);
+
+#endif
@@ -6,7 +6,137 @@
   * @version 1.0
 */
 #include "allcode_api.h"
+#ifdef HOST_BUILD
+#include "host.h"
+#endif
 #include "main.h"
+#include "btframe.h"
+#include "senselog.h"
+#include "profile.h"
+#include "planner.h"
+#include "power.h"
+#include "upload.h"
+#include "share.h"
+#include "walls.h"
+
+/**
+  * SYSTEM CONSTANTS
+*/
+// The IR reading distance to detect a wall
+const int WALL_DIST_THRESHOLD = 50;
+// The light level reading to mark cell as nest
+const int LIGHT_LEVEL_THRESHOLD = 200;
+// The line reading to mark a new cell
+const int CELL_LINE_THRESHOLD = 50;
+const int MOTOR_SPEED = 20;
+const int TURN_DEGREE = 85;
+// The IR Reading threshold for reactive behaviour
+const int CRASH_THRESHOLD = 900;
+// The number of times a cell's walls must have been sensed before they are trusted
+const int KNOWN_CELL_SENSES = 1;
+// Wall centring controller constants
+const int CENTRE_TARGET = 250;
+const int CENTRE_KP = 3;
+const int CENTRE_KD = 20;
+const int CENTRE_GAIN_DIV = 100;
+const int CENTRE_MAX_TRIM = 10;
+const int CENTRE_PERIOD_MS = 20;
+const int CENTRE_WALL_END_DIV = 5;
+// Straight run speed profile constants
+const int CRUISE_SPEED = 50;
+const int MOTION_ACCEL = 40;
+const int MOTION_DECEL = 40;
+const int MOTION_PERIOD_MS = 20;
+// Robot geometry
+const int CELL_LENGTH_MM = 160;
+const int SPEED_MM_PER_S = 4;
+const int CREEP_MS = 400;
+// How often the side walls are sampled whilst sensing on the move
+const int SENSE_PERIOD_MS = 50;
+// Pause between drive loop iterations, which bounds how fast driving fills the sensor log
+const int DRIVE_POLL_MS = 2;
+// Maze Drawing Constants
+const int MAZE_DRAW_LENGTH = 28;
+const int MAZE_DRAW_WIDTH = 28;
+const int MAZE_DRAW_CELL_LENGTH = 7;
+const int MAZE_DRAW_CELL_WIDTH = 7;
+
+/**
+  * SYSTEM INFO VARIABLES
+*/
+int currentDirection = DIR_NORTH;
+// 1 as default
+int currentPosX = 1;
+int currentPosY = 0;
+// The number of cells that the robot has visited
+int noVisitedCells = 0;
+// The pose the run started from
+int startPosX = START_X;
+int startPosY = START_Y;
+int startDirection = DIR_NORTH;
+
+// The state machine variables
+MainState mainState;
+
+// Create the 2D maze array and store pointers to the current cell
+Cell maze[SIZE_X][SIZE_Y];
+
+// The current cell of the robot and the nest cell (default null)
+Cell *currentCell;
+Cell *nestCell;
+
+// Wall centring controller state: the last error, when it was measured and whether it is valid,
+// which side walls it was measured against, the last side readings and whether each is falling
+// away as a wall ends, and the trim and speed last set on the motors
+int centreLastError = 0;
+unsigned long centreLastUpdate = 0;
+bool centreHasError = false;
+int centreLastWalls = 0;
+int centreLastLeft = 0;
+int centreLastRight = 0;
+bool centreLeftEnding = false;
+bool centreRightEnding = false;
+long centreTrim = 0;
+int centreSpeed = 0;
+
+// Speed profile state: commanded speed in hundredths of a unit, when it was last updated,
+// distance travelled (mm) from the middle of the current cell, and cells left to the stopping cell
+long motionSpeedCenti = 0;
+unsigned long motionLastUpdate = 0;
+long motionTravelled = 0;
+int motionCellsToGo = 1;
+bool motionOnLine = false;
+
+// Sensing on the move: whether the buggy is on its way from a new cell's line into its middle,
+// whether it is sensing the cell's walls on the way, distance travelled from the line (um),
+// when that was last updated and when the side walls were last sampled
+bool senseMoving = false;
+bool senseSampling = false;
+long senseTravelled = 0;
+unsigned long senseLastUpdate = 0;
+unsigned long senseLastSample = 0;
+
+// The phase of the run, and the cell wall following started from (the start cell, or where a route
+// to an unmapped cell ended) and the heading it first left that cell by (-1 until then)
+RoutePhase routePhase = ROUTE_EXPLORE;
+int exploreFromX, exploreFromY;
+int exploreFirstDirection = -1;
+
+// Action timing: when the buggy set off and how many cells it has moved since, when it last
+// stopped and whether in a known cell, and time spent turning since
+unsigned long actionDriveStart = 0;
+int actionCells = 0;
+unsigned long actionStopTime = 0;
+bool actionStopKnown = false;
+unsigned long actionTurnMs = 0;
+
+// When the buggy finished, for timing the LED flashes
+unsigned long finishStart = 0;
+
+// Cells entered on the move are only drawn and reported at the next stop: whether any are
+// waiting, and whether the profile is due
+bool reportPending = false;
+bool reportProfileDue = false;
 
 
 /**
@@ -15,15 +145,43 @@
 void changeMainState(MainState newState){
   // Standard 500ms delay between each state to allow sensors to
   // settle etc.
-  FA_DelayMillis(500);
+  idleDelayMillis(500);
+  changeMainStateNow(newState);
+}
+
+/**
+  * Change the system's main state without the settling delay, for transitions
+  * where nothing is sensed in between
+*/
+void changeMainStateNow(MainState newState){
   mainState = newState;
-  int i;
+
+#ifdef SENSE_LOG
+  logState(newState);
+#endif
+#ifdef HOST_BUILD
+  hostStateChanged(newState);
+#endif
 
   // State first-time entry behaviour
   // Code that only needs to be executed once on entry into the state
   switch(mainState){
 
     case MAIN_DRIVE:
+#ifdef WALL_CENTRING
+      resetCentring();
+#endif
+#ifdef SPEED_PROFILE
+      resetMotion();
+#endif
+#ifdef ROUTE_PLANNER
+      // Time spent stopped in a known cell, besides turning, is what a route pays per stop
+      actionDriveStart = FA_ClockMS();
+      if(actionStopKnown){
+        recordAction(ACTION_SETTLE, actionDriveStart - actionStopTime - actionTurnMs);
+      }
+      actionCells = 0;
+#endif
     break;
 
     case MAIN_DETECT:
@@ -32,20 +190,31 @@ void changeMainState(MainState newState){
     case MAIN_FINISH:
       FA_SetMotors(0, 0);
 
+#ifdef PROFILE
+      sendProfile();
+#endif
+#ifdef ROUTE_PLANNER
+      sendActionCosts();
+#endif
+#ifdef UPLOAD
+      sendMap();
+#endif
+      // Power use over the run, then each POWER_REPORT_MS whilst finished
+      sendPower();
+      finishStart = FA_ClockMS();
+
       // Turn on all front LEDs
-      for(i = 0; i < 8; i++){
-        FA_LEDOn(i);
-      }
+      powerLeds(true);
 
       // Play a quick tune once
       FA_PlayNote(523,100);
-      FA_DelayMillis(100);
+      idleDelayMillis(100);
       FA_PlayNote(523,100);
-      FA_DelayMillis(100);
+      idleDelayMillis(100);
       FA_PlayNote(523,100);
-      FA_DelayMillis(100);
+      idleDelayMillis(100);
       FA_PlayNote(659,200);
-      FA_DelayMillis(100);
+      idleDelayMillis(100);
     break;
   }
 }
@@ -60,6 +229,13 @@ void avoidObstacle(){
     FA_Backwards(10);
   }
 
+#ifdef WALL_CENTRING
+  // Whilst driving, the centring controller keeps the robot off the side walls
+  if(mainState == MAIN_DRIVE){
+    return;
+  }
+#endif
+
   // If there is an obstacle on either the left or right side of the robot
   // correct accordingly
 
@@ -72,6 +248,358 @@ void avoidObstacle(){
   }
 }
 
+/**
+  * Forget the centring controller's history, on setting off from a cell
+*/
+void resetCentring(){
+  centreHasError = false;
+  centreLastUpdate = FA_ClockMS() - CENTRE_PERIOD_MS;
+  centreTrim = 0;
+  centreLastLeft = 0;
+  centreLastRight = 0;
+  centreLeftEnding = false;
+  centreRightEnding = false;
+}
+
+/**
+  * Check whether a side IR reading shows a wall to centre on. Where a wall ends the reading
+  * falls away over a few cm, which would look like the robot drifting off the wall and steer
+  * it into the opening, so a reading falling by more than 1/CENTRE_WALL_END_DIV of itself in a
+  * control period isn't used until it stops falling.
+*/
+bool centreWall(int reading, int *lastReading, bool *ending){
+  if(reading < *lastReading - *lastReading / CENTRE_WALL_END_DIV){
+    *ending = true;
+  }else if(reading >= *lastReading){
+    *ending = false;
+  }
+  *lastReading = reading;
+
+  return reading > WALL_DIST_THRESHOLD && !*ending;
+}
+
+/**
+  * Set the motors to the given speed, speeding up the left wheel by trim and slowing the right
+*/
+void setCentredMotors(int speed, long trim){
+  int left = speed + trim;
+  int right = speed - trim;
+
+  centreTrim = trim;
+  centreSpeed = speed;
+  FA_SetMotors(left < 0 ? 0 : (left > 100 ? 100 : left), right < 0 ? 0 : (right > 100 ? 100 : right));
+}
+
+/**
+  * Drive forwards at the given speed whilst staying centred between the side walls.
+  * A proportional-derivative controller on the side IR readings trims the motor speeds
+  * every CENTRE_PERIOD_MS, so the robot corrects continuously without stopping. In between
+  * the last trim is kept, following any change of speed straight away.
+*/
+void driveCentred(int speed){
+  int left, right, error;
+  long trim;
+  bool wallLeft, wallRight;
+  unsigned long now = FA_ClockMS();
+
+  if(now - centreLastUpdate < (unsigned long)CENTRE_PERIOD_MS){
+    if(speed != centreSpeed){
+      setCentredMotors(speed, centreTrim);
+    }
+    return;
+  }
+  centreLastUpdate = now;
+
+  left = FA_ReadIR(IR_LEFT);
+  right = FA_ReadIR(IR_RIGHT);
+  wallLeft = centreWall(left, &centreLastLeft, &centreLeftEnding);
+  wallRight = centreWall(right, &centreLastRight, &centreRightEnding);
+
+  // Positive error means the robot is too close to the left wall
+  if(wallLeft && wallRight){
+    error = left - right;
+  }else if(wallLeft){
+    error = left - CENTRE_TARGET;
+  }else if(wallRight){
+    error = CENTRE_TARGET - right;
+  }else{
+    // Nothing to centre on (e.g. crossing a junction), so hold course
+    centreHasError = false;
+    setCentredMotors(speed, 0);
+    return;
+  }
+
+  // A wall appearing or ending steps the error, which isn't the robot moving, so skip the derivative
+  if(centreLastWalls != (wallLeft ? 1 : 0) + (wallRight ? 2 : 0)){
+    centreHasError = false;
+  }
+  centreLastWalls = (wallLeft ? 1 : 0) + (wallRight ? 2 : 0);
+
+  // In long, as a step in the error times CENTRE_KD can overflow an int on the robot
+  trim = (long)CENTRE_KP * error;
+  if(centreHasError){
+    trim += (long)CENTRE_KD * (error - centreLastError);
+  }
+  trim /= CENTRE_GAIN_DIV;
+  centreLastError = error;
+  centreHasError = true;
+
+  if(trim > CENTRE_MAX_TRIM){
+    trim = CENTRE_MAX_TRIM;
+  }else if(trim < -CENTRE_MAX_TRIM){
+    trim = -CENTRE_MAX_TRIM;
+  }
+
+  // Speed up the wheel nearest the wall to steer away from it
+  setCentredMotors(speed, trim);
+}
+
+/**
+  * Choose the direction to leave a cell by, using the 'Left Hand Rule'
+  * Returns the new heading given the heading the cell was entered with
+*/
+int chooseDirection(Cell *cell, int direction){
+  int left = ((direction-1) % 4 + 4) % 4;
+  int rear = ((direction+2) % 4 + 4) % 4;
+  int right = ((direction+1) % 4 + 4) % 4;
+
+  // Left (PRIORITY #1), then forward (#2), then right (#3), otherwise a dead end
+  if(!(cell->walls[left])){
+    return left;
+  }else if(!(cell->walls[direction])){
+    return direction;
+  }else if(!(cell->walls[right])){
+    return right;
+  }
+  return rear;
+}
+
+/**
+  * Check whether wall following is about to leave the cell it started from the way it
+  * first did, and so would only repeat itself
+*/
+bool wallFollowRepeats(int newDirection){
+  if(exploreFirstDirection < 0){
+    exploreFromX = currentPosX;
+    exploreFromY = currentPosY;
+    exploreFirstDirection = newDirection;
+    return false;
+  }
+  return currentPosX == exploreFromX && currentPosY == exploreFromY && newDirection == exploreFirstDirection;
+}
+
+/**
+  * Check whether exploring is done: every cell has been visited or no unmapped cell can be
+  * reached. Heading for unmapped cells, that takes a search (findFrontier()) each time; wall
+  * following, only once the unmapped cell last found has been mapped.
+*/
+bool explorationComplete(bool toFrontier){
+  if(noVisitedCells >= SIZE_X * SIZE_Y){
+    return true;
+  }
+  if(toFrontier){
+    return !findFrontier();
+  }
+  return cellKnown(&maze[frontierX][frontierY]) && !findFrontier();
+}
+
+/**
+  * Plan the quickest route from the current cell and heading to another cell and start following it
+  * Returns false if the known maze has no way there
+*/
+bool startRoute(int toX, int toY){
+  if(planRoute(currentPosX, currentPosY, currentDirection, toX, toY) < 0){
+    return false;
+  }
+  return true;
+}
+
+/**
+  * Turn on the spot, timing the turn for the route planner's cost model
+*/
+void turnTimed(bool left, unsigned int angle){
+#ifdef ROUTE_PLANNER
+  unsigned long start = FA_ClockMS();
+  unsigned long taken;
+#endif
+
+  if(left){
+    FA_Left(angle);
+  }else{
+    FA_Right(angle);
+  }
+
+#ifdef ROUTE_PLANNER
+  taken = FA_ClockMS() - start;
+  recordAction(angle > TURN_DEGREE ? ACTION_TURN_180 : ACTION_TURN_90, taken);
+  actionTurnMs += taken;
+#endif
+}
+
+/**
+  * Get the cell next to the given position in a direction, or null (0) at the edge of the maze
+*/
+Cell *neighbourCell(int x, int y, int direction){
+  switch(direction){
+    case DIR_NORTH:
+      y++;
+    break;
+
+    case DIR_EAST:
+      x++;
+    break;
+
+    case DIR_SOUTH:
+      y--;
+    break;
+
+    case DIR_WEST:
+      x--;
+    break;
+  }
+
+  if(x < 0 || x >= SIZE_X || y < 0 || y >= SIZE_Y){
+    return 0;
+  }
+  return &maze[x][y];
+}
+
+/**
+  * Check whether the buggy can drive straight through a cell without stopping:
+  * its walls are known, it isn't the nest or the cell wall following started from (where
+  * wallFollowRepeats() must be asked) and the left hand rule would carry straight on.
+  * On a planned route, whether the route carries straight on through the cell that many cells ahead.
+*/
+bool passThrough(Cell *cell, int direction, int ahead){
+#ifdef SKIP_KNOWN_CELLS
+  if(routePhase != ROUTE_EXPLORE){
+#ifdef WALL_CONFIDENCE
+    // Stop to sense a cell in doubt again, in case the route is blocked after all
+    if(cell != 0 && cellInDoubt(cell)){
+      return false;
+    }
+#endif
+    return cell != 0 && routeStep + ahead < routeLength && route[routeStep + ahead] == direction;
+  }
+  return cell != 0 && cell != nestCell && cellKnown(cell)
+    && (exploreFirstDirection < 0 || cell != &maze[exploreFromX][exploreFromY])
+    && chooseDirection(cell, direction) == direction;
+#else
+  return false;
+#endif
+}
+
+/**
+  * Count the cells ahead that the buggy will drive straight through before the cell it must stop in
+*/
+int straightRunLength(){
+  int x = currentPosX;
+  int y = currentPosY;
+  int run = 0;
+  Cell *cell = neighbourCell(x, y, currentDirection);
+
+  while(passThrough(cell, currentDirection, run + 1) && run < SIZE_X + SIZE_Y){
+    run++;
+    switch(currentDirection){
+      case DIR_NORTH: y++; break;
+      case DIR_EAST:  x++; break;
+      case DIR_SOUTH: y--; break;
+      case DIR_WEST:  x--; break;
+    }
+    cell = neighbourCell(x, y, currentDirection);
+  }
+
+  return run;
+}
+
+/**
+  * Set off from the middle of a cell at MOTOR_SPEED, planning the run to the next stopping cell
+*/
+void resetMotion(){
+  motionSpeedCenti = MOTOR_SPEED * 100L;
+  motionLastUpdate = FA_ClockMS();
+  motionTravelled = 0;
+  motionCellsToGo = straightRunLength() + 1;
+  // A stop well off the middle of the cell, or a turn, can leave the line sensors over one of the
+  // cell's own lines: ignore it until they are clear, rather than counting a cell that isn't there
+  motionOnLine = FA_ReadLine(CHANNEL_LEFT) < CELL_LINE_THRESHOLD || FA_ReadLine(CHANNEL_RIGHT) < CELL_LINE_THRESHOLD;
+}
+
+/**
+  * Integer square root, for the braking curve
+*/
+static long squareRoot(long value){
+  long root = 0;
+  long bit = 1L << 30;
+
+  while(bit > value){
+    bit >>= 2;
+  }
+  while(bit != 0){
+    if(value >= root + bit){
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }else{
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+/**
+  * The speed to drive at along a straight run. The speed ramps up at MOTION_ACCEL
+  * towards CRUISE_SPEED, and comes back down at MOTION_DECEL so that the buggy is
+  * at MOTOR_SPEED when it reaches the line of the cell it stops in, then creeps in as usual.
+*/
+int motionSpeed(){
+  unsigned long now = FA_ClockMS();
+  unsigned long elapsed = now - motionLastUpdate;
+  long toLine, limit, target;
+
+  if(elapsed < (unsigned long)MOTION_PERIOD_MS){
+    return motionSpeedCenti / 100;
+  }
+  motionLastUpdate = now;
+
+  // Creeping into the middle of a cell sensed on the move (see senseOnMove()): hold the speed
+  if(motionCellsToGo == 0){
+    return motionSpeedCenti / 100;
+  }
+
+  // Dead reckoning on the commanded speed
+  motionTravelled += motionSpeedCenti * SPEED_MM_PER_S * (long)elapsed / 100000L;
+
+  // Distance to the line of the stopping cell, which is one creep short of its middle
+  toLine = (long)motionCellsToGo * CELL_LENGTH_MM - motionTravelled
+    - (long)MOTOR_SPEED * SPEED_MM_PER_S * CREEP_MS / 1000;
+  if(toLine < 0){
+    toLine = 0;
+  }
+
+  // Fastest speed from which MOTOR_SPEED can still be reached by the line: v^2 = v0^2 + 2ad
+  limit = squareRoot((long)MOTOR_SPEED * MOTOR_SPEED + 2L * MOTION_DECEL * toLine / SPEED_MM_PER_S);
+  target = limit < CRUISE_SPEED ? limit : CRUISE_SPEED;
+  if(target < MOTOR_SPEED){
+    target = MOTOR_SPEED;
+  }
+  target *= 100;
+
+  if(target > motionSpeedCenti){
+    motionSpeedCenti += MOTION_ACCEL * (long)elapsed / 10;
+    if(motionSpeedCenti > target){
+      motionSpeedCenti = target;
+    }
+  }else if(target < motionSpeedCenti){
+    motionSpeedCenti -= MOTION_DECEL * (long)elapsed / 10;
+    if(motionSpeedCenti < target){
+      motionSpeedCenti = target;
+    }
+  }
+
+  return motionSpeedCenti / 100;
+}
+
 /**
   * Send system information over bluetooth
   * for debugging purposes.
@@ -98,17 +626,37 @@ void printDebugStream(){
     FA_BTSendNumber(currentCell->walls[2]);
     FA_BTSendNumber(currentCell->walls[3]);
     FA_BTSendString("\n", 4);
+#ifdef SENSE_LOG
+    FA_BTSendString("Log entries dropped: ", 30);
+    FA_BTSendNumber(logDropped);
+    FA_BTSendString("\n", 4);
+#endif
     FA_BTSendString("============================ \n", 30);
   }
 }
 
 /**
-  * The operations to perform when the buggy enters a new cell
-  * Print debug information to bluetooth console
+  * Check whether a cell's walls are already known well enough to be used
+  * without stopping to sense them again
+*/
+bool cellKnown(Cell *cell){
+#ifdef WALL_CONFIDENCE
+  // Every wall must be trusted as well as the cell sensed (the nest is only found by
+  // sensing, however well the neighbouring cells have shown its walls)
+  if(cellInDoubt(cell)){
+    return false;
+  }
+#endif
+  return cell->visited && cell->timesSensed >= KNOWN_CELL_SENSES;
+}
+
+/**
+  * Update the model as the buggy moves into the next cell
   * Update current position
   * Update number of cells seen
+  * Nothing is drawn or sent here, as the buggy may be moving: see reportCells()
 */
-void newCellEntered(){
+void advanceCell(){
 
   // Update position of the buggy based on its direction of travel
   // Could simplify this switch block but it would obfuscate the code drastically
@@ -131,6 +679,10 @@ void newCellEntered(){
   }
 
   currentCell = &maze[currentPosX][currentPosY];
+  actionCells++;
+  if(routePhase != ROUTE_EXPLORE){
+    routeStep++;
+  }
 
   // Update visited flag and increment visited cells
   if(!currentCell->visited){
@@ -138,10 +690,77 @@ void newCellEntered(){
     noVisitedCells++;
   }
 
+  reportPending = true;
+#ifdef PROFILE
+  profileCells++;
+  if(profileCells % PROFILE_REPORT_CELLS == 0){
+    reportProfileDue = true;
+  }
+#endif
+}
+
+/**
+  * Once stopped, draw the cells entered since the last stop and send their debug information.
+  * This blocks for a while (drawMaze() alone plots thousands of pixels), with no line, centring
+  * or crash checks, so it waits for a stop rather than running as each cell is entered.
+*/
+void reportCells(){
+  if(!reportPending){
+    return;
+  }
+  reportPending = false;
+
   // Update maze representation
-  drawMaze();
+  PROFILE_CALL(PROF_DRAW_MAZE, drawMaze());
 #ifdef DEBUG
-  printDebugStream();
+  PROFILE_CALL(PROF_DEBUG_STREAM, printDebugStream());
+#endif
+#ifdef SENSE_LOG
+  flushLog();
+#endif
+#ifdef PROFILE
+  if(reportProfileDue){
+    reportProfileDue = false;
+    sendProfile();
+  }
+#endif
+}
+
+/**
+  * Time the run just finished on stopping in the current cell, for the route planner's cost model
+*/
+void recordStop(){
+#ifdef ROUTE_PLANNER
+  unsigned long now;
+
+  // Time the run just finished: a single cell, or the cells after the first on a straight run
+  now = FA_ClockMS();
+  if(actionCells == 1){
+    recordAction(ACTION_RUN_START, now - actionDriveStart);
+  }else if(actionCells > 1 && now - actionDriveStart > actionCost[ACTION_RUN_START]){
+    recordAction(ACTION_RUN_CELL, (now - actionDriveStart - actionCost[ACTION_RUN_START]) / (actionCells - 1));
+  }
+  actionStopTime = now;
+  actionStopKnown = cellKnown(currentCell);
+  actionTurnMs = 0;
+#endif
+}
+
+/**
+  * The operations to perform when the buggy stops in a new cell
+*/
+void newCellEntered(){
+  advanceCell();
+  recordStop();
+  reportCells();
+
+#ifdef SKIP_KNOWN_CELLS
+  // Revisited cells are traversed using the stored model, going straight
+  // to the turn decision without stopping to sense
+  if(cellKnown(currentCell)){
+    changeMainStateNow(MAIN_TURN);
+    return;
+  }
 #endif
 
   changeMainState(MAIN_DETECT);
@@ -212,11 +831,20 @@ void drawMaze(){
 void initialize(){
   int x, y, i;
 
+#ifdef SENSE_LOG
+  // Start recording a new run
+  resetLog();
+#endif
+#ifdef PROFILE
+  profileReset();
+#endif
+
   // Initialize the API-specific things
   FA_LCDBacklight(50);
   for(i = 0; i < 8; i++){
     FA_LEDOff(i);
   };
+  powerReset();
 
   // Initialize the maze by iteratively setting its walls attributes
   for(x = 0; x < SIZE_X; x++){
@@ -227,26 +855,56 @@ void initialize(){
       maze[x][y].walls[DIR_WEST] = false;
 
       maze[x][y].visited = false;
+      maze[x][y].timesSensed = 0;
     }
   }
+#ifdef WALL_CONFIDENCE
+  resetWalls();
+#endif
 
   // Set number of visited cells to 0
   noVisitedCells = 0;
 
+  // Reset robot position + direction
+  startPosX = START_X;
+  startPosY = START_Y;
+  startDirection = DIR_NORTH;
+  currentPosX = startPosX;
+  currentPosY = startPosY;
+  currentDirection = startDirection;
+
   // Set the current cell pointer to the current position
   currentCell = &maze[currentPosX][currentPosY];
 
   // Draw maze in initial state.
   drawMaze();
-
-  // Reset robot position + direction
-  currentPosX = 1;
-  currentPosY = 0;
-  currentDirection = DIR_NORTH;
+  reportPending = false;
+  reportProfileDue = false;
 
   // Reset nest position
   nestCell = 0;
 
+  // Explore first
+  routePhase = ROUTE_EXPLORE;
+  exploreFirstDirection = -1;
+  resetFrontier();
+  actionStopKnown = false;
+#ifdef SHARE_MAP
+  resetShare();
+#endif
+
+#ifdef UPLOAD
+  // Start from an uploaded map or route if there is one, going straight onto the route to the nest
+  if(FA_BTConnected()){
+    waitForUpload();
+  }
+  if(applyUpload()){
+    drawMaze();
+    changeMainState(cellKnown(currentCell) ? MAIN_TURN : MAIN_DETECT);
+    return;
+  }
+#endif
+
   // Move to the next state...
   changeMainState(MAIN_DETECT);
 }
@@ -257,17 +915,46 @@ void initialize(){
 */
 void detect(){
 
-  int front = currentDirection;
-  int left = ((currentDirection-1) % 4 + 4) % 4;
-  int rear = ((currentDirection+2) % 4 + 4) % 4;
-  int right = ((currentDirection+1) % 4 + 4) % 4;
-
+#ifndef ROUTE_PLANNER
   // Check if all cells have been visited (crawling finished)
   if(noVisitedCells > (SIZE_X * SIZE_Y)){
     changeMainState(MAIN_FINISH);
     return;
   }
+#endif
+
+  senseCell();
+
+  // Advance the state machine
+  changeMainState(MAIN_TURN);
+}
+
+/**
+  * Sense the current cell's walls and light level into the maze model
+*/
+void senseCell(){
+
+  int front = currentDirection;
+  int left = ((currentDirection-1) % 4 + 4) % 4;
+  int rear = ((currentDirection+2) % 4 + 4) % 4;
+  int right = ((currentDirection+1) % 4 + 4) % 4;
+#ifdef WALL_CONFIDENCE
+  // The IR channel facing each heading, counting clockwise from the way the robot faces
+  static const unsigned char wallChannel[4] = {IR_FRONT, IR_RIGHT, IR_REAR, IR_LEFT};
+  int i, read, direction;
+#endif
 
+#ifdef WALL_CONFIDENCE
+  // Weigh up a reading of every side of the cell, then read again any side still in doubt
+  for(read = 0; read <= WALL_RESENSE_READS; read++){
+    for(i = 0; i < 4; i++){
+      direction = (currentDirection + i) % 4;
+      if(read == 0 || !wallConfident(currentCell, direction)){
+        senseWall(currentPosX, currentPosY, direction, FA_ReadIR(wallChannel[i]));
+      }
+    }
+  }
+#else
   // Detect all the cell's walls and update the maze model
   // Directions are relative depending on the way the robot is facing, so check that first.
   switch(currentDirection){
@@ -301,14 +988,21 @@ void detect(){
     break;
 
   }
+#endif
+
+  if(currentCell->timesSensed < 255){
+    currentCell->timesSensed++;
+  }
 
   // Detect Light Level in the cell to check for nest then update model
   if(FA_ReadLight() < LIGHT_LEVEL_THRESHOLD){
     nestCell = currentCell;
   }
 
-  // Advance the state machine
-  changeMainState(MAIN_TURN);
+#ifdef SHARE_MAP
+  // Tell any other buggies in the maze
+  shareCell(currentCell);
+#endif
 }
 
 /**
@@ -316,41 +1010,134 @@ void detect(){
   * by using the 'Left Hand Rule', allowing the robot to solve the maze
 */
 void turn(){
+  int newDirection = nextDirection();
 
-  // Get headingings dynamically from the compass using modulus
-  int front = currentDirection;
-  int left = ((currentDirection-1) % 4 + 4) % 4;
+  if(newDirection < 0){
+    changeMainState(MAIN_FINISH);
+    return;
+  }
+  turnTowards(newDirection);
+}
+
+/**
+  * Decide which way to leave the current cell: by the 'Left Hand Rule' whilst exploring,
+  * otherwise along the planned route, planning the next route when one is needed.
+  * Returns the new heading, or -1 if the run is over
+*/
+int nextDirection(){
   int rear = ((currentDirection+2) % 4 + 4) % 4;
-  int right = ((currentDirection+1) % 4 + 4) % 4;
+  int newDirection;
+#ifdef ROUTE_PLANNER
+  bool toFrontier = false;
 
-  // If cell is the nest, no need to decide simply turn around and advance state
-  if(currentCell == nestCell){
+#ifdef SHARE_MAP
+  // Take in what the other buggies have found before deciding
+  pollUpload();
+#endif
 
-    // Choose Best direction to turn around based on vicinity to wall
-    if(FA_ReadIR(CHANNEL_LEFT) > FA_ReadIR(CHANNEL_RIGHT)){
-      FA_Right(TURN_DEGREE*2);
-    }else{
-      FA_Left(TURN_DEGREE*2);
+  // On the way to an unmapped cell: once there, or once another buggy has mapped it, explore again
+  if(routePhase == ROUTE_TO_FRONTIER && (routeStep >= routeLength || cellKnown(&maze[frontierX][frontierY]))){
+    routePhase = ROUTE_EXPLORE;
+  }
+
+  // Head for the nearest unmapped cell rather than wall follow: always when exploring with
+  // other buggies, and alone once wall following would only repeat itself (going round an
+  // island, say), which can leave cells and the nest still unmapped
+  if(routePhase == ROUTE_EXPLORE){
+#ifdef SHARE_MAP
+    toFrontier = shareActive;
+#endif
+    if(!toFrontier){
+      toFrontier = wallFollowRepeats(chooseDirection(currentCell, currentDirection));
+    }
+  }
+
+  // Once the maze is explored, plan the quickest route to the nest
+  if(routePhase == ROUTE_EXPLORE && explorationComplete(toFrontier)){
+    if(nestCell == 0 || !startRoute((nestCell - &maze[0][0]) / SIZE_Y, (nestCell - &maze[0][0]) % SIZE_Y)){
+      return -1;
+    }
+    routePhase = ROUTE_TO_NEST;
+  }
+
+  // Claim the unmapped cell explorationComplete() found, and plan the quickest route
+  // to the known cell next to it, then one more step in (wall following starts afresh there)
+  if(routePhase == ROUTE_EXPLORE && toFrontier){
+#ifdef SHARE_MAP
+    shareClaim(frontierX, frontierY);
+#endif
+    exploreFirstDirection = -1;
+    if((frontierFromX != currentPosX || frontierFromY != currentPosY) && startRoute(frontierFromX, frontierFromY)
+      && routeLength < ROUTE_MAX){
+      route[routeLength++] = frontierFromDirection;
+      routePhase = ROUTE_TO_FRONTIER;
     }
-    changeMainState(MAIN_DRIVE);
-    return;
   }
 
+  // At the end of a route: from the nest, plan the quickest way back to the start, which ends the run
+  if(routePhase != ROUTE_EXPLORE && routeStep >= routeLength){
+    if(routePhase == ROUTE_TO_START || !startRoute(startPosX, startPosY)){
+      return -1;
+    }
+    routePhase = ROUTE_TO_START;
+  }
 
-  // Check if left turn is possible (PRIORITY #1)
-  if(!(currentCell->walls[left])){
+#ifdef WALL_CONFIDENCE
+  // Sensing a cell in doubt again can find a wall across the route: plan around it,
+  // or go back to exploring if the route was to an unmapped cell
+  if(routePhase != ROUTE_EXPLORE && currentCell->walls[route[routeStep]]){
+    if(routePhase == ROUTE_TO_FRONTIER){
+      routePhase = ROUTE_EXPLORE;
+      exploreFirstDirection = -1;
+    }else if(routePhase == ROUTE_TO_START ? !startRoute(startPosX, startPosY)
+      : nestCell == 0 || !startRoute((nestCell - &maze[0][0]) / SIZE_Y, (nestCell - &maze[0][0]) % SIZE_Y)){
+      return -1;
+    }
+  }
+#endif
+#endif
+
+  if(routePhase != ROUTE_EXPLORE){
+    // Follow the planned route
+    newDirection = route[routeStep];
+  }else if(currentCell == nestCell){
+    // If cell is the nest, no need to decide simply turn around
+    newDirection = rear;
+  }else{
+    newDirection = chooseDirection(currentCell, currentDirection);
+  }
+#ifdef ROUTE_PLANNER
+  // Stepping straight into a neighbouring unmapped cell
+  if(routePhase == ROUTE_EXPLORE && toFrontier && frontierFromX == currentPosX && frontierFromY == currentPosY){
+    newDirection = frontierFromDirection;
+  }
+#endif
+
+  return newDirection;
+}
+
+/**
+  * Turn on the spot to face the new heading, then drive out of the cell
+*/
+void turnTowards(int newDirection){
+  int left = ((currentDirection-1) % 4 + 4) % 4;
+  int rear = ((currentDirection+2) % 4 + 4) % 4;
+  int right = ((currentDirection+1) % 4 + 4) % 4;
+
+  // Left turn (PRIORITY #1)
+  if(newDirection == left){
     // Turn left and update direction
-    FA_Left(TURN_DEGREE);
+    turnTimed(true, TURN_DEGREE);
     currentDirection = left;
 
-    // Otherwise check if forward is possible (PRIORITY #2)
-  }else if(!(currentCell->walls[currentDirection])){
+    // Forward (PRIORITY #2)
+  }else if(newDirection == currentDirection){
     // Do nothing
 
-    // Right turn possible? (PRIORITY #3)
-  }else if(!(currentCell->walls[right])){
+    // Right turn (PRIORITY #3)
+  }else if(newDirection == right){
     // Turn right and update direction
-    FA_Right(TURN_DEGREE);
+    turnTimed(false, TURN_DEGREE);
     currentDirection = right;
 
     // If none of the above are possible, robot is in dead end and must turn around
@@ -361,9 +1148,9 @@ void turn(){
       * and turn the opposite direction to avoid scraping
     */
     if(FA_ReadIR(CHANNEL_LEFT) > FA_ReadIR(CHANNEL_RIGHT)){
-      FA_Right(TURN_DEGREE*2);
+      turnTimed(false, TURN_DEGREE*2);
     }else{
-      FA_Left(TURN_DEGREE*2);
+      turnTimed(true, TURN_DEGREE*2);
     }
 
     // Update direction to rear
@@ -374,20 +1161,129 @@ void turn(){
   changeMainState(MAIN_DRIVE);
 }
 
+/**
+  * Drive from a new cell's line into its middle, sampling the cell's side walls on the way
+  * (with WALL_CONFIDENCE) and reading all of its walls in the middle, as detect() does but
+  * without stopping. There the buggy decides which way to leave the cell, and stops only
+  * if it has to turn or go back; otherwise it plans the straight run on from the cell.
+*/
+void senseOnMove(int speed){
+  unsigned long now = FA_ClockMS();
+  int newDirection;
+
+  // Dead reckoning on the commanded speed
+  senseTravelled += (long)speed * SPEED_MM_PER_S * (long)(now - senseLastUpdate);
+  senseLastUpdate = now;
+
+  if(senseTravelled < (long)MOTOR_SPEED * SPEED_MM_PER_S * CREEP_MS){
+#ifdef WALL_CONFIDENCE
+    if(senseSampling && now - senseLastSample >= (unsigned long)SENSE_PERIOD_MS){
+      senseLastSample = now;
+      senseWall(currentPosX, currentPosY, (currentDirection + 3) % 4, FA_ReadIR(IR_LEFT));
+      senseWall(currentPosX, currentPosY, (currentDirection + 1) % 4, FA_ReadIR(IR_RIGHT));
+    }
+#endif
+    return;
+  }
+
+  // In the middle of the cell
+  senseMoving = false;
+  if(senseSampling){
+    senseCell();
+  }
+
+  newDirection = nextDirection();
+  if(newDirection == currentDirection){
+#ifdef SPEED_PROFILE
+    motionTravelled = 0;
+    motionCellsToGo = straightRunLength() + 1;
+#endif
+    return;
+  }
+
+  FA_SetMotors(0, 0);
+  recordStop();
+  reportCells();
+  if(newDirection < 0){
+    changeMainState(MAIN_FINISH);
+    return;
+  }
+  changeMainStateNow(MAIN_TURN);
+  turnTowards(newDirection);
+}
+
 /**
   * Implements the cruising aspect of the robot and it's basic reactive behaviour
   * Whilst simultaniously modelling the maze and using the FSM.
   * Constantly check for cell changes then enact the correct behaviour
 */
 void drive(){
-  FA_SetMotors(MOTOR_SPEED, MOTOR_SPEED);
+  int speed = MOTOR_SPEED;
+  bool onLine;
+
+#ifdef SPEED_PROFILE
+  speed = motionSpeed();
+#endif
+
+#ifdef WALL_CENTRING
+  driveCentred(speed);
+#else
+  FA_SetMotors(speed, speed);
+#endif
+
+  onLine = FA_ReadLine(CHANNEL_LEFT) < CELL_LINE_THRESHOLD || FA_ReadLine(CHANNEL_RIGHT) < CELL_LINE_THRESHOLD;
+
+#ifdef SENSE_ON_MOVE
+  // On the way into the middle of a new cell
+  if(senseMoving){
+    PROFILE_CALL(PROF_NEW_CELL, senseOnMove(speed));
+    return;
+  }
+#endif
+
+#ifdef SPEED_PROFILE
+  // Ignore the line of a cell that is being driven straight through until the sensors are clear of it
+  if(motionOnLine){
+    motionOnLine = onLine;
+    return;
+  }
+#endif
 
   // When buggy enters a new cell creep into the middle, then stops and updates state.
-  if(FA_ReadLine(CHANNEL_LEFT) < CELL_LINE_THRESHOLD || FA_ReadLine(CHANNEL_RIGHT) < CELL_LINE_THRESHOLD){
+  if(onLine){
+#ifdef SPEED_PROFILE
+    if(motionCellsToGo > 1){
+      // A cell on a straight run: carry on through it at speed
+      motionCellsToGo--;
+      motionTravelled = -((long)MOTOR_SPEED * SPEED_MM_PER_S * CREEP_MS / 1000);
+      motionOnLine = true;
+      advanceCell();
+      return;
+    }
+#endif
+
+#ifdef SENSE_ON_MOVE
+    // Carry on into the middle of the cell at the same speed, sensing it on the way (see senseOnMove())
+    advanceCell();
+    senseMoving = true;
+#ifdef SKIP_KNOWN_CELLS
+    senseSampling = !cellKnown(currentCell);
+#else
+    senseSampling = true;
+#endif
+    senseTravelled = 0;
+    senseLastUpdate = FA_ClockMS();
+    senseLastSample = senseLastUpdate;
+#ifdef SPEED_PROFILE
+    motionCellsToGo = 0;
+#endif
+    return;
+#endif
+
     // Delay for a small period to allow the buggy to creep into the cell
-    FA_DelayMillis(400);
+    idleDelayMillis(CREEP_MS * MOTOR_SPEED / speed);
     FA_SetMotors(0, 0);
-    newCellEntered();
+    PROFILE_CALL(PROF_NEW_CELL, newCellEntered());
   }
 }
 
@@ -397,6 +1293,29 @@ void drive(){
   * (Some LED flashes and a buzzer sound)
 */
 void finish(){
+#ifdef LOW_POWER
+  unsigned long now;
+#endif
+
+#ifdef SENSE_LOG
+  // Send the end of the run's log
+  flushLog();
+#endif
+
+#ifdef LOW_POWER
+  // Sleep between switch polls, and flash the LEDs briefly rather than keeping all eight lit
+  now = FA_ClockMS();
+  powerLeds((now - finishStart) % FINISH_BLINK_MS < FINISH_BLINK_ON_MS);
+  if(now - powerPeriodStart >= POWER_REPORT_MS){
+    sendPower();
+  }
+  idleDelayMillis(FINISH_POLL_MS);
+#endif
+
+#ifdef UPLOAD
+  // A map or route can be uploaded for the next run whilst waiting
+  pollUpload();
+#endif
 
   // Wait for button press to restart the crawler
   if(FA_ReadSwitch(0) > 0 || FA_ReadSwitch(1) > 0){
@@ -404,6 +1323,51 @@ void finish(){
   }
 }
 
+/**
+  * A single iteration of the main loop, it checks the state of the
+  * system and invokes the relevant behaviour
+*/
+void runMainState(){
+#ifdef PROFILE
+  // Each iteration is timed against the state it started in
+  ProfileSlot loopSlot = (ProfileSlot)(PROF_LOOP_START + mainState);
+  unsigned long loopStart = profileCycles();
+#endif
+
+  // Check state and behave accordingly
+  switch(mainState){
+
+    case MAIN_START:
+      initialize();
+    break;
+
+    case MAIN_DETECT:
+      PROFILE_CALL(PROF_DETECT, detect());
+      PROFILE_CALL(PROF_AVOID_OBSTACLE, avoidObstacle());
+    break;
+
+    case MAIN_TURN:
+      PROFILE_CALL(PROF_TURN, turn());
+    break;
+
+    case MAIN_DRIVE:
+      PROFILE_CALL(PROF_DRIVE, drive());
+      PROFILE_CALL(PROF_AVOID_OBSTACLE, avoidObstacle());
+      idleDelayMillis(DRIVE_POLL_MS);
+    break;
+
+    case MAIN_FINISH:
+      finish();
+    break;
+  }
+
+#ifdef PROFILE
+  profileRecord(loopSlot, loopStart);
+#endif
+}
+
+// Host builds (simulation, replay) provide their own main() and drive runMainState()
+#ifndef HOST_BUILD
 /**
   * The main loop of the system, through each iteration it checks the state of the
   * system and invokes the relevant behaviour
@@ -416,33 +1380,9 @@ int main(){
 
   // Main Loop
   while(1){
-
-    // Check state and behave accordingly
-    switch(mainState){
-
-      case MAIN_START:
-        initialize();
-      break;
-
-      case MAIN_DETECT:
-        detect();
-        avoidObstacle();
-      break;
-
-      case MAIN_TURN:
-        turn();
-      break;
-
-      case MAIN_DRIVE:
-        drive();
-        avoidObstacle();
-      break;
-
-      case MAIN_FINISH:
-        finish();
-      break;
-    }
+    runMainState();
   }
 
   return 0;
 }
+#endif
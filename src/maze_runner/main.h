@@ -6,8 +6,41 @@
   * @version 1.0
 */
 
+#ifndef MAIN_H
+#define MAIN_H
+
+#include <stdbool.h>
+
 // Simpy comment out the below line to stop bluetooth debug transmissions
 #define DEBUG
+// Simply comment out the below line to stop recording sensor reads and commands
+// (host replays build with NO_SENSE_LOG as they consume a log rather than record one)
+#ifndef NO_SENSE_LOG
+#define SENSE_LOG
+#endif
+// Simply comment out the below line to stop timing the controller (see profile.h)
+#define PROFILE
+// Simply comment out the below line to re-sense the walls of every cell on every visit
+#define SKIP_KNOWN_CELLS
+// Simply comment out the below line to trust every wall reading rather than weighing up the evidence (see walls.h)
+#define WALL_CONFIDENCE
+// Simply comment out the below line to drive with equal motor speeds and stop-and-nudge corrections
+#define WALL_CENTRING
+// Simply comment out the below line to drive every cell at MOTOR_SPEED (needs SKIP_KNOWN_CELLS)
+// (the simulator can compare both by building with NO_SPEED_PROFILE)
+#ifndef NO_SPEED_PROFILE
+#define SPEED_PROFILE
+#endif
+// Simply comment out the below line to stop in every new cell to sense its walls rather than sensing them on the move
+#define SENSE_ON_MOVE
+// Simply comment out the below line to keep wall following rather than racing to the nest and back
+#define ROUTE_PLANNER
+// Simply comment out the below line to busy-wait in delays and whilst finished (see power.h)
+#define LOW_POWER
+// Simply comment out the below line to ignore maps and routes uploaded over bluetooth (needs ROUTE_PLANNER)
+#define UPLOAD
+// Simply comment out the below line to explore alone even when other buggies share their maps (needs UPLOAD)
+#define SHARE_MAP
 
 // Preprocessor constants for directions
 #define DIR_NORTH       0
@@ -16,8 +49,16 @@
 #define DIR_WEST        3
 
 // Size of the maze (4x4 by default)
+#ifndef SIZE_X
 #define SIZE_X          4
+#endif
+#ifndef SIZE_Y
 #define SIZE_Y          4
+#endif
+
+// The cell the buggy starts in, facing north, unless an uploaded map says otherwise
+#define START_X         1
+#define START_Y         0
 
 // Preprocessor constants for the Infra Red detectors
 #define IR_LEFT         0
@@ -33,30 +74,59 @@
   * SYSTEM CONSTANTS
 */
 // The IR reading distance to detect a wall
-const int WALL_DIST_THRESHOLD = 50;
+extern const int WALL_DIST_THRESHOLD;
 // The light level reading to mark cell as nest
-const int LIGHT_LEVEL_THRESHOLD = 200;
+extern const int LIGHT_LEVEL_THRESHOLD;
 // The line reading to mark a new cell
-const int CELL_LINE_THRESHOLD = 50;
-const int MOTOR_SPEED = 20;
-const int TURN_DEGREE = 85;
+extern const int CELL_LINE_THRESHOLD;
+extern const int MOTOR_SPEED;
+extern const int TURN_DEGREE;
 // The IR Reading threshold for reactive behaviour
-const int CRASH_THRESHOLD = 900;
+extern const int CRASH_THRESHOLD;
+// The number of times a cell's walls must have been sensed before they are trusted
+extern const int KNOWN_CELL_SENSES;
+// Wall centring controller: side IR reading when centred, gains (divided by CENTRE_GAIN_DIV),
+// largest speed trim, the control period and the fall in a side reading that marks a wall's end
+extern const int CENTRE_TARGET;
+extern const int CENTRE_KP;
+extern const int CENTRE_KD;
+extern const int CENTRE_GAIN_DIV;
+extern const int CENTRE_MAX_TRIM;
+extern const int CENTRE_PERIOD_MS;
+extern const int CENTRE_WALL_END_DIV;
+// Straight run speed profile: cruise speed, acceleration and deceleration limits (speed units per second)
+extern const int CRUISE_SPEED;
+extern const int MOTION_ACCEL;
+extern const int MOTION_DECEL;
+extern const int MOTION_PERIOD_MS;
+// Robot geometry: cell length, and mm/s travelled per unit of motor speed
+extern const int CELL_LENGTH_MM;
+extern const int SPEED_MM_PER_S;
+// How long the buggy creeps at MOTOR_SPEED from a cell's line into its middle
+extern const int CREEP_MS;
+// How often the side walls are sampled whilst sensing on the move
+extern const int SENSE_PERIOD_MS;
+// Pause between drive loop iterations, which bounds how fast driving fills the sensor log
+extern const int DRIVE_POLL_MS;
 // Maze Drawing Constants
-const int MAZE_DRAW_LENGTH = 28;
-const int MAZE_DRAW_WIDTH = 28;
-const int MAZE_DRAW_CELL_LENGTH = 7;
-const int MAZE_DRAW_CELL_WIDTH = 7;
+extern const int MAZE_DRAW_LENGTH;
+extern const int MAZE_DRAW_WIDTH;
+extern const int MAZE_DRAW_CELL_LENGTH;
+extern const int MAZE_DRAW_CELL_WIDTH;
 
 /**
   * SYSTEM INFO VARIABLES
 */
-int currentDirection = DIR_NORTH;
+extern int currentDirection;
 // 1 as default
-int currentPosX = 1;
-int currentPosY = 0;
+extern int currentPosX;
+extern int currentPosY;
 // The number of cells that the robot has visited
-int noVisitedCells = 0;
+extern int noVisitedCells;
+// The pose the run started from
+extern int startPosX;
+extern int startPosY;
+extern int startDirection;
 
 /**
   * STATE MACHINE SETUP
@@ -72,10 +142,24 @@ typedef enum{
 
 
 // The state machine variables
-MainState mainState;
+extern MainState mainState;
+
+// The phases of a run: wall following until the maze is explored, then planned routes.
+// When exploring with other buggies, planned routes also lead to unmapped cells
+typedef enum{
+  ROUTE_EXPLORE,
+  ROUTE_TO_NEST,
+  ROUTE_TO_START,
+  ROUTE_TO_FRONTIER,
+} RoutePhase;
+
+extern RoutePhase routePhase;
+// The heading wall following first left the cell it started from by, -1 until then
+extern int exploreFirstDirection;
 
 // State machine functions
 void changeMainState(MainState newState);
+void changeMainStateNow(MainState newState);
 
 /**
   * MAZE MODEL
@@ -88,14 +172,18 @@ typedef struct{
   bool visited;
   // Store the status of the walls for each cell (NORTH, EAST, SOUTH, WEST) - 0,1,2 and 3rd element of the Array
   bool walls[4];
+  // The number of times the walls have been sensed by detect()
+  unsigned char timesSensed;
+  // The evidence for each wall, with WALL_CONFIDENCE (see walls.h)
+  signed char wallEvidence[4];
 } Cell;
 
-// Create the 2D maze array and store pointers to the current cell
-Cell maze[SIZE_X][SIZE_Y];
+// The 2D maze array and pointers to the current cell
+extern Cell maze[SIZE_X][SIZE_Y];
 
 // The current cell of the robot and the nest cell (default null)
-Cell *currentCell;
-Cell *nestCell;
+extern Cell *currentCell;
+extern Cell *nestCell;
 
 
 /**
@@ -105,12 +193,37 @@ void initialize();
 void detect();
 void drive();
 void turn();
-void end();
+void finish();
 
 /**
   * Utility Functions
 */
 void avoidObstacle();
+bool wallFollowRepeats(int newDirection);
+bool explorationComplete(bool toFrontier);
+bool startRoute(int toX, int toY);
+void turnTimed(bool left, unsigned int angle);
+int chooseDirection(Cell *cell, int direction);
+Cell *neighbourCell(int x, int y, int direction);
+bool passThrough(Cell *cell, int direction, int ahead);
+int straightRunLength();
+void resetMotion();
+int motionSpeed();
+void resetCentring();
+void setCentredMotors(int speed, long trim);
+bool centreWall(int reading, int *lastReading, bool *ending);
+void driveCentred(int speed);
+bool cellKnown(Cell *cell);
+void advanceCell();
+void reportCells();
+void recordStop();
 void newCellEntered();
+void senseCell();
+void senseOnMove(int speed);
+int nextDirection();
+void turnTowards(int newDirection);
 void drawMaze();
 void printDebugStream();
+void runMainState();
+
+#endif
@@ -0,0 +1,300 @@
+/**
+  * Route planner
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include "allcode_api.h"
+#include "btframe.h"
+#include "planner.h"
+#include "walls.h"
+#include "share.h"
+
+// Starting costs (ms) until the robot has timed its own actions, as measured in the simulator
+// (run start, run cell, 90 degree turn, 180 degree turn, settle)
+#define DEFAULT_ACTION_COSTS    {1160, 900, 500, 1000, 500}
+
+static const unsigned int defaultActionCost[ACTIONS] = DEFAULT_ACTION_COSTS;
+
+// The model carries over from run to run, so it isn't reset by initialize()
+unsigned int actionCost[ACTIONS] = DEFAULT_ACTION_COSTS;
+unsigned int actionSamples[ACTIONS];
+
+unsigned char route[ROUTE_MAX];
+int routeLength = 0;
+int routeStep = 0;
+
+int frontierX, frontierY;
+int frontierFromX, frontierFromY, frontierFromDirection;
+
+// Search state for each (cell, heading) the buggy can be stopped in
+#define PLAN_STATES     (SIZE_X * SIZE_Y * 4)
+#define PLAN_UNREACHED  0xffffffffUL
+
+static unsigned long planCost[PLAN_STATES];
+static int planPrevious[PLAN_STATES];
+static bool planDone[PLAN_STATES];
+
+/**
+  * Go back to the default action costs
+*/
+void resetActionCosts(){
+  int i;
+
+  for(i = 0; i < ACTIONS; i++){
+    actionCost[i] = defaultActionCost[i];
+    actionSamples[i] = 0;
+  }
+}
+
+/**
+  * Fold a measured duration into an action's running average
+  * The first measurement replaces the default outright
+*/
+void recordAction(Action action, unsigned long ms){
+  long cost = actionCost[action];
+
+  if(ms > 60000UL){
+    return;
+  }
+
+  if(actionSamples[action] == 0){
+    cost = ms;
+  }else{
+    cost += ((long)ms - cost) / ACTION_COST_WEIGHT;
+  }
+  actionCost[action] = cost;
+  if(actionSamples[action] < 0xffff){
+    actionSamples[action]++;
+  }
+}
+
+static int planState(int x, int y, int direction){
+  return (x * SIZE_Y + y) * 4 + direction;
+}
+
+/**
+  * Check whether the buggy can drive from a known cell into the next one
+  * Both cells must have been sensed, and neither may have seen a wall between them.
+  * With WALL_CONFIDENCE a cell still in doubt counts too, by its best guess, as the
+  * buggy stops there to sense it again.
+*/
+static bool planOpen(int x, int y, int direction){
+  Cell *next = neighbourCell(x, y, direction);
+
+#ifdef WALL_CONFIDENCE
+  return next != 0 && maze[x][y].visited && next->visited
+    && !maze[x][y].walls[direction] && !next->walls[(direction + 2) % 4];
+#else
+  return next != 0 && cellKnown(&maze[x][y]) && cellKnown(next)
+    && !maze[x][y].walls[direction] && !next->walls[(direction + 2) % 4];
+#endif
+}
+
+/**
+  * Relax the cost of reaching a state
+*/
+static void planReach(int state, unsigned long cost, int from){
+  if(!planDone[state] && cost < planCost[state]){
+    planCost[state] = cost;
+    planPrevious[state] = from;
+  }
+}
+
+/**
+  * Plan the quickest route from a cell, stopped facing fromDirection, to another cell.
+  * Dijkstra's algorithm over (cell, heading): turning costs a turn, and driving a
+  * straight run of n cells costs a start, n-1 run cells and a stop to settle.
+  * Without SPEED_PROFILE the buggy stops in every cell, so runs are one cell long.
+  * Fills route[] and returns the route's cost in ms, or -1 if the goal can't be reached.
+*/
+long planRoute(int fromX, int fromY, int fromDirection, int toX, int toY){
+  int i, state, best, x, y, direction, turn, run, next, count;
+  unsigned long cost;
+  static int path[PLAN_STATES];
+
+  for(i = 0; i < PLAN_STATES; i++){
+    planCost[i] = PLAN_UNREACHED;
+    planPrevious[i] = -1;
+    planDone[i] = false;
+  }
+  planCost[planState(fromX, fromY, fromDirection)] = 0;
+
+  while(1){
+    // Take the cheapest state not yet finished (the maze is small enough to scan)
+    best = -1;
+    for(i = 0; i < PLAN_STATES; i++){
+      if(!planDone[i] && planCost[i] != PLAN_UNREACHED && (best < 0 || planCost[i] < planCost[best])){
+        best = i;
+      }
+    }
+    if(best < 0){
+      return -1;
+    }
+    planDone[best] = true;
+
+    direction = best % 4;
+    x = best / 4 / SIZE_Y;
+    y = best / 4 % SIZE_Y;
+    if(x == toX && y == toY){
+      break;
+    }
+
+    // Turn on the spot
+    for(turn = 1; turn <= 3; turn++){
+      cost = planCost[best] + actionCost[turn == 2 ? ACTION_TURN_180 : ACTION_TURN_90];
+      planReach(planState(x, y, (direction + turn) % 4), cost, best);
+    }
+
+    // Drive straight on, one cell or (with the speed profile) several
+    cost = planCost[best] + actionCost[ACTION_RUN_START] + actionCost[ACTION_SETTLE];
+    for(run = 1; planOpen(x, y, direction); run++){
+      switch(direction){
+        case DIR_NORTH: y++; break;
+        case DIR_EAST:  x++; break;
+        case DIR_SOUTH: y--; break;
+        case DIR_WEST:  x--; break;
+      }
+      if(run > 1){
+        cost += actionCost[ACTION_RUN_CELL];
+      }
+      planReach(planState(x, y, direction), cost, best);
+#ifndef SPEED_PROFILE
+      break;
+#endif
+#ifdef WALL_CONFIDENCE
+      // The run ends in a cell in doubt
+      if(cellInDoubt(&maze[x][y])){
+        break;
+      }
+#endif
+    }
+  }
+
+  // Walk back from the goal, then lay the route out forwards one heading per cell moved
+  count = 0;
+  for(state = best; state >= 0; state = planPrevious[state]){
+    path[count++] = state;
+  }
+
+  routeLength = 0;
+  routeStep = 0;
+  for(i = count - 1; i > 0; i--){
+    state = path[i];
+    next = path[i - 1];
+    if(next / 4 == state / 4){
+      // A turn; the heading of the following run is what counts
+      continue;
+    }
+    // Cells moved along the run: the change in whichever of x or y it runs along
+    run = next / 4 / SIZE_Y - state / 4 / SIZE_Y + next / 4 % SIZE_Y - state / 4 % SIZE_Y;
+    if(run < 0){
+      run = -run;
+    }
+    while(run-- > 0 && routeLength < ROUTE_MAX){
+      route[routeLength++] = next % 4;
+    }
+  }
+
+  return planCost[best];
+}
+
+/**
+  * Forget the unmapped cell last found, at the start of a run: the start cell
+  * stands in until the first search, so that search isn't put off
+*/
+void resetFrontier(){
+  frontierX = START_X;
+  frontierY = START_Y;
+}
+
+/**
+  * Check whether another buggy is heading for a cell
+*/
+static bool frontierClaimed(int x, int y){
+#ifdef SHARE_MAP
+  return shareIsClaimed(x, y);
+#else
+  return false;
+#endif
+}
+
+/**
+  * Find the nearest unmapped cell that can be reached through the known maze, preferring
+  * ones no other buggy has claimed, searching breadth first with the left hand rule's
+  * order of headings. Sets frontier and frontierFrom, returning false if there is none.
+*/
+bool findFrontier(){
+  static int queue[SIZE_X * SIZE_Y];
+  static bool seen[SIZE_X][SIZE_Y];
+  int head = 0, tail = 0, turn, direction, x, y, nx, ny;
+  bool found = false;
+  Cell *next;
+
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      seen[x][y] = false;
+    }
+  }
+  seen[currentPosX][currentPosY] = true;
+  queue[tail++] = currentPosX * SIZE_Y + currentPosY;
+
+  while(head < tail){
+    x = queue[head] / SIZE_Y;
+    y = queue[head++] % SIZE_Y;
+
+    // Left, forward, right, then back
+    for(turn = 3; turn <= 6; turn++){
+      direction = (currentDirection + turn) % 4;
+      next = neighbourCell(x, y, direction);
+      if(next == 0 || maze[x][y].walls[direction]){
+        continue;
+      }
+      nx = (next - &maze[0][0]) / SIZE_Y;
+      ny = (next - &maze[0][0]) % SIZE_Y;
+
+      if(!cellKnown(next)){
+        // The first unclaimed cell found is the nearest; else fall back on the nearest claimed one
+        if(!found || (frontierClaimed(frontierX, frontierY) && !frontierClaimed(nx, ny))){
+          frontierX = nx;
+          frontierY = ny;
+          frontierFromX = x;
+          frontierFromY = y;
+          frontierFromDirection = direction;
+          found = true;
+          if(!frontierClaimed(nx, ny)){
+            return true;
+          }
+        }
+      }else if(!seen[nx][ny] && !next->walls[(direction + 2) % 4]){
+        seen[nx][ny] = true;
+        queue[tail++] = nx * SIZE_Y + ny;
+      }
+    }
+  }
+
+  return found;
+}
+
+/**
+  * Send the action cost model over bluetooth if connected
+  * Frame body: FRAME_COSTS, action count, then per action the cost (ms) and
+  * sample count, 2 bytes each, little endian
+*/
+void sendActionCosts(){
+  unsigned char body[2 + ACTIONS * 4];
+  int i, length = 0;
+
+  if(!FA_BTConnected()){
+    return;
+  }
+
+  body[length++] = FRAME_COSTS;
+  body[length++] = ACTIONS;
+  for(i = 0; i < ACTIONS; i++){
+    body[length++] = actionCost[i] & 0xff;
+    body[length++] = (actionCost[i] >> 8) & 0xff;
+    body[length++] = actionSamples[i] & 0xff;
+    body[length++] = (actionSamples[i] >> 8) & 0xff;
+  }
+  sendFrame(body, length);
+}
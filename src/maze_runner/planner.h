@@ -0,0 +1,58 @@
+/**
+  * Route planner
+  * Finds the quickest route between two cells through the known part of the maze.
+  * Routes are costed in milliseconds from running averages of how long the buggy
+  * has been measured to take over each kind of action, so a route with fewer stops
+  * and turns wins over one with fewer cells.
+  * It also finds the nearest unmapped cell to explore next (findFrontier()), for a
+  * buggy whose wall following would only repeat itself or that is sharing a map.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include "main.h"
+
+// Longest route that can be followed, in cells moved
+#define ROUTE_MAX       (SIZE_X * SIZE_Y * 2)
+
+// Weight given to each new measurement in the running averages, as 1/ACTION_COST_WEIGHT
+#define ACTION_COST_WEIGHT  4
+
+// The timed actions that make up a route
+typedef enum{
+  // Setting off from a cell and stopping in the next one
+  ACTION_RUN_START,
+  // Each further cell driven through on the same straight run
+  ACTION_RUN_CELL,
+  // Turning on the spot
+  ACTION_TURN_90,
+  ACTION_TURN_180,
+  // Stopped in a known cell until setting off again, less any turn
+  ACTION_SETTLE,
+  ACTIONS,
+} Action;
+
+// Running average duration (ms) of each action and how many times it has been measured
+extern unsigned int actionCost[ACTIONS];
+extern unsigned int actionSamples[ACTIONS];
+
+// The planned route: the heading to leave each cell by, starting with the cell planned from
+extern unsigned char route[ROUTE_MAX];
+extern int routeLength;
+// The route's cell the buggy is in
+extern int routeStep;
+
+// The unmapped cell found by findFrontier(), the known cell next to it and the heading between
+extern int frontierX, frontierY;
+extern int frontierFromX, frontierFromY, frontierFromDirection;
+
+void resetActionCosts();
+void recordAction(Action action, unsigned long ms);
+long planRoute(int fromX, int fromY, int fromDirection, int toX, int toY);
+void sendActionCosts();
+void resetFrontier();
+bool findFrontier();
+
+#endif
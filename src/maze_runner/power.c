@@ -0,0 +1,186 @@
+/**
+  * Low power waiting
+  * Doesn't include senselog.h: waits are recorded by its logIdleDelayMillis() wrapper,
+  * and the clock reads here are for accounting only so mustn't appear in the log
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifdef __XC16__
+#include <xc.h>
+#endif
+
+#include "allcode_api.h"
+#ifdef HOST_BUILD
+#include "host.h"
+#endif
+#include "btframe.h"
+#include "power.h"
+
+unsigned long powerPeriodStart = 0;
+unsigned long powerIdleMs = 0;
+unsigned long powerLedMs = 0;
+
+// Whether the LEDs are lit (by powerLeds()) and since when
+static bool powerLedsOn = false;
+static unsigned long powerLedsSince = 0;
+
+/**
+  * The time in ms, read without going through the sensor log (see senselog.h)
+  * Host builds read the virtual clock directly, as the backend's clock may be replaying a log
+*/
+static unsigned long powerNow(){
+#ifdef HOST_BUILD
+  return hostClockMs;
+#else
+  return FA_ClockMS();
+#endif
+}
+
+#if defined(__XC16__) && defined(LOW_POWER)
+/**
+  * Timer7 only has to bring the CPU out of Idle, so its interrupt just acknowledges
+*/
+void __attribute__((__interrupt__, no_auto_psv)) _T7Interrupt(void){
+  IFS3bits.T7IF = 0;
+}
+#endif
+
+/**
+  * Start a new reporting period (and on the robot, the Timer7 wake up tick)
+*/
+void powerReset(){
+  powerPeriodStart = powerNow();
+  powerIdleMs = 0;
+  powerLedMs = 0;
+  // Called once the LEDs have been turned off
+  powerLedsOn = false;
+  powerLedsSince = powerPeriodStart;
+
+#if defined(__XC16__) && defined(LOW_POWER)
+  // 1:64 prescale of Fcy (70 MHz), interrupting every IDLE_TICK_MS
+  T7CON = 0;
+  T7CONbits.TCKPS = 2;
+  TMR7 = 0;
+  PR7 = (unsigned int)(70000000UL / 64 / 1000 * IDLE_TICK_MS) - 1;
+  IFS3bits.T7IF = 0;
+  IPC12bits.T7IP = 1;
+  IEC3bits.T7IE = 1;
+  T7CONbits.TON = 1;
+#endif
+}
+
+/**
+  * Wait for the given time, sleeping the CPU between timer ticks with LOW_POWER,
+  * otherwise spinning in FA_DelayMillis()
+*/
+void idleDelayMillis(unsigned int ms){
+#ifdef LOW_POWER
+#ifdef __XC16__
+  unsigned long start = FA_ClockMS();
+
+  // Any interrupt wakes the CPU, so check the time after each and go back to sleep
+  while(FA_ClockMS() - start < ms){
+    Idle();
+  }
+#else
+  FA_DelayMillis(ms);
+#endif
+  powerIdleMs += ms;
+#else
+  FA_DelayMillis(ms);
+#endif
+}
+
+/**
+  * Turn all eight front LEDs on or off, totalling how long they are lit
+*/
+void powerLeds(bool on){
+  int i;
+  unsigned long now = powerNow();
+
+  if(on == powerLedsOn){
+    return;
+  }
+  if(powerLedsOn){
+    powerLedMs += (now - powerLedsSince) * 8;
+  }
+  powerLedsOn = on;
+  powerLedsSince = now;
+
+  for(i = 0; i < 8; i++){
+    if(on){
+      FA_LEDOn(i);
+    }else{
+      FA_LEDOff(i);
+    }
+  }
+}
+
+/**
+  * Estimate the mean supply current (tenths of a mA) over the period so far from
+  * the share of it spent idle and the LED on-time. Motor current isn't included.
+*/
+unsigned int powerEstimate(){
+  unsigned long now = powerNow();
+  unsigned long elapsed = now - powerPeriodStart;
+  unsigned long idle = powerIdleMs < elapsed ? powerIdleMs : elapsed;
+  unsigned long led = powerLedMs;
+  unsigned long long charge;
+
+  if(elapsed == 0){
+    return 0;
+  }
+  if(powerLedsOn){
+    led += (now - powerLedsSince) * 8;
+  }
+
+  // mA ms, then back to tenths of a mA
+  charge = (unsigned long long)(elapsed - idle) * POWER_AWAKE_MA
+    + (unsigned long long)idle * POWER_IDLE_MA
+    + (unsigned long long)led * POWER_LED_MA;
+  return (unsigned int)(charge * 10 / elapsed);
+}
+
+/**
+  * Send the period's power telemetry over bluetooth if connected, then start a new period
+  * Frame body: FRAME_POWER, period, idle and LED ms (4 bytes each), battery reading and
+  * estimated current in tenths of a mA (2 bytes each), little endian
+*/
+void sendPower(){
+  unsigned char body[17];
+  unsigned long now = powerNow();
+  unsigned long values[3];
+  unsigned int battery, current;
+  int i, length = 0;
+
+  if(!FA_BTConnected()){
+    return;
+  }
+
+  current = powerEstimate();
+  battery = FA_ReadBattery();
+  if(powerLedsOn){
+    powerLedMs += (now - powerLedsSince) * 8;
+    powerLedsSince = now;
+  }
+  values[0] = now - powerPeriodStart;
+  values[1] = powerIdleMs;
+  values[2] = powerLedMs;
+
+  body[length++] = FRAME_POWER;
+  for(i = 0; i < 3; i++){
+    body[length++] = values[i] & 0xff;
+    body[length++] = (values[i] >> 8) & 0xff;
+    body[length++] = (values[i] >> 16) & 0xff;
+    body[length++] = (values[i] >> 24) & 0xff;
+  }
+  body[length++] = battery & 0xff;
+  body[length++] = (battery >> 8) & 0xff;
+  body[length++] = current & 0xff;
+  body[length++] = (current >> 8) & 0xff;
+  sendFrame(body, length);
+
+  powerPeriodStart = now;
+  powerIdleMs = 0;
+  powerLedMs = 0;
+}
@@ -0,0 +1,42 @@
+/**
+  * Low power waiting
+  * With LOW_POWER defined, waits put the CPU in Idle (peripherals, the motor PWM and
+  * bluetooth keep running) until the next Timer7 tick rather than spinning in
+  * FA_DelayMillis(). Time spent idle and awake, and LED on-time, are totalled so that
+  * the supply current can be estimated and sent over bluetooth as telemetry.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef POWER_H
+#define POWER_H
+
+#include "main.h"
+
+// Timer7 wakes the CPU from Idle this often (ms)
+#define IDLE_TICK_MS        1
+// Whilst finished, how often the switches are polled (ms)
+#define FINISH_POLL_MS      50
+// Whilst finished, the LEDs flash on for FINISH_BLINK_ON_MS every FINISH_BLINK_MS
+#define FINISH_BLINK_MS     2000
+#define FINISH_BLINK_ON_MS  50
+// How often power telemetry is sent whilst finished (ms)
+#define POWER_REPORT_MS     10000
+
+// Supply current (mA) with the CPU running and idle, motors stopped, and per LED lit.
+// Estimates from the dsPIC33EP and LED datasheets; calibrate against a meter.
+#define POWER_AWAKE_MA      95
+#define POWER_IDLE_MA       60
+#define POWER_LED_MA        4
+
+// Totals since the last report: elapsed, idle, and LED on-time (ms per LED lit)
+extern unsigned long powerPeriodStart;
+extern unsigned long powerIdleMs;
+extern unsigned long powerLedMs;
+
+void powerReset();
+void idleDelayMillis(unsigned int ms);
+void powerLeds(bool on);
+unsigned int powerEstimate();
+void sendPower();
+
+#endif
@@ -0,0 +1,135 @@
+/**
+  * Controller profiling
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifdef __XC16__
+#include <xc.h>
+#endif
+#ifdef HOST_BUILD
+#include <time.h>
+#endif
+
+#include "allcode_api.h"
+#include "btframe.h"
+#include "profile.h"
+
+ProfileStat profileStats[PROF_SLOTS];
+unsigned long profileCalls[LOG_STATE + 1];
+unsigned long profileDelayMs = 0;
+unsigned int profileCells = 0;
+
+/**
+  * Clear all results and (re)start the timer
+  * On the robot Timer8/9 run as one 32 bit timer at the instruction clock,
+  * wrapping every ~61s which is far longer than anything timed.
+*/
+void profileReset(){
+  int i;
+
+  for(i = 0; i < PROF_SLOTS; i++){
+    profileStats[i].count = 0;
+    profileStats[i].min = 0xffffffffUL;
+    profileStats[i].max = 0;
+    profileStats[i].total = 0;
+  }
+  for(i = 0; i <= LOG_STATE; i++){
+    profileCalls[i] = 0;
+  }
+  profileDelayMs = 0;
+  profileCells = 0;
+
+#ifdef __XC16__
+  T8CON = 0;
+  T9CON = 0;
+  T8CONbits.T32 = 1;
+  T8CONbits.TCKPS = 0;
+  TMR9 = 0;
+  TMR8 = 0;
+  PR9 = 0xffff;
+  PR8 = 0xffff;
+  T8CONbits.TON = 1;
+#endif
+}
+
+/**
+  * Read the free running timer
+*/
+unsigned long profileCycles(){
+#ifdef __XC16__
+  // Reading TMR8 latches the upper word into TMR9HLD
+  unsigned long low = TMR8;
+  return ((unsigned long)TMR9HLD << 16) | low;
+#elif defined(HOST_BUILD)
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long)now.tv_sec * 1000000000UL + now.tv_nsec;
+#else
+  return 0;
+#endif
+}
+
+/**
+  * Add the time since start to a slot
+*/
+void profileRecord(ProfileSlot slot, unsigned long start){
+  unsigned long cycles = profileCycles() - start;
+  ProfileStat *stat = &profileStats[slot];
+
+  stat->count++;
+  stat->total += cycles;
+  if(cycles < stat->min){
+    stat->min = cycles;
+  }
+  if(cycles > stat->max){
+    stat->max = cycles;
+  }
+}
+
+/**
+  * Append a 32 bit little endian value to a frame body
+*/
+static int put32(unsigned char *body, int length, unsigned long value){
+  body[length++] = value & 0xff;
+  body[length++] = (value >> 8) & 0xff;
+  body[length++] = (value >> 16) & 0xff;
+  body[length++] = (value >> 24) & 0xff;
+  return length;
+}
+
+/**
+  * Send the results over bluetooth if connected
+  * One FRAME_PROFILE per slot: slot, cycles per us (2 bytes), count, min, max, total (low, high)
+  * then one FRAME_COUNTS: delay ms, cells entered, and the call count for each LogKind
+*/
+void sendProfile(){
+  unsigned char body[8 + (LOG_STATE + 1) * 4];
+  int i, length;
+
+  if(!FA_BTConnected()){
+    return;
+  }
+
+  for(i = 0; i < PROF_SLOTS; i++){
+    body[0] = FRAME_PROFILE;
+    body[1] = i;
+    body[2] = PROFILE_CYCLES_PER_US & 0xff;
+    body[3] = (PROFILE_CYCLES_PER_US >> 8) & 0xff;
+    length = put32(body, 4, profileStats[i].count);
+    length = put32(body, length, profileStats[i].count ? profileStats[i].min : 0);
+    length = put32(body, length, profileStats[i].max);
+    length = put32(body, length, (unsigned long)profileStats[i].total);
+    length = put32(body, length, (unsigned long)(profileStats[i].total >> 32));
+    sendFrame(body, length);
+  }
+
+  body[0] = FRAME_COUNTS;
+  length = put32(body, 1, profileDelayMs);
+  body[length++] = profileCells & 0xff;
+  body[length++] = (profileCells >> 8) & 0xff;
+  body[length++] = LOG_STATE + 1;
+  for(i = 0; i <= LOG_STATE; i++){
+    length = put32(body, length, profileCalls[i]);
+  }
+  sendFrame(body, length);
+}
@@ -0,0 +1,75 @@
+/**
+  * Controller profiling
+  * Times the behavioural functions and each iteration of the main loop (per MainState)
+  * with a free running hardware timer, keeping min/mean/max cycle counts, and counts
+  * API calls by kind. Results are sent over bluetooth as frames for src/host/profview.c.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "main.h"
+#include "senselog.h"
+
+// Timer counts per microsecond (Fcy = 70 MHz on the robot, nanoseconds on a host)
+#ifdef HOST_BUILD
+#define PROFILE_CYCLES_PER_US   1000
+#else
+#define PROFILE_CYCLES_PER_US   70
+#endif
+
+// Send the results over bluetooth at the first stop after every this many cells entered (and on finishing)
+#define PROFILE_REPORT_CELLS    8
+
+// Timed code. The first five are main loop iterations in each MainState
+typedef enum{
+  PROF_LOOP_START,
+  PROF_LOOP_DETECT,
+  PROF_LOOP_TURN,
+  PROF_LOOP_DRIVE,
+  PROF_LOOP_FINISH,
+  PROF_DETECT,
+  PROF_TURN,
+  PROF_DRIVE,
+  PROF_AVOID_OBSTACLE,
+  PROF_NEW_CELL,
+  PROF_DRAW_MAZE,
+  PROF_DEBUG_STREAM,
+  PROF_SLOTS,
+} ProfileSlot;
+
+typedef struct{
+  unsigned long count;
+  unsigned long min;
+  unsigned long max;
+  unsigned long long total;
+} ProfileStat;
+
+extern ProfileStat profileStats[PROF_SLOTS];
+// API calls of each LogKind since the last reset
+extern unsigned long profileCalls[LOG_STATE + 1];
+// Milliseconds spent in FA_DelayMillis since the last reset
+extern unsigned long profileDelayMs;
+// Cells entered since the last reset
+extern unsigned int profileCells;
+
+void profileReset();
+unsigned long profileCycles();
+void profileRecord(ProfileSlot slot, unsigned long start);
+void sendProfile();
+
+/**
+  * Time a call into the given slot
+*/
+#ifdef PROFILE
+#define PROFILE_CALL(slot, call) do{ \
+    unsigned long profileStart = profileCycles(); \
+    call; \
+    profileRecord(slot, profileStart); \
+  }while(0)
+#else
+#define PROFILE_CALL(slot, call) call
+#endif
+
+#endif
@@ -0,0 +1,267 @@
+/**
+  * Sensor log
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#define SENSELOG_IMPL
+#include "allcode_api.h"
+#include "btframe.h"
+#include "senselog.h"
+#include "profile.h"
+#include "power.h"
+#include "share.h"
+
+// The ring buffer of entries recorded but not yet sent
+LogEntry logBuffer[LOG_SIZE];
+unsigned int logNext = 0;
+unsigned int logSent = 0;
+unsigned long logDropped = 0;
+unsigned int logGap = 0;
+bool logRecording = false;
+
+static void sendLogFrame();
+
+/**
+  * Empty the log, ready for a new run
+*/
+void resetLog(){
+  logNext = 0;
+  logSent = 0;
+  logDropped = 0;
+  logGap = 0;
+  logRecording = true;
+}
+
+/**
+  * Add an entry to the buffer, which must have room for it
+*/
+static void append(LogKind kind, unsigned char channel, int value){
+  LogEntry *entry;
+
+  entry = &logBuffer[logNext % LOG_SIZE];
+  // A clock read is its own timestamp, so a replay can take one from the other
+  entry->time = (kind == LOG_CLOCK ? (unsigned int)value : (unsigned int)FA_ClockMS()) & 0xffff;
+  entry->kind = kind;
+  entry->channel = channel;
+  entry->value = value;
+  logNext++;
+}
+
+/**
+  * Check whether to send a frame as the buffer fills rather than waiting for a stop:
+  * not while sharing a map, as the link can't carry the log as fast as driving fills it,
+  * and cells shared with other buggies mustn't queue behind it (nor can shared runs be replayed)
+*/
+static bool logStreaming(){
+#ifdef SHARE_MAP
+  if(shareActive){
+    return false;
+  }
+#endif
+  return FA_BTConnected();
+}
+
+/**
+  * Record an entry, sending a frame first if the buffer is nearly full. If it is full
+  * all the same, the entry is dropped rather than overwriting, as a replay needs the run
+  * from its beginning; a LOG_GAP entry then says how many went before the next one kept.
+*/
+static void record(LogKind kind, unsigned char channel, int value){
+#ifdef PROFILE
+  profileCalls[kind]++;
+#endif
+
+  if(!logRecording){
+    return;
+  }
+
+  if(logNext - logSent >= LOG_SEND_ENTRIES && logStreaming()){
+    sendLogFrame();
+  }
+
+  // Room for the entry, and for the gap entry before it if any were dropped
+  if(logNext - logSent >= LOG_SIZE - (logGap > 0 ? 1 : 0)){
+    logDropped++;
+    if(logGap < LOG_GAP_MAX){
+      logGap++;
+    }
+    return;
+  }
+
+  if(logGap > 0){
+    append(LOG_GAP, 0, logGap);
+    logGap = 0;
+  }
+  append(kind, channel, value);
+}
+
+/**
+  * Record a state change. The run ends at MAIN_FINISH, so recording stops there
+  * instead of filling the buffer with switch polling.
+*/
+void logState(MainState state){
+  record(LOG_STATE, 0, state);
+  if(state == MAIN_FINISH){
+    logRecording = false;
+  }
+}
+
+/**
+  * Pack an entry into a frame body (see senselog.h), given the time of the entry before
+  * it in the frame, or -1 for the first. Returns the number of bytes written
+*/
+static int packEntry(unsigned char *body, const LogEntry *entry, long lastTime){
+  unsigned int since = (entry->time - (unsigned int)lastTime) & 0xffff;
+  int length = 0;
+
+  if(lastTime < 0 || since >= LOG_TIME_ABS){
+    body[length++] = entry->kind << 4 | LOG_TIME_ABS;
+    body[length++] = entry->time & 0xff;
+    body[length++] = (entry->time >> 8) & 0xff;
+  }else{
+    body[length++] = entry->kind << 4 | since;
+  }
+
+  switch(entry->kind){
+    case LOG_CLOCK:
+    break;
+    case LOG_IR:
+    case LOG_LINE:
+    case LOG_LIGHT:
+    case LOG_SWITCH:
+      body[length++] = entry->value & 0xff;
+      body[length++] = (entry->channel << 4) | ((entry->value >> 8) & 0x0f);
+    break;
+    case LOG_MOTORS:
+      body[length++] = entry->channel;
+      body[length++] = entry->value & 0xff;
+    break;
+    default:
+      body[length++] = entry->value & 0xff;
+      body[length++] = (entry->value >> 8) & 0xff;
+    break;
+  }
+  return length;
+}
+
+/**
+  * Send the oldest waiting entries, up to a frame's worth
+  * Frame body: FRAME_LOG, index of first entry (2 bytes, little endian), entry count,
+  * then the entries packed by packEntry()
+*/
+static void sendLogFrame(){
+  unsigned char body[4 + LOG_FRAME_ENTRIES * LOG_PACKED_MAX];
+  LogEntry *entry;
+  long lastTime = -1;
+  int count, length;
+
+  count = logNext - logSent;
+  if(count > LOG_FRAME_ENTRIES){
+    count = LOG_FRAME_ENTRIES;
+  }
+
+  body[0] = FRAME_LOG;
+  body[1] = logSent & 0xff;
+  body[2] = (logSent >> 8) & 0xff;
+  body[3] = count;
+  length = 4;
+
+  while(count-- > 0){
+    entry = &logBuffer[logSent % LOG_SIZE];
+    length += packEntry(&body[length], entry, lastTime);
+    lastTime = entry->time;
+    logSent++;
+  }
+
+  sendFrame(body, length);
+}
+
+/**
+  * Send all recorded entries over bluetooth if connected
+*/
+void flushLog(){
+  if(!FA_BTConnected()){
+    return;
+  }
+
+  while(logSent != logNext){
+    sendLogFrame();
+  }
+}
+
+/**
+  * API wrappers, each performs the call then records it
+*/
+unsigned int logReadIR(unsigned char channel){
+  unsigned int value = FA_ReadIR(channel);
+  record(LOG_IR, channel, value);
+  return value;
+}
+
+unsigned int logReadLine(unsigned char channel){
+  unsigned int value = FA_ReadLine(channel);
+  record(LOG_LINE, channel, value);
+  return value;
+}
+
+unsigned int logReadLight(){
+  unsigned int value = FA_ReadLight();
+  record(LOG_LIGHT, 0, value);
+  return value;
+}
+
+unsigned char logReadSwitch(unsigned char sw){
+  unsigned char value = FA_ReadSwitch(sw);
+  record(LOG_SWITCH, sw, value);
+  return value;
+}
+
+unsigned long logClockMS(){
+  unsigned long value = FA_ClockMS();
+  record(LOG_CLOCK, 0, (int)(value & 0xffff));
+  return value;
+}
+
+void logSetMotors(unsigned char left, unsigned char right){
+  record(LOG_MOTORS, left, right);
+  FA_SetMotors(left, right);
+}
+
+void logForwards(unsigned int distance){
+  record(LOG_FORWARDS, 0, distance);
+  FA_Forwards(distance);
+}
+
+void logBackwards(unsigned int distance){
+  record(LOG_BACKWARDS, 0, distance);
+  FA_Backwards(distance);
+}
+
+void logLeft(unsigned int angle){
+  record(LOG_LEFT, 0, angle);
+  FA_Left(angle);
+}
+
+void logRight(unsigned int angle){
+  record(LOG_RIGHT, 0, angle);
+  FA_Right(angle);
+}
+
+void logDelayMillis(unsigned int ms){
+  record(LOG_DELAY, 0, ms);
+#ifdef PROFILE
+  profileDelayMs += ms;
+#endif
+  FA_DelayMillis(ms);
+}
+
+/**
+  * Recorded as a delay, so a host replay (where it is an FA_DelayMillis()) sees the same wait
+*/
+void logIdleDelayMillis(unsigned int ms){
+  record(LOG_DELAY, 0, ms);
+#ifdef PROFILE
+  profileDelayMs += ms;
+#endif
+  idleDelayMillis(ms);
+}
@@ -0,0 +1,118 @@
+/**
+  * Sensor log
+  * Records every sensor read and actuator command with a timestamp into a RAM
+  * buffer, which is streamed out over bluetooth in frames so that a run can be
+  * replayed through the same state machine on a host (see src/host/replay.c).
+  * The buffer is sent at each stop, and a frame at a time whenever it is nearly
+  * full, as driving fills it many times over between stops. Entries are packed (see
+  * LOG_TIME_ABS) and the drive loop paced (DRIVE_POLL_MS) so that driving logs less
+  * than the link carries, the main loop waiting on the link only when a stop's debug
+  * output is still going out. With other buggies sharing the link (share.h) the log is
+  * only sent at stops.
+  * Entries that don't fit are dropped and marked by a LOG_GAP entry.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef SENSELOG_H
+#define SENSELOG_H
+
+#include "main.h"
+#include "btframe.h"
+
+// Number of entries held in RAM while waiting to be sent (6 bytes each)
+#define LOG_SIZE        256
+// Most entries sent in a single bluetooth frame
+#define LOG_FRAME_ENTRIES 32
+// A frame is sent as soon as this many entries are waiting, rather than waiting for a stop
+#define LOG_SEND_ENTRIES  (LOG_SIZE - LOG_FRAME_ENTRIES)
+// The most dropped entries one LOG_GAP entry counts, as its value is a signed 16 bit number
+#define LOG_GAP_MAX       0x7fff
+
+// Entries are packed to be sent, as driving logs several thousand a second. Each starts with
+// its kind in the top 4 bits of a byte and in the bottom 4 the ms since the entry before in
+// the frame, or LOG_TIME_ABS then the time's low 16 bits (always so for the first entry).
+// Then a read (IR, line, light, switch) has the channel in the top 4 bits of 16 and the
+// value in the bottom 12, LOG_MOTORS the left and right speeds, a clock read nothing (its
+// value is its time) and anything else its value in 16 bits, all little endian.
+#define LOG_TIME_ABS      15
+// Most bytes a packed entry takes
+#define LOG_PACKED_MAX    5
+
+#if 4 + LOG_FRAME_ENTRIES * LOG_PACKED_MAX > FRAME_MAX_LEN
+#error "A frame of log entries won't fit in FRAME_MAX_LEN"
+#endif
+
+// The kinds of log entry
+typedef enum{
+  LOG_IR,
+  LOG_LINE,
+  LOG_LIGHT,
+  LOG_SWITCH,
+  LOG_CLOCK,
+  LOG_MOTORS,
+  LOG_FORWARDS,
+  LOG_BACKWARDS,
+  LOG_LEFT,
+  LOG_RIGHT,
+  LOG_DELAY,
+  LOG_STATE,
+  // Not an API call: entries were dropped here, value is how many (at most LOG_GAP_MAX)
+  LOG_GAP,
+} LogKind;
+
+typedef struct{
+  // Low 16 bits of FA_ClockMS() when the entry was recorded
+  unsigned int time;
+  unsigned char kind;
+  // Sensor channel, or the left motor speed for LOG_MOTORS
+  unsigned char channel;
+  // Value read, or the command's argument
+  int value;
+} LogEntry;
+
+// Index of the next entry to record (entries are numbered from the start of the run)
+extern unsigned int logNext;
+// Index of the oldest entry not yet sent
+extern unsigned int logSent;
+// Entries lost because the buffer was full, in all and since the last LOG_GAP entry
+extern unsigned long logDropped;
+extern unsigned int logGap;
+// Whether reads and commands are being recorded (stops once the run has finished)
+extern bool logRecording;
+
+void resetLog();
+void logState(MainState state);
+void flushLog();
+
+unsigned int logReadIR(unsigned char channel);
+unsigned int logReadLine(unsigned char channel);
+unsigned int logReadLight();
+unsigned char logReadSwitch(unsigned char sw);
+unsigned long logClockMS();
+void logSetMotors(unsigned char left, unsigned char right);
+void logForwards(unsigned int distance);
+void logBackwards(unsigned int distance);
+void logLeft(unsigned int angle);
+void logRight(unsigned int angle);
+void logDelayMillis(unsigned int ms);
+void logIdleDelayMillis(unsigned int ms);
+
+/**
+  * Route the controller's API calls through the log
+*/
+#if (defined(SENSE_LOG) || defined(PROFILE)) && !defined(SENSELOG_IMPL)
+#define FA_ReadIR(channel)          logReadIR(channel)
+#define FA_ReadLine(channel)        logReadLine(channel)
+#define FA_ReadLight()              logReadLight()
+#define FA_ReadSwitch(sw)           logReadSwitch(sw)
+#define FA_ClockMS()                logClockMS()
+#define FA_SetMotors(left, right)   logSetMotors(left, right)
+#define FA_Forwards(distance)       logForwards(distance)
+#define FA_Backwards(distance)      logBackwards(distance)
+#define FA_Left(angle)              logLeft(angle)
+#define FA_Right(angle)             logRight(angle)
+#define FA_DelayMillis(ms)          logDelayMillis(ms)
+#define idleDelayMillis(ms)         logIdleDelayMillis(ms)
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+/**
+  * Map sharing between buggies
+  * Doesn't include senselog.h: like uploads, cells heard from other buggies aren't in
+  * the sensor log, so shared runs can't be replayed
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include "allcode_api.h"
+#include "btframe.h"
+#include "share.h"
+#include "walls.h"
+
+bool shareActive = false;
+
+// Cells other buggies are heading for, and when each claim was heard
+static bool shareClaimed[SIZE_X][SIZE_Y];
+static unsigned long shareClaimTime[SIZE_X][SIZE_Y];
+
+/**
+  * Forget other buggies, at the start of a run
+*/
+void resetShare(){
+  int x, y;
+
+  shareActive = false;
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      shareClaimed[x][y] = false;
+    }
+  }
+}
+
+/**
+  * Handle a received frame body. Returns 0 once taken into the model,
+  * or -1 if it isn't a sharing frame or is malformed
+*/
+int receiveShare(const unsigned char *body, int length){
+  Cell *cell;
+  int i;
+
+  if(length < 3 || body[1] >= SIZE_X || body[2] >= SIZE_Y){
+    return -1;
+  }
+
+  if(body[0] == FRAME_CELL && length == SHARE_CELL_LEN){
+    cell = &maze[body[1]][body[2]];
+    // The buggy's own senses of a cell are kept over another's
+    if(!cellKnown(cell)){
+      for(i = DIR_NORTH; i <= DIR_WEST; i++){
+        setWall(cell, i, (body[3] & (1 << i)) != 0);
+      }
+      cell->timesSensed = KNOWN_CELL_SENSES;
+      if(!cell->visited){
+        cell->visited = true;
+        noVisitedCells++;
+      }
+    }
+    if(body[3] & SHARE_CELL_NEST){
+      nestCell = cell;
+    }
+  }else if(body[0] == FRAME_CLAIM && length == SHARE_CLAIM_LEN){
+    shareClaimed[body[1]][body[2]] = true;
+    shareClaimTime[body[1]][body[2]] = FA_ClockMS();
+  }else{
+    return -1;
+  }
+
+  shareActive = true;
+  return 0;
+}
+
+/**
+  * Send a cell's sensed walls to the other buggies, if connected
+*/
+void shareCell(Cell *cell){
+  unsigned char body[SHARE_CELL_LEN];
+  int index = cell - &maze[0][0];
+  int i;
+
+  if(!FA_BTConnected()){
+    return;
+  }
+
+  body[0] = FRAME_CELL;
+  body[1] = index / SIZE_Y;
+  body[2] = index % SIZE_Y;
+  body[3] = cell == nestCell ? SHARE_CELL_NEST : 0;
+  for(i = DIR_NORTH; i <= DIR_WEST; i++){
+    if(cell->walls[i]){
+      body[3] |= 1 << i;
+    }
+  }
+  sendFrame(body, SHARE_CELL_LEN);
+}
+
+/**
+  * Tell the other buggies which unmapped cell this one is heading for, if connected
+*/
+void shareClaim(int x, int y){
+  unsigned char body[SHARE_CLAIM_LEN];
+
+  if(!FA_BTConnected()){
+    return;
+  }
+
+  body[0] = FRAME_CLAIM;
+  body[1] = x;
+  body[2] = y;
+  sendFrame(body, SHARE_CLAIM_LEN);
+}
+
+/**
+  * Check whether another buggy is still heading for a cell. The clock isn't in the sensor
+  * log, so it is only read once sharing, or a replay of a buggy's run alone would diverge.
+*/
+bool shareIsClaimed(int x, int y){
+  return shareActive && shareClaimed[x][y] && FA_ClockMS() - shareClaimTime[x][y] < SHARE_CLAIM_MS;
+}
@@ -0,0 +1,39 @@
+/**
+  * Map sharing between buggies
+  * Several buggies exploring one maze tell each other, in frames over bluetooth (relayed
+  * between them by the host they're connected to), which cells they have sensed and which
+  * unmapped cell each is heading for. A buggy takes another's cells straight into its
+  * maze model as known, and once it has heard from another buggy it stops wall following:
+  * at each decision it heads for the nearest cell nobody has mapped or claimed (findFrontier(),
+  * planner.h), along the quickest route through the known maze (ROUTE_TO_FRONTIER).
+  * Exploring is done when no unmapped cell can be reached.
+  *
+  * FRAME_CELL body: FRAME_CELL, x, y, then the cell's wall bits 1 << heading, plus
+  *   SHARE_CELL_NEST if it is the nest.
+  * FRAME_CLAIM body: FRAME_CLAIM, x, y of the unmapped cell the sender is heading for.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef SHARE_H
+#define SHARE_H
+
+#include "main.h"
+
+// Set in a FRAME_CELL wall byte when the cell is the nest
+#define SHARE_CELL_NEST     0x10
+#define SHARE_CELL_LEN      4
+#define SHARE_CLAIM_LEN     3
+
+// How long another buggy's claim on a cell is respected (ms), in case it never gets there
+#define SHARE_CLAIM_MS      15000
+
+// Whether another buggy has been heard from this run, so exploring is shared
+extern bool shareActive;
+
+void resetShare();
+int receiveShare(const unsigned char *body, int length);
+void shareCell(Cell *cell);
+void shareClaim(int x, int y);
+bool shareIsClaimed(int x, int y);
+
+#endif
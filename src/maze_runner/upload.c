@@ -0,0 +1,358 @@
+/**
+  * Map and route upload
+  * Doesn't include senselog.h: bluetooth input isn't in the sensor log, so the wait for
+  * an upload mustn't be either, or replays (which are never connected) would diverge
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include "allcode_api.h"
+#include "btframe.h"
+#include "power.h"
+#include "upload.h"
+#include "share.h"
+#include "walls.h"
+
+bool uploadHasMap = false;
+bool uploadHasRoute = false;
+
+// The uploaded map: a byte per cell as in FRAME_MAP, the start pose and the nest (-1 if none)
+static unsigned char uploadCells[SIZE_X][SIZE_Y];
+static int uploadStartX, uploadStartY, uploadStartDirection;
+static int uploadNestX, uploadNestY;
+
+// The uploaded route and the pose it starts from
+static unsigned char uploadRoute[ROUTE_MAX];
+static int uploadRouteLength;
+static int uploadRouteX, uploadRouteY, uploadRouteDirection;
+
+// Inbound frames, fed from the bluetooth receive buffer
+static FrameParser uploadParser;
+static bool uploadParserReady = false;
+
+/**
+  * Check that a cell is inside the maze
+*/
+static bool uploadInMaze(int x, int y){
+  return x >= 0 && x < SIZE_X && y >= 0 && y < SIZE_Y;
+}
+
+/**
+  * Step from a cell in a heading, returning false if that leaves the maze
+*/
+static bool uploadStep(int *x, int *y, int direction){
+  switch(direction){
+    case DIR_NORTH: (*y)++; break;
+    case DIR_EAST:  (*x)++; break;
+    case DIR_SOUTH: (*y)--; break;
+    case DIR_WEST:  (*x)--; break;
+  }
+  return uploadInMaze(*x, *y);
+}
+
+/**
+  * Check a route against the uploaded map: it mustn't drive through a wall of a known cell
+*/
+static bool uploadRouteOpen(){
+  int i, x = uploadRouteX, y = uploadRouteY;
+  unsigned char here, next;
+
+  for(i = 0; i < uploadRouteLength; i++){
+    here = uploadCells[x][y];
+    uploadStep(&x, &y, uploadRoute[i]);
+    next = uploadCells[x][y];
+    if(((here & UPLOAD_CELL_KNOWN) && (here & (1 << uploadRoute[i])))
+      || ((next & UPLOAD_CELL_KNOWN) && (next & (1 << ((uploadRoute[i] + 2) % 4))))){
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+  * Decode and validate a FRAME_MAP body
+*/
+static int decodeMap(const unsigned char *body, int length){
+  int x, y, direction, nx, ny;
+  unsigned char cell, other;
+  const unsigned char *cells = &body[8];
+
+  if(length == 1){
+    uploadHasMap = false;
+    uploadHasRoute = false;
+    return UPLOAD_OK;
+  }
+  if(length != UPLOAD_MAP_LEN || body[1] != SIZE_X || body[2] != SIZE_Y){
+    return UPLOAD_BAD_FORMAT;
+  }
+  if(!uploadInMaze(body[3], body[4]) || body[5] > DIR_WEST
+    || !(uploadInMaze(body[6], body[7]) || (body[6] == UPLOAD_NO_NEST && body[7] == UPLOAD_NO_NEST))){
+    return UPLOAD_BAD_POSE;
+  }
+
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      cell = cells[x * SIZE_Y + y];
+      if(!(cell & UPLOAD_CELL_KNOWN)){
+        continue;
+      }
+      for(direction = DIR_NORTH; direction <= DIR_WEST; direction++){
+        nx = x;
+        ny = y;
+        if(!uploadStep(&nx, &ny, direction)){
+          // The outside of the maze is always walled off
+          if(!(cell & (1 << direction))){
+            return UPLOAD_BAD_WALLS;
+          }
+          continue;
+        }
+        other = cells[nx * SIZE_Y + ny];
+        if((other & UPLOAD_CELL_KNOWN) && !(cell & (1 << direction)) != !(other & (1 << ((direction + 2) % 4)))){
+          return UPLOAD_BAD_WALLS;
+        }
+      }
+    }
+  }
+
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      uploadCells[x][y] = cells[x * SIZE_Y + y];
+    }
+  }
+  uploadStartX = body[3];
+  uploadStartY = body[4];
+  uploadStartDirection = body[5];
+  uploadNestX = body[6] == UPLOAD_NO_NEST ? -1 : body[6];
+  uploadNestY = body[7] == UPLOAD_NO_NEST ? -1 : body[7];
+  uploadHasMap = true;
+  return UPLOAD_OK;
+}
+
+/**
+  * Decode and validate a FRAME_ROUTE body
+*/
+static int decodeRoute(const unsigned char *body, int length){
+  unsigned char route[ROUTE_MAX];
+  int i, x, y, count, direction;
+
+  if(length < 6){
+    return UPLOAD_BAD_FORMAT;
+  }
+  count = body[4] | (body[5] << 8);
+  if(count > ROUTE_MAX){
+    return UPLOAD_BAD_ROUTE;
+  }
+  if(length != 6 + (count + 3) / 4){
+    return UPLOAD_BAD_FORMAT;
+  }
+  if(!uploadInMaze(body[1], body[2]) || body[3] > DIR_WEST){
+    return UPLOAD_BAD_POSE;
+  }
+
+  x = body[1];
+  y = body[2];
+  for(i = 0; i < count; i++){
+    direction = (body[6 + i / 4] >> (i % 4 * 2)) & 3;
+    if(!uploadStep(&x, &y, direction)){
+      return UPLOAD_BAD_ROUTE;
+    }
+    route[i] = direction;
+  }
+
+  // Only replace the route held once the new one is known to be good
+  for(i = 0; i < count; i++){
+    uploadRoute[i] = route[i];
+  }
+  uploadRouteLength = count;
+  uploadRouteX = body[1];
+  uploadRouteY = body[2];
+  uploadRouteDirection = body[3];
+  uploadHasRoute = true;
+  return UPLOAD_OK;
+}
+
+/**
+  * Handle a received frame body. Returns its UploadStatus, having answered with FRAME_ACK,
+  * or -1 if it isn't an upload frame
+*/
+int receiveUpload(const unsigned char *body, int length){
+  unsigned char ack[3];
+  int status;
+
+  if(body[0] == FRAME_MAP){
+    status = decodeMap(body, length);
+  }else if(body[0] == FRAME_ROUTE){
+    status = decodeRoute(body, length);
+  }else{
+    return -1;
+  }
+
+  if(FA_BTConnected()){
+    ack[0] = FRAME_ACK;
+    ack[1] = body[0];
+    ack[2] = status;
+    sendFrame(ack, 3);
+  }
+  return status;
+}
+
+/**
+  * Handle any bytes received over bluetooth
+  * Returns once the receive buffer is empty
+*/
+void pollUpload(){
+  int length;
+
+  if(!uploadParserReady){
+    resetFrameParser(&uploadParser);
+    uploadParserReady = true;
+  }
+
+  while(FA_BTAvailable()){
+    length = parseFrameByte(&uploadParser, FA_BTGetByte());
+    if(length > 0 && receiveUpload(uploadParser.body, length) < 0){
+#ifdef SHARE_MAP
+      receiveShare(uploadParser.body, length);
+#endif
+    }
+  }
+}
+
+/**
+  * Listen for an upload for up to UPLOAD_WAIT_MS, returning early once one has
+  * arrived and nothing more is coming
+*/
+void waitForUpload(){
+  unsigned long start = FA_ClockMS();
+  bool received = false;
+
+  while(FA_ClockMS() - start < UPLOAD_WAIT_MS){
+    if(FA_BTAvailable()){
+      pollUpload();
+      received = true;
+    }else if(received){
+      return;
+    }
+    idleDelayMillis(UPLOAD_POLL_MS);
+  }
+}
+
+/**
+  * Load the uploaded map into the maze model and set the buggy off on the uploaded
+  * route, or the quickest route to the nest through the map.
+  * Called from initialize() once the model has been reset.
+  * Returns true if the run starts on a route rather than exploring
+*/
+bool applyUpload(){
+  int x, y, i;
+
+  if(uploadHasMap){
+    for(x = 0; x < SIZE_X; x++){
+      for(y = 0; y < SIZE_Y; y++){
+        if(!(uploadCells[x][y] & UPLOAD_CELL_KNOWN)){
+          continue;
+        }
+        for(i = DIR_NORTH; i <= DIR_WEST; i++){
+          setWall(&maze[x][y], i, (uploadCells[x][y] & (1 << i)) != 0);
+        }
+        maze[x][y].visited = true;
+        maze[x][y].timesSensed = KNOWN_CELL_SENSES;
+        noVisitedCells++;
+      }
+    }
+    nestCell = uploadNestX >= 0 ? &maze[uploadNestX][uploadNestY] : 0;
+    startPosX = uploadStartX;
+    startPosY = uploadStartY;
+    startDirection = uploadStartDirection;
+  }
+  if(uploadHasRoute && !uploadHasMap){
+    startPosX = uploadRouteX;
+    startPosY = uploadRouteY;
+    startDirection = uploadRouteDirection;
+  }
+
+  currentPosX = startPosX;
+  currentPosY = startPosY;
+  currentDirection = startDirection;
+  currentCell = &maze[currentPosX][currentPosY];
+
+  // An uploaded route is used if it starts where the run does and agrees with the map
+  if(uploadHasRoute && uploadRouteX == startPosX && uploadRouteY == startPosY
+    && uploadRouteDirection == startDirection && (!uploadHasMap || uploadRouteOpen())){
+    for(i = 0; i < uploadRouteLength; i++){
+      route[i] = uploadRoute[i];
+    }
+    routeLength = uploadRouteLength;
+    routeStep = 0;
+    routePhase = ROUTE_TO_NEST;
+    return true;
+  }
+
+  if(uploadHasMap && nestCell != 0 && planRoute(startPosX, startPosY, startDirection, uploadNestX, uploadNestY) >= 0){
+    routePhase = ROUTE_TO_NEST;
+    return true;
+  }
+  return false;
+}
+
+/**
+  * Encode the maze model as a FRAME_MAP body, returning its length
+*/
+int encodeMap(unsigned char *body){
+  int x, y, i;
+  int nest = nestCell != 0 ? nestCell - &maze[0][0] : -1;
+  unsigned char cell;
+
+  body[0] = FRAME_MAP;
+  body[1] = SIZE_X;
+  body[2] = SIZE_Y;
+  body[3] = startPosX;
+  body[4] = startPosY;
+  body[5] = startDirection;
+  body[6] = nest >= 0 ? nest / SIZE_Y : UPLOAD_NO_NEST;
+  body[7] = nest >= 0 ? nest % SIZE_Y : UPLOAD_NO_NEST;
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      cell = cellKnown(&maze[x][y]) ? UPLOAD_CELL_KNOWN : 0;
+      for(i = DIR_NORTH; i <= DIR_WEST; i++){
+        if(maze[x][y].walls[i]){
+          cell |= 1 << i;
+        }
+      }
+      body[8 + x * SIZE_Y + y] = cell;
+    }
+  }
+  return UPLOAD_MAP_LEN;
+}
+
+/**
+  * Encode the planned route as a FRAME_ROUTE body, returning its length
+*/
+int encodeRoute(unsigned char *body, int fromX, int fromY, int fromDirection){
+  int i;
+
+  body[0] = FRAME_ROUTE;
+  body[1] = fromX;
+  body[2] = fromY;
+  body[3] = fromDirection;
+  body[4] = routeLength & 0xff;
+  body[5] = (routeLength >> 8) & 0xff;
+  for(i = 0; i < (routeLength + 3) / 4; i++){
+    body[6 + i] = 0;
+  }
+  for(i = 0; i < routeLength; i++){
+    body[6 + i / 4] |= (route[i] & 3) << (i % 4 * 2);
+  }
+  return 6 + (routeLength + 3) / 4;
+}
+
+/**
+  * Send the maze model over bluetooth if connected, so it can be uploaded to a later run
+*/
+void sendMap(){
+  unsigned char body[UPLOAD_MAP_LEN];
+
+  if(!FA_BTConnected()){
+    return;
+  }
+  sendFrame(body, encodeMap(body));
+}
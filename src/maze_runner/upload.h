@@ -0,0 +1,67 @@
+/**
+  * Map and route upload
+  * Accepts a maze map (walls, nest and start pose) and/or a precomputed route from a
+  * host tool over bluetooth, in checksummed frames (btframe.h), so that a run can start
+  * from a known maze and drive the quickest route to the nest without exploring first.
+  * The robot sends its own map in the same format on finishing, ready to upload again.
+  *
+  * FRAME_MAP body: FRAME_MAP, SIZE_X, SIZE_Y, start x, start y, start heading, nest x,
+  *   nest y (UPLOAD_NO_NEST if not found), then a byte per cell (x major, as maze[x][y]): wall bits 1 << heading,
+  *   plus UPLOAD_CELL_KNOWN if its walls have been sensed. A body of just FRAME_MAP
+  *   forgets the uploaded map and route.
+  * FRAME_ROUTE body: FRAME_ROUTE, start x, start y, start heading, cell count (2 bytes,
+  *   little endian), then the heading to leave each cell by, four to a byte from the low bits up.
+  * Each is answered by FRAME_ACK: FRAME_ACK, the frame type, an UploadStatus.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include "planner.h"
+#include "btframe.h"
+
+// Set in a FRAME_MAP cell byte when the cell's walls are known
+#define UPLOAD_CELL_KNOWN   0x10
+// Nest x and y in a FRAME_MAP when the nest hasn't been found
+#define UPLOAD_NO_NEST      0xff
+
+// How long the robot listens for an upload at the start of a run when connected (ms),
+// and how often it checks
+#define UPLOAD_WAIT_MS      2000
+#define UPLOAD_POLL_MS      20
+
+// Largest FRAME_MAP and FRAME_ROUTE bodies
+#define UPLOAD_MAP_LEN      (8 + SIZE_X * SIZE_Y)
+#define UPLOAD_ROUTE_LEN    (6 + (ROUTE_MAX + 3) / 4)
+
+// Both must fit in a frame, which limits SIZE_X and SIZE_Y (a map to about 190 cells)
+#if UPLOAD_MAP_LEN > FRAME_MAX_LEN || UPLOAD_ROUTE_LEN > FRAME_MAX_LEN
+#error "The maze is too big for its map or route to fit in a frame (FRAME_MAX_LEN)"
+#endif
+
+typedef enum{
+  UPLOAD_OK,
+  // Wrong length or maze size
+  UPLOAD_BAD_FORMAT,
+  // Start or nest outside the maze
+  UPLOAD_BAD_POSE,
+  // Two known cells disagree about the wall between them, or a known cell is open to the outside
+  UPLOAD_BAD_WALLS,
+  // The route is too long, leaves the maze or runs through an uploaded wall
+  UPLOAD_BAD_ROUTE,
+} UploadStatus;
+
+// Whether a map or route has been uploaded (kept from run to run)
+extern bool uploadHasMap;
+extern bool uploadHasRoute;
+
+void pollUpload();
+void waitForUpload();
+int receiveUpload(const unsigned char *body, int length);
+bool applyUpload();
+int encodeMap(unsigned char *body);
+int encodeRoute(unsigned char *body, int fromX, int fromY, int fromDirection);
+void sendMap();
+
+#endif
@@ -0,0 +1,92 @@
+/**
+  * Wall confidence
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#include "walls.h"
+
+/**
+  * Add evidence to one side of a wall, keeping the cell's best guess in step
+*/
+static void addEvidence(Cell *cell, int direction, int evidence){
+  int total = cell->wallEvidence[direction] + evidence;
+
+  if(total > WALL_EVIDENCE_MAX){
+    total = WALL_EVIDENCE_MAX;
+  }else if(total < -WALL_EVIDENCE_MAX){
+    total = -WALL_EVIDENCE_MAX;
+  }
+  cell->wallEvidence[direction] = total;
+  cell->walls[direction] = total > 0;
+}
+
+/**
+  * Forget all the evidence, at the start of a run, leaving only the outside walls
+*/
+void resetWalls(){
+  int x, y, i;
+
+  for(x = 0; x < SIZE_X; x++){
+    for(y = 0; y < SIZE_Y; y++){
+      for(i = DIR_NORTH; i <= DIR_WEST; i++){
+        maze[x][y].wallEvidence[i] = 0;
+        maze[x][y].walls[i] = false;
+        if(neighbourCell(x, y, i) == 0){
+          setWall(&maze[x][y], i, true);
+        }
+      }
+    }
+  }
+}
+
+/**
+  * Weigh an IR reading of the wall on one side of a cell, for both cells it divides
+*/
+void senseWall(int x, int y, int direction, unsigned int reading){
+  long evidence = ((long)reading - WALL_READING_MIDDLE) * WALL_EVIDENCE_READ / WALL_READING_SPAN;
+  Cell *next = neighbourCell(x, y, direction);
+
+  if(evidence > WALL_EVIDENCE_READ){
+    evidence = WALL_EVIDENCE_READ;
+  }else if(evidence < -WALL_EVIDENCE_READ){
+    evidence = -WALL_EVIDENCE_READ;
+  }
+
+  addEvidence(&maze[x][y], direction, evidence);
+  if(next != 0){
+    addEvidence(next, (direction + 2) % 4, evidence);
+  }
+}
+
+/**
+  * Set a wall known outright, from an uploaded map or another buggy
+*/
+void setWall(Cell *cell, int direction, bool wall){
+  cell->wallEvidence[direction] = wall ? WALL_EVIDENCE_MAX : -WALL_EVIDENCE_MAX;
+  cell->walls[direction] = wall;
+}
+
+/**
+  * Check whether there is enough evidence to trust a wall either way
+*/
+bool wallConfident(Cell *cell, int direction){
+  return cell->wallEvidence[direction] >= WALL_CONFIDENT || cell->wallEvidence[direction] <= -WALL_CONFIDENT;
+}
+
+/**
+  * Check whether a cell has been visited but still has a wall in doubt,
+  * so the buggy must stop there to sense it again
+*/
+bool cellInDoubt(Cell *cell){
+  int i;
+
+  if(!cell->visited){
+    return false;
+  }
+  for(i = DIR_NORTH; i <= DIR_WEST; i++){
+    if(!wallConfident(cell, i)){
+      return true;
+    }
+  }
+  return false;
+}
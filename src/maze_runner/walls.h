@@ -0,0 +1,42 @@
+/**
+  * Wall confidence
+  * Rather than trusting a single IR reading, each wall of the maze model keeps the
+  * evidence for it as a small fixed point log odds (Cell.wallEvidence): positive for a
+  * wall, negative for an opening. Every reading adds evidence in proportion to how far it
+  * lies from the gap between the readings of an opening (a far wall seen down the next
+  * cell) and of a wall, so a clear reading is trusted at once and a reading in the gap
+  * only counts for a little. A wall is shared by the cells either side, so evidence from
+  * either cell counts for both. Cell.walls is the sign of the evidence, the best guess.
+  *
+  * A cell whose walls are all trusted is known (cellKnown()): the buggy drives through it
+  * on the stored model. A visited cell with a wall still in doubt is sensed again each
+  * time the buggy reaches it, so one bad reading costs a stop rather than a wrong map.
+  * The outside walls of the maze are known from the start.
+  * @author Rhys Evans (rhe24@aber.ac.uk)
+  * @version 1.0
+*/
+#ifndef WALLS_H
+#define WALLS_H
+
+#include "main.h"
+
+// Evidence is kept within +/- WALL_EVIDENCE_MAX, which walls known outright (uploaded,
+// shared or outside walls) start at, so a few contrary readings can't overturn them
+#define WALL_EVIDENCE_MAX       64
+// The most evidence one reading gives, and how much a wall needs to be trusted
+#define WALL_EVIDENCE_READ      16
+#define WALL_CONFIDENT          16
+// The IR reading that says nothing either way, and how far either side of it a reading
+// gives full evidence: openings read up to about 50 and walls from about 110
+#define WALL_READING_MIDDLE     80
+#define WALL_READING_SPAN       30
+// The extra readings detect() takes of sides still in doubt
+#define WALL_RESENSE_READS      2
+
+void resetWalls();
+void senseWall(int x, int y, int direction, unsigned int reading);
+void setWall(Cell *cell, int direction, bool wall);
+bool wallConfident(Cell *cell, int direction);
+bool cellInDoubt(Cell *cell);
+
+#endif